@@ -1,37 +1,52 @@
 #include "Engine.hpp"
+#include "Scene.hpp"
+#include <cmath>
 
-Animator::Animator() : Component(), currentAnimation(""), nextAnimation(""),
-                       isPlaying(true),
-                       mode(AnimationMode::Loop)
+Animator::Animator() : Component()
 {
     sprite = nullptr;
     object = nullptr;
-    currentFrame = 0;
-    frameCount = 0;
-    frameDuration = 0;
-    currentTime = 0;
-    isReversed = false;
     isLoad = true;
+    slot = AnimationSystem::Instance().add(this);
 }
 
-void Animator::OnDestroy()
+Animator::~Animator()
 {
-    for (auto &pair : animations)
-    {
-        delete pair.second;
-    }
-    animations.clear();
+    AnimationSystem::Instance().remove(slot);
 }
 
-
 void Animator::OnUpdate(float deltaTime)
 {
-    if (animations.size() == 0 || !isLoad)
+    (void)deltaTime;
+    if (!isLoad)
         return;
 
+    // só marca, o AnimationSystem avança todos de uma vez
+    AnimationSystem &system = AnimationSystem::Instance();
+    uint8_t state = system.flags[slot] | ANIM_AWAKE;
+
+    Scene *scene = object->scene;
+    if (scene)
+    {
+        const Rectangle &view = scene->cameraView;
+        const Rectangle &bound = object->bound;
+        float margin = system.margin;
+        bool visible = bound.x + bound.width >= view.x - margin && bound.x <= view.x + view.width + margin &&
+                       bound.y + bound.height >= view.y - margin && bound.y <= view.y + view.height + margin;
+        state = visible ? (state | ANIM_VISIBLE) : (state & ~ANIM_VISIBLE);
+    }
+    else
+    {
+        state |= ANIM_VISIBLE;
+    }
+    system.flags[slot] = state;
+}
+
+void Animator::writeSprite(const AnimationClip &clip, int frame, bool newClip)
+{
     if (!sprite)
     {
-        sprite = object->GetComponent<SpriteComponent>();
+        sprite = object ? object->GetComponent<SpriteComponent>() : nullptr;
         if (!sprite)
         {
             Log(LOG_ERROR, "Animator::OnUpdate() : SpriteComponent not found");
@@ -39,162 +54,149 @@ void Animator::OnUpdate(float deltaTime)
             return;
         }
     }
-
-    //   Log(LOG_INFO, "Animator::OnUpdate() : %s", object->name.c_str());
-
-    if (isPlaying)
-    {
-        Animation *animation = GetAnimation();
-        if (!animation)
-            return;
-        animation->Update(deltaTime, mode);
-
-        currentFrame = animation->currentFrame;
-        currentTime = animation->currentTime;
-        frameCount = animation->frameCount;
-        frameDuration = animation->frameDuration;
-        isReversed = animation->isReversed;
-
-        if (nextAnimation != "" && animation->currentFrame == animation->frameCount - 1)
-        {
-            currentAnimation = nextAnimation;
-            nextAnimation = "";
-            animation->currentFrame = 0;
-            animation->currentTime = 0;
-            Play();
-        }
-        // verifica se a animação atual terminou de ser reproduzida
-        if (animation->currentFrame == animation->frameCount - 1)
-        {
-            if (mode == AnimationMode::Loop)
-            {
-                animation->currentFrame = 0; // reinicia a animação
-                animation->currentTime = 0;
-            }
-            else if (mode == AnimationMode::PingPong)
-            {
-                animation->isReversed = true; // inverte a reprodução da animação
-            }
-        }
-
-        // verifica se a animação atual terminou de ser reproduzida no modo PingPong
-        if (animation->currentFrame == 0 && animation->isReversed)
-        {
-            if (mode == AnimationMode::PingPong)
-            {
-                animation->isReversed = false; // inverte a reprodução da animação de volta
-            }
-        }
-    }
-
-    Animation *animation = GetAnimation();
-    if (!animation)
-        return;
-
-    if (sprite)
-    {
-
-        Rectangle frameRectangle = animation->GetFrame();
-        sprite->clip.x = frameRectangle.x;
-        sprite->clip.y = frameRectangle.y;
-        sprite->clip.width = frameRectangle.width;
-        sprite->clip.height = frameRectangle.height;
-        sprite->graph = animation->graph;
-    }
+    if (newClip)
+        sprite->SetGraph(clip.graphID);
+    sprite->clip = clip.frames[frame];
 }
 
 void Animator::Play()
 {
-    isPlaying = true;
+    AnimationSystem::Instance().flags[slot] |= ANIM_PLAYING;
 }
 
 void Animator::Pause()
 {
-    isPlaying = false;
+    AnimationSystem::Instance().flags[slot] &= ~ANIM_PLAYING;
 }
 
 void Animator::Stop()
 {
-    isPlaying = false;
-    if (animations.size() == 0 || !isLoad)
-        return;
-    Animation *animation = GetAnimation();
-    if (!animation)
-        return;
+    AnimationSystem &system = AnimationSystem::Instance();
+    system.flags[slot] &= ~ANIM_PLAYING;
+    system.reset(slot);
+    system.sync(slot);
+}
 
-    animation->currentFrame = 0;
-    animation->currentTime = 0;
+int Animator::GetAnimationID(const std::string &name) const
+{
+    AnimationLibrary &library = AnimationLibrary::Instance();
+    for (int id : clips)
+    {
+        const AnimationClip *clip = library.getClip(id);
+        if (clip && clip->name == name)
+            return id;
+    }
+    return -1;
 }
 
 void Animator::SetAnimation(const std::string &name, bool now)
 {
-    if (animations.size() == 0 || !isLoad)
+    if (clips.size() == 0 || !isLoad)
         return;
-    if (now)
-    {
-        currentAnimation = name;
-        nextAnimation = "";
-        Play();
-    }
-    else if (currentAnimation != name)
+    int clipID = GetAnimationID(name);
+    if (clipID == -1)
     {
-        if (nextAnimation == "")
-        {
-            nextAnimation = name; // marca a próxima animação a ser reproduzida
-        }
-        else
-        {
-            nextAnimation = name; // sobrescreve a próxima animação marcada
-        }
+        Log(LOG_WARNING, "Animator::SetAnimation() : %s not found", name.c_str());
+        return;
     }
+    SetAnimation(clipID, now);
 }
-Animation *Animator::GetAnimation()
+
+void Animator::SetAnimation(int clipID, bool now)
 {
-    auto it = std::find_if(animations.begin(), animations.end(),
-                           [this](const std::pair<std::string, Animation *> &pair)
-                           {
-                               return pair.first == currentAnimation;
-                           });
-    if (it != animations.end())
+    if (clipID < 0 || !isLoad)
+        return;
+    AnimationSystem &system = AnimationSystem::Instance();
+    if (now)
     {
-        return it->second;
+        system.play(slot, clipID);
+        system.next[slot] = -1;
+        system.flags[slot] |= ANIM_PLAYING;
     }
-    else
+    else if (system.clip[slot] != clipID)
     {
-
-        return animations.front().second;
+        system.next[slot] = clipID; // marca (ou sobrescreve) a próxima animação a ser reproduzida
     }
 }
 
-void Animator::AddAnimation(const std::string &name, Animation *animation)
+void Animator::AddClip(int clipID)
 {
-    animations.push_back(std::make_pair(name, animation));
-    if (currentAnimation == "")
+    if (!AnimationLibrary::Instance().getClip(clipID))
     {
-        currentAnimation = name;
+        Log(LOG_ERROR, "Animator::AddClip() : clip %d not found", clipID);
+        return;
+    }
+    clips.push_back(clipID);
+    AnimationSystem &system = AnimationSystem::Instance();
+    if (system.clip[slot] == -1)
+    {
+        system.play(slot, clipID);
+        system.sync(slot);
     }
-    OnUpdate(0);
 }
 
 void Animator::Add(const std::string &name, const std::string &graph, int rows, int columns, int frameCount, float framesPerSecond)
 {
-    float frameDuration = 1.0f / framesPerSecond;
-    Animation *animation = new Animation(graph, rows, columns, frameCount, frameDuration);
-    AddAnimation(name, animation);
+    Add(name, Assets::Instance().getGraphID(graph), rows, columns, frameCount, framesPerSecond);
+}
+
+void Animator::Add(const std::string &name, int graphID, int rows, int columns, int frameCount, float framesPerSecond)
+{
+    AddClip(AnimationLibrary::Instance().addClip(name, graphID, rows, columns, frameCount, framesPerSecond));
+}
+
+void Animator::Add(const std::string &name, GraphKey key, int rows, int columns, int frameCount, float framesPerSecond)
+{
+    Add(name, Assets::Instance().getGraphID(key), rows, columns, frameCount, framesPerSecond);
 }
 
 void Animator::SetMode(AnimationMode mode)
 {
-    this->mode = mode;
-    if (animations.size() == 0 || !isLoad)
-        return;
-    Animation *animation = GetAnimation();
-    if (!animation)
-        return;
-    animation->currentFrame = 0;
-    animation->currentTime = 0;
-    animation->isReversed = false;
+    AnimationSystem &system = AnimationSystem::Instance();
+    system.mode[slot] = (uint8_t)mode;
+    system.flags[slot] |= ANIM_MODE_OVERRIDE;
+    system.reset(slot);
+}
+
+int Animator::getCurrentFrame() const
+{
+    AnimationSystem &system = AnimationSystem::Instance();
+    system.resolve(slot);
+    return system.frame[slot];
+}
+
+float Animator::getCurrentTime() const
+{
+    AnimationSystem &system = AnimationSystem::Instance();
+    system.resolve(slot);
+    return system.time[slot];
 }
+
+bool Animator::getIsReversed() const
+{
+    AnimationSystem &system = AnimationSystem::Instance();
+    system.resolve(slot);
+    return (system.flags[slot] & ANIM_REVERSED) != 0;
+}
+
+int Animator::getFrameCount() const
+{
+    const AnimationClip *clip = GetClip();
+    return clip ? clip->frameCount : 0;
+}
+
+float Animator::getFrameDuration() const
+{
+    const AnimationClip *clip = GetClip();
+    return clip && clip->frameCount > 0 ? clip->durations[getCurrentFrame()] : 0;
+}
+
+std::string Animator::getName() const
+{
+    const AnimationClip *clip = GetClip();
+    return clip ? clip->name : "";
+}
+
 void Animator::OnInit()
 {
     if (object != nullptr)
@@ -216,108 +218,312 @@ void Animator::OnDebug()
     // Log(LOG_INFO, "Animator::OnDebug()");
 }
 
-
-
 //*********************************************************************************************************************
-//**                         ANIMATION                                                                              **
+//**                         ANIMATION SYSTEM                                                                       **
 //*********************************************************************************************************************
 
-Animation::Animation(const std::string &graphID, int rows, int columns, int frameCount, float frameDuration) : frameCount(frameCount),
-                                                                                                               currentFrame(0),
-                                                                                                               frameDuration(frameDuration),
-                                                                                                               currentTime(0),
-                                                                                                               isReversed(false), rows(rows),
-                                                                                                               columns(columns)
+int AnimationSystem::add(Animator *animator)
+{
+    int slot = (int)owners.size();
+    time.push_back(0);
+    pending.push_back(0);
+    frame.push_back(0);
+    clip.push_back(-1);
+    next.push_back(-1);
+    mode.push_back((uint8_t)AnimationMode::Loop);
+    flags.push_back(ANIM_PLAYING);
+    owners.push_back(animator);
+    return slot;
+}
 
+void AnimationSystem::remove(int slot)
 {
-    this->graphID = graphID;
-    graph = Assets::Instance().getGraph(graphID);
-    if (graph)
-    {
-        imageWidth = graph->texture.width;
-        imageHeight = graph->texture.height;
-        // Log(LOG_INFO, "Animation::Animation() : graphID %s %d %d", graphID.c_str(), imageWidth, imageHeight);
-    }
-    else
+    int last = (int)owners.size() - 1;
+    if (slot < 0 || slot > last)
+        return;
+    if (slot != last)
     {
-        Log(LOG_ERROR, "Animation::Animation() : graphID not found %s", graphID.c_str());
+        time[slot] = time[last];
+        pending[slot] = pending[last];
+        frame[slot] = frame[last];
+        clip[slot] = clip[last];
+        next[slot] = next[last];
+        mode[slot] = mode[last];
+        flags[slot] = flags[last];
+        owners[slot] = owners[last];
+        owners[slot]->slot = slot;
     }
+    time.pop_back();
+    pending.pop_back();
+    frame.pop_back();
+    clip.pop_back();
+    next.pop_back();
+    mode.pop_back();
+    flags.pop_back();
+    owners.pop_back();
 }
 
-Rectangle Animation::GetFrame()
+void AnimationSystem::play(int slot, int clipID)
 {
-    Rectangle rect;
-    if (graph == nullptr)
-    {
-        Log(LOG_ERROR, "Animation::GetFrame() : graph is null");
-        return rect;
-    }
-    rect.width = imageWidth / columns;
-    rect.height = imageHeight / rows;
-    rect.x = (currentFrame % columns) * rect.width;
-    rect.y = (currentFrame / columns) * rect.height;
-    return rect;
+    if (clip[slot] == clipID)
+        return;
+    clip[slot] = clipID;
+    flags[slot] |= ANIM_NEW_CLIP;
+    reset(slot);
+
+    const AnimationClip *c = AnimationLibrary::Instance().getClip(clipID);
+    if (c && !(flags[slot] & ANIM_MODE_OVERRIDE))
+        mode[slot] = (uint8_t)c->mode;
 }
 
-void Animation::Update(float deltaTime, AnimationMode mode)
+void AnimationSystem::reset(int slot)
 {
-    if (!graph)
+    frame[slot] = 0;
+    time[slot] = 0;
+    pending[slot] = 0;
+    flags[slot] = (flags[slot] | ANIM_DIRTY) & ~(ANIM_REVERSED | ANIM_FINISHED);
+}
+
+void AnimationSystem::resolve(int slot)
+{
+    if (pending[slot] <= 0)
+        return;
+    const AnimationClip *c = AnimationLibrary::Instance().getClip(clip[slot]);
+    if (!c || c->frameCount <= 0)
         return;
-    currentTime += deltaTime;
+    float step = pending[slot];
+    pending[slot] = 0;
+    if (advance(*c, (AnimationMode)mode[slot], step, time[slot], frame[slot], flags[slot]))
+        flags[slot] |= ANIM_DIRTY;
+}
 
-    if (mode == AnimationMode::Loop)
+void AnimationSystem::sync(int slot)
+{
+    uint8_t state = flags[slot];
+    if (!(state & ANIM_DIRTY) || !owners[slot]->object)
+        return;
+    flags[slot] = state & ~(ANIM_DIRTY | ANIM_NEW_CLIP);
+
+    const AnimationClip *c = AnimationLibrary::Instance().getClip(clip[slot]);
+    Animator *animator = owners[slot];
+    if (c && c->frameCount > 0 && animator->isLoad)
+        animator->writeSprite(*c, frame[slot], (state & ANIM_NEW_CLIP) != 0);
+}
+
+bool AnimationSystem::advance(const AnimationClip &clip, AnimationMode mode, float deltaTime, float &time, int &frame, uint8_t &state)
+{
+    int start = frame;
+    time += deltaTime;
+
+    // long stretches out of view: skip the whole cycles, the phase is the same
+    if (mode == AnimationMode::Loop && clip.length > 0 && time > clip.length)
     {
-        while (currentTime >= frameDuration)
+        time = fmodf(time, clip.length);
+    }
+    else if (mode == AnimationMode::PingPong && clip.frameCount > 1)
+    {
+        float cycle = clip.length * 2 - clip.durations[0] - clip.durations[clip.frameCount - 1];
+        if (cycle > 0 && time > cycle)
+            time = fmodf(time, cycle);
+    }
+
+    float duration = clip.durations[frame];
+    while (duration > 0 && time >= duration)
+    {
+        if (mode == AnimationMode::Loop)
         {
-            currentFrame = (currentFrame + 1) % frameCount;
-            currentTime -= frameDuration;
+            frame = frame + 1 < clip.frameCount ? frame + 1 : 0;
         }
+        else if (mode == AnimationMode::PingPong)
+        {
+            if (clip.frameCount > 1)
+            {
+                int frameIndex = frame + ((state & ANIM_REVERSED) ? -1 : 1);
+                if (frameIndex < 0)
+                {
+                    frameIndex = 1;
+                    state &= ~ANIM_REVERSED;
+                }
+                else if (frameIndex >= clip.frameCount)
+                {
+                    frameIndex = clip.frameCount - 2;
+                    state |= ANIM_REVERSED;
+                }
+                frame = frameIndex;
+            }
+        }
+        else // Stop, Once
+        {
+            if (frame >= clip.frameCount - 1)
+            {
+                time = 0;
+                state |= ANIM_FINISHED;
+                break;
+            }
+            frame++;
+        }
+        time -= duration;
+        duration = clip.durations[frame];
     }
-    else if (mode == AnimationMode::PingPong)
+    return frame != start;
+}
+
+void AnimationSystem::update(float deltaTime)
+{
+    const std::vector<AnimationClip *> &clips = AnimationLibrary::Instance().getClips();
+    int clipCount = (int)clips.size();
+    events.clear();
+
+    // owners can not be added or removed while this runs, the sprite writes don't touch the system
+    size_t count = owners.size();
+    for (size_t i = 0; i < count; i++)
     {
-        int frameIndex = currentFrame;
-        int frameIncrement = isReversed ? -1 : 1;
+        uint8_t state = flags[i];
+        if (!(state & ANIM_AWAKE))
+            continue;
+        state &= ~ANIM_AWAKE;
 
-        while (currentTime >= frameDuration)
+        int id = clip[i];
+        if (id < 0 || id >= clipCount || clips[id]->frameCount <= 0)
         {
-            frameIndex += frameIncrement;
+            flags[i] = state;
+            continue;
+        }
+        const AnimationClip *c = clips[id];
 
-            if (frameIndex < 0)
+        if (state & ANIM_PLAYING)
+        {
+            // fora de vista e sem eventos pendentes, só acumula o tempo
+            AnimationMode m = (AnimationMode)mode[i];
+            bool waiting = next[i] != -1 || ((m == AnimationMode::Stop || m == AnimationMode::Once) && !(state & ANIM_FINISHED));
+            if (!(state & ANIM_VISIBLE) && !waiting)
             {
-                frameIndex = 1;
-                isReversed = false;
+                pending[i] += deltaTime;
+                flags[i] = state;
+                continue;
             }
-            else if (frameIndex >= frameCount)
+
+            float step = pending[i] + deltaTime;
+            pending[i] = 0;
+            bool finished = (state & ANIM_FINISHED) != 0;
+            if (advance(*c, m, step, time[i], frame[i], state))
+                state |= ANIM_DIRTY;
+            if (!finished && (state & ANIM_FINISHED))
             {
-                frameIndex = frameCount - 2;
-                isReversed = true;
+                AnimationEvent event;
+                event.animator = owners[i];
+                event.clip = id;
+                events.push_back(event);
             }
 
-            currentTime -= frameDuration;
+            // a animação seguinte começa quando a atual chega ao ultimo frame
+            int nextID = next[i];
+            if (nextID != -1 && frame[i] == c->frameCount - 1 && nextID < clipCount && clips[nextID]->frameCount > 0)
+            {
+                next[i] = -1;
+                flags[i] = state;
+                play((int)i, nextID);
+                state = flags[i];
+                c = clips[nextID];
+            }
         }
 
-        currentFrame = frameIndex;
-    }
-    else if (mode == AnimationMode::Stop)
-    {
-        if (currentFrame < frameCount - 1)
+        if ((state & ANIM_DIRTY) && (state & ANIM_VISIBLE))
         {
-            while (currentTime >= frameDuration)
-            {
-                currentFrame++;
-                currentTime -= frameDuration;
-            }
+            Animator *animator = owners[i];
+            if (animator->isLoad)
+                animator->writeSprite(*c, frame[i], (state & ANIM_NEW_CLIP) != 0);
+            state &= ~(ANIM_DIRTY | ANIM_NEW_CLIP);
         }
+        flags[i] = state;
     }
-    else if (mode == AnimationMode::Once)
+}
+
+//*********************************************************************************************************************
+//**                         ANIMATION LIBRARY                                                                      **
+//*********************************************************************************************************************
+
+int AnimationLibrary::addClip(const std::string &name, int graphID, int rows, int columns, int frameCount, float framesPerSecond, AnimationMode mode)
+{
+    std::string key = TextFormat("%s|%d|%d|%d|%d|%f|%d", name.c_str(), graphID, rows, columns, frameCount, framesPerSecond, (int)mode);
+    auto it = clipIDs.find(key);
+    if (it != clipIDs.end())
+        return it->second;
+
+    AnimationClip *clip = new AnimationClip();
+    clip->name = name;
+    clip->graphID = graphID;
+    clip->rows = rows;
+    clip->columns = columns;
+    clip->frameCount = frameCount;
+    clip->mode = mode;
+    clip->frames.resize(frameCount);
+    clip->durations.assign(frameCount, framesPerSecond > 0 ? 1.0f / framesPerSecond : 0);
+
+    Graph *graph = Assets::Instance().getGraph(graphID);
+    if (graph && rows > 0 && columns > 0)
     {
-        if (currentFrame < frameCount - 1)
+        int frameWidth = graph->width / columns;
+        int frameHeight = graph->height / rows;
+        for (int i = 0; i < frameCount; i++)
         {
-            while (currentTime >= frameDuration)
-            {
-                currentFrame++;
-                currentTime -= frameDuration;
-            }
+            Rectangle &rect = clip->frames[i];
+            rect.x = (float)((i % columns) * frameWidth);
+            rect.y = (float)((i / columns) * frameHeight);
+            rect.width = (float)frameWidth;
+            rect.height = (float)frameHeight;
         }
     }
-}
\ No newline at end of file
+    else
+    {
+        Log(LOG_ERROR, "AnimationLibrary::addClip() : graph not found %s", Assets::Instance().getGraphName(graphID).c_str());
+    }
+
+    return registerClip(clip, key);
+}
+
+int AnimationLibrary::addClip(const std::string &name, int graphID, const std::vector<Rectangle> &frames, const std::vector<float> &durations, AnimationMode mode)
+{
+    if (frames.size() != durations.size())
+    {
+        Log(LOG_ERROR, "AnimationLibrary::addClip() : %s has %d frames and %d durations", name.c_str(), (int)frames.size(), (int)durations.size());
+        return -1;
+    }
+
+    // clips with custom frames are not shared by definition, the caller keeps the id
+    AnimationClip *clip = new AnimationClip();
+    clip->name = name;
+    clip->graphID = graphID;
+    clip->rows = 0;
+    clip->columns = 0;
+    clip->frameCount = (int)frames.size();
+    clip->mode = mode;
+    clip->frames = frames;
+    clip->durations = durations;
+    return registerClip(clip, "");
+}
+
+int AnimationLibrary::registerClip(AnimationClip *clip, const std::string &key)
+{
+    clip->length = 0;
+    for (float duration : clip->durations)
+    {
+        clip->length += duration;
+    }
+
+    int id = (int)clips.size();
+    clips.push_back(clip);
+    if (!key.empty())
+        clipIDs[key] = id;
+    return id;
+}
+
+void AnimationLibrary::clear()
+{
+    for (AnimationClip *clip : clips)
+    {
+        delete clip;
+    }
+    clips.clear();
+    clipIDs.clear();
+}
@@ -0,0 +1,961 @@
+#include "Collision.hpp"
+#include "Scene.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if !defined(COLLISION_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define COLLISION_SIMD
+typedef __m256 Lane;
+static const int LANES = 8;
+static inline Lane Load(const float *p) { return _mm256_loadu_ps(p); }
+static inline Lane Add(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+static inline Lane Sub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+static inline Lane Mul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+static inline Lane Min(Lane a, Lane b) { return _mm256_min_ps(a, b); }
+static inline Lane Max(Lane a, Lane b) { return _mm256_max_ps(a, b); }
+static inline Lane And(Lane a, Lane b) { return _mm256_and_ps(a, b); }
+static inline Lane Less(Lane a, Lane b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Lane LessEqual(Lane a, Lane b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline int Mask(Lane a) { return _mm256_movemask_ps(a); }
+#elif !defined(COLLISION_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define COLLISION_SIMD
+typedef __m128 Lane;
+static const int LANES = 4;
+static inline Lane Load(const float *p) { return _mm_loadu_ps(p); }
+static inline Lane Add(Lane a, Lane b) { return _mm_add_ps(a, b); }
+static inline Lane Sub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+static inline Lane Mul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+static inline Lane Min(Lane a, Lane b) { return _mm_min_ps(a, b); }
+static inline Lane Max(Lane a, Lane b) { return _mm_max_ps(a, b); }
+static inline Lane And(Lane a, Lane b) { return _mm_and_ps(a, b); }
+static inline Lane Less(Lane a, Lane b) { return _mm_cmplt_ps(a, b); }
+static inline Lane LessEqual(Lane a, Lane b) { return _mm_cmple_ps(a, b); }
+static inline int Mask(Lane a) { return _mm_movemask_ps(a); }
+#endif
+
+//*********************************************************************************************************************
+//**                         CollisionSystem                                                                         **
+//*********************************************************************************************************************
+
+CollisionSystem::CollisionSystem()
+    : frame((unsigned long)-1), gridDirty(true), gridX(0), gridY(0), gridCell(64), gridColumns(0), gridRows(0), rayStamp(0), layerCount(1)
+{
+    layerNames[0] = "default";
+    for (int i = 0; i < MAX_LAYERS; i++)
+    {
+        layerMatrix[i] = 0xFFFFFFFF;
+    }
+}
+
+int CollisionSystem::addLayer(const std::string &name)
+{
+    int layer = getLayer(name);
+    if (layer >= 0)
+        return layer;
+    if (layerCount == MAX_LAYERS)
+    {
+        Log(LOG_ERROR, "CollisionSystem::addLayer  no free layer for %s", name.c_str());
+        return -1;
+    }
+    layerNames[layerCount] = name;
+    return layerCount++;
+}
+
+int CollisionSystem::getLayer(const std::string &name) const
+{
+    for (int i = 0; i < layerCount; i++)
+    {
+        if (layerNames[i] == name)
+            return i;
+    }
+    return -1;
+}
+
+const std::string &CollisionSystem::getLayerName(int layer) const
+{
+    static const std::string empty;
+    if (layer < 0 || layer >= layerCount)
+        return empty;
+    return layerNames[layer];
+}
+
+void CollisionSystem::setLayerCollision(int a, int b, bool collide)
+{
+    if (a < 0 || b < 0 || a >= MAX_LAYERS || b >= MAX_LAYERS)
+        return;
+    if (collide)
+    {
+        layerMatrix[a] |= 1u << b;
+        layerMatrix[b] |= 1u << a;
+    }
+    else
+    {
+        layerMatrix[a] &= ~(1u << b);
+        layerMatrix[b] &= ~(1u << a);
+    }
+
+    // objects already on these layers take the new rows
+    Scene *scene = Scene::Instance();
+    if (!scene)
+        return;
+    for (auto list : {&scene->gameObjects, &scene->gameObjectsToAdd})
+    {
+        for (auto object : *list)
+        {
+            if (object->collisionLayer == a || object->collisionLayer == b)
+                object->collisionMask = layerMatrix[object->collisionLayer];
+        }
+    }
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        if (objects[i])
+            mask[i] = objects[i]->collisionMask;
+    }
+}
+
+bool CollisionSystem::getLayerCollision(int a, int b) const
+{
+    if (a < 0 || b < 0 || a >= MAX_LAYERS || b >= MAX_LAYERS)
+        return false;
+    return (layerMatrix[a] >> b) & 1;
+}
+
+uint32_t CollisionSystem::getLayerMask(int layer) const
+{
+    if (layer < 0 || layer >= MAX_LAYERS)
+        return 0;
+    return layerMatrix[layer];
+}
+
+void CollisionSystem::clear()
+{
+    minX.clear();
+    minY.clear();
+    maxX.clear();
+    maxY.clear();
+    centerX.clear();
+    centerY.clear();
+    radius.clear();
+    kind.clear();
+    orientedIndex.clear();
+    oriented.clear();
+    colliders.clear();
+    objects.clear();
+    category.clear();
+    mask.clear();
+    fixed.clear();
+    tileLayers.clear();
+    gridDirty = true;
+}
+
+void CollisionSystem::attach(ColideComponent *collider)
+{
+    GameObject *object = collider ? collider->object : nullptr;
+    colliders.push_back(collider);
+    objects.push_back(object);
+    category.push_back(object ? object->collisionCategory : 1);
+    mask.push_back(object ? object->collisionMask : 0xFFFFFFFF);
+    fixed.push_back(object && object->solid ? 1 : 0);
+    gridDirty = true;
+}
+
+int CollisionSystem::addBox(const Rectangle &rect, ColideComponent *collider)
+{
+    minX.push_back(rect.x);
+    minY.push_back(rect.y);
+    maxX.push_back(rect.x + rect.width);
+    maxY.push_back(rect.y + rect.height);
+    centerX.push_back(rect.x + rect.width * 0.5f);
+    centerY.push_back(rect.y + rect.height * 0.5f);
+    radius.push_back(0);
+    kind.push_back(ColliderType::Box);
+    orientedIndex.push_back(-1);
+    attach(collider);
+    return (int)kind.size() - 1;
+}
+
+int CollisionSystem::addCircle(Vector2 center, float r, ColideComponent *collider)
+{
+    minX.push_back(center.x - r);
+    minY.push_back(center.y - r);
+    maxX.push_back(center.x + r);
+    maxY.push_back(center.y + r);
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    radius.push_back(r);
+    kind.push_back(ColliderType::Circle);
+    orientedIndex.push_back(-1);
+    attach(collider);
+    return (int)kind.size() - 1;
+}
+
+int CollisionSystem::addOriented(const OrientedBox &box, ColideComponent *collider)
+{
+    const Rectangle &b = box.bound;
+    minX.push_back(b.x);
+    minY.push_back(b.y);
+    maxX.push_back(b.x + b.width);
+    maxY.push_back(b.y + b.height);
+    centerX.push_back(box.center.x);
+    centerY.push_back(box.center.y);
+    radius.push_back(0);
+    kind.push_back(ColliderType::Oriented);
+    orientedIndex.push_back((int)oriented.size());
+    oriented.push_back(box);
+    attach(collider);
+    return (int)kind.size() - 1;
+}
+
+void CollisionSystem::gather(const std::vector<GameObject *> &objects)
+{
+    clear();
+    Scene *scene = Scene::Instance();
+    frame = scene ? scene->frame : 0;
+    for (auto object : objects)
+    {
+        if (!object->alive)
+            continue;
+        if (TileLayerComponent *tiles = object->GetComponent<TileLayerComponent>())
+            tileLayers.push_back(tiles);
+        if (!object->collidable)
+            continue;
+
+        BoxColiderComponent *box = object->GetComponent<BoxColiderComponent>();
+        CircleColiderComponent *circle = box ? nullptr : object->GetComponent<CircleColiderComponent>();
+        if (!box && !circle)
+        {
+            if (OrientedColiderComponent *rotated = object->GetComponent<OrientedColiderComponent>())
+                addOriented(rotated->GetWorldBox(), rotated);
+            continue;
+        }
+
+        float x = object->getWorldX();
+        float y = object->getWorldY();
+        if (box)
+            addBox({x + box->rect.x, y + box->rect.y, box->rect.width, box->rect.height}, box);
+        else
+            addCircle({x + circle->center.x, y + circle->center.y}, circle->radius, circle);
+    }
+}
+
+void CollisionSystem::sweep(std::vector<CollisionPair> &pairs)
+{
+    int count = (int)kind.size();
+    order.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    const float *left = minX.data();
+    std::sort(order.begin(), order.end(), [left](int a, int b)
+              { return left[a] < left[b]; });
+
+    for (int i = 0; i < count; i++)
+    {
+        int a = order[i];
+        GameObject *objectA = objects[a];
+        for (int j = i + 1; j < count; j++)
+        {
+            int b = order[j];
+            if (minX[b] > maxX[a])
+                break;
+            if (minY[b] > maxY[a] || minY[a] > maxY[b])
+                continue;
+            // layers and solids before touching the objects
+            if (!(category[a] & mask[b]) || !(category[b] & mask[a]) || (fixed[a] && fixed[b]))
+                continue;
+            GameObject *objectB = objects[b];
+            if (objectA && objectB && (objectA == objectB || objectA->parent == objectB || objectB->parent == objectA))
+                continue;
+            pairs.push_back({a, b});
+        }
+    }
+}
+
+void CollisionSystem::test(const std::vector<CollisionPair> &pairs, std::vector<Contact> &contacts)
+{
+    boxes.clear();
+    circles.clear();
+    mixed.clear();
+    flipped.clear();
+    rotated.clear();
+    for (size_t i = 0; i < pairs.size(); i++)
+    {
+        const CollisionPair &pair = pairs[i];
+        ColliderType ka = kind[pair.a];
+        ColliderType kb = kind[pair.b];
+        if (ka == ColliderType::Oriented || kb == ColliderType::Oriented)
+            rotated.push_back(pair);
+        else if (ka == ColliderType::Box && kb == ColliderType::Box)
+            boxes.push_back(pair);
+        else if (ka == ColliderType::Circle && kb == ColliderType::Circle)
+            circles.push_back(pair);
+        else
+        {
+            bool flip = ka == ColliderType::Circle;
+            mixed.push_back(flip ? CollisionPair{pair.b, pair.a} : pair);
+            flipped.push_back(flip ? 1 : 0);
+        }
+    }
+
+    boxBox(contacts);
+    circleCircle(contacts);
+    boxCircle(contacts);
+    orientedPairs(contacts);
+}
+
+// pairs are gathered in blocks that stay in L1, then tested LANES at a time
+static const int BLOCK = 64;
+
+void CollisionSystem::boxBox(std::vector<Contact> &contacts)
+{
+    float aMinX[BLOCK], aMaxX[BLOCK], aMinY[BLOCK], aMaxY[BLOCK];
+    float bMinX[BLOCK], bMaxX[BLOCK], bMinY[BLOCK], bMaxY[BLOCK];
+    int total = (int)boxes.size();
+    for (int start = 0; start < total; start += BLOCK)
+    {
+        const CollisionPair *pair = boxes.data() + start;
+        int n = std::min(BLOCK, total - start);
+        for (int i = 0; i < n; i++)
+        {
+            int a = pair[i].a;
+            int b = pair[i].b;
+            aMinX[i] = minX[a];
+            aMaxX[i] = maxX[a];
+            aMinY[i] = minY[a];
+            aMaxY[i] = maxY[a];
+            bMinX[i] = minX[b];
+            bMaxX[i] = maxX[b];
+            bMinY[i] = minY[b];
+            bMaxY[i] = maxY[b];
+        }
+
+        int i = 0;
+#ifdef COLLISION_SIMD
+        for (; i + LANES <= n; i += LANES)
+        {
+            Lane x = And(Less(Load(bMinX + i), Load(aMaxX + i)), Less(Load(aMinX + i), Load(bMaxX + i)));
+            Lane y = And(Less(Load(bMinY + i), Load(aMaxY + i)), Less(Load(aMinY + i), Load(bMaxY + i)));
+            int mask = Mask(And(x, y));
+            for (int bit = 0; mask; bit++, mask >>= 1)
+            {
+                if (mask & 1)
+                    contact(pair[i + bit].a, pair[i + bit].b, false, contacts);
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if (bMinX[i] < aMaxX[i] && aMinX[i] < bMaxX[i] && bMinY[i] < aMaxY[i] && aMinY[i] < bMaxY[i])
+                contact(pair[i].a, pair[i].b, false, contacts);
+        }
+    }
+}
+
+void CollisionSystem::circleCircle(std::vector<Contact> &contacts)
+{
+    float ax[BLOCK], ay[BLOCK], ar[BLOCK];
+    float bx[BLOCK], by[BLOCK], br[BLOCK];
+    int total = (int)circles.size();
+    for (int start = 0; start < total; start += BLOCK)
+    {
+        const CollisionPair *pair = circles.data() + start;
+        int n = std::min(BLOCK, total - start);
+        for (int i = 0; i < n; i++)
+        {
+            int a = pair[i].a;
+            int b = pair[i].b;
+            ax[i] = centerX[a];
+            ay[i] = centerY[a];
+            ar[i] = radius[a];
+            bx[i] = centerX[b];
+            by[i] = centerY[b];
+            br[i] = radius[b];
+        }
+
+        int i = 0;
+#ifdef COLLISION_SIMD
+        for (; i + LANES <= n; i += LANES)
+        {
+            Lane dx = Sub(Load(bx + i), Load(ax + i));
+            Lane dy = Sub(Load(by + i), Load(ay + i));
+            Lane r = Add(Load(ar + i), Load(br + i));
+            int mask = Mask(LessEqual(Add(Mul(dx, dx), Mul(dy, dy)), Mul(r, r)));
+            for (int bit = 0; mask; bit++, mask >>= 1)
+            {
+                if (mask & 1)
+                    contact(pair[i + bit].a, pair[i + bit].b, false, contacts);
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float dx = bx[i] - ax[i];
+            float dy = by[i] - ay[i];
+            float r = ar[i] + br[i];
+            if (dx * dx + dy * dy <= r * r)
+                contact(pair[i].a, pair[i].b, false, contacts);
+        }
+    }
+}
+
+void CollisionSystem::boxCircle(std::vector<Contact> &contacts)
+{
+    float left[BLOCK], right[BLOCK], top[BLOCK], bottom[BLOCK];
+    float cx[BLOCK], cy[BLOCK], cr[BLOCK];
+    int total = (int)mixed.size();
+    for (int start = 0; start < total; start += BLOCK)
+    {
+        const CollisionPair *pair = mixed.data() + start;
+        const unsigned char *flip = flipped.data() + start;
+        int n = std::min(BLOCK, total - start);
+        for (int i = 0; i < n; i++)
+        {
+            int a = pair[i].a;
+            int b = pair[i].b;
+            left[i] = minX[a];
+            right[i] = maxX[a];
+            top[i] = minY[a];
+            bottom[i] = maxY[a];
+            cx[i] = centerX[b];
+            cy[i] = centerY[b];
+            cr[i] = radius[b];
+        }
+
+        int i = 0;
+#ifdef COLLISION_SIMD
+        for (; i + LANES <= n; i += LANES)
+        {
+            Lane x = Load(cx + i);
+            Lane y = Load(cy + i);
+            Lane r = Load(cr + i);
+            Lane dx = Sub(x, Min(Max(x, Load(left + i)), Load(right + i)));
+            Lane dy = Sub(y, Min(Max(y, Load(top + i)), Load(bottom + i)));
+            int mask = Mask(LessEqual(Add(Mul(dx, dx), Mul(dy, dy)), Mul(r, r)));
+            for (int bit = 0; mask; bit++, mask >>= 1)
+            {
+                if (mask & 1)
+                    contact(pair[i + bit].a, pair[i + bit].b, flip[i + bit] != 0, contacts);
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float dx = cx[i] - std::min(std::max(cx[i], left[i]), right[i]);
+            float dy = cy[i] - std::min(std::max(cy[i], top[i]), bottom[i]);
+            if (dx * dx + dy * dy <= cr[i] * cr[i])
+                contact(pair[i].a, pair[i].b, flip[i] != 0, contacts);
+        }
+    }
+}
+
+OrientedBox CollisionSystem::orientedBox(int shape) const
+{
+    if (orientedIndex[shape] >= 0)
+        return oriented[orientedIndex[shape]];
+    OrientedBox box;
+    box.set({minX[shape], minY[shape], maxX[shape] - minX[shape], maxY[shape] - minY[shape]});
+    return box;
+}
+
+void CollisionSystem::orientedPairs(std::vector<Contact> &contacts)
+{
+    for (size_t i = 0; i < rotated.size(); i++)
+    {
+        int a = rotated[i].a;
+        int b = rotated[i].b;
+        // bounds first, most pairs stop here
+        if (minX[b] > maxX[a] || minX[a] > maxX[b] || minY[b] > maxY[a] || minY[a] > maxY[b])
+            continue;
+
+        Contact c;
+        c.a = a;
+        c.b = b;
+        bool hit;
+        if (kind[a] == ColliderType::Circle)
+        {
+            hit = OverlapOrientedBoxCircle(oriented[orientedIndex[b]], {centerX[a], centerY[a]}, radius[a], &c.normal, &c.depth);
+            c.normal = {-c.normal.x, -c.normal.y};
+        }
+        else if (kind[b] == ColliderType::Circle)
+            hit = OverlapOrientedBoxCircle(oriented[orientedIndex[a]], {centerX[b], centerY[b]}, radius[b], &c.normal, &c.depth);
+        else
+            hit = OverlapOrientedBoxes(orientedBox(a), orientedBox(b), &c.normal, &c.depth);
+        if (hit)
+            contacts.push_back(c);
+    }
+}
+
+// normal and depth, only for the pairs that touch
+void CollisionSystem::contact(int a, int b, bool flip, std::vector<Contact> &contacts)
+{
+    Contact c;
+    c.a = a;
+    c.b = b;
+    c.normal = {1, 0};
+    c.depth = 0;
+
+    if (radius[a] > 0 && radius[b] > 0)
+    {
+        float dx = centerX[b] - centerX[a];
+        float dy = centerY[b] - centerY[a];
+        float distance = sqrtf(dx * dx + dy * dy);
+        if (distance > 0)
+            c.normal = {dx / distance, dy / distance};
+        c.depth = radius[a] + radius[b] - distance;
+    }
+    else if (radius[b] > 0)
+    {
+        float px = std::min(std::max(centerX[b], minX[a]), maxX[a]);
+        float py = std::min(std::max(centerY[b], minY[a]), maxY[a]);
+        float dx = centerX[b] - px;
+        float dy = centerY[b] - py;
+        float distance = sqrtf(dx * dx + dy * dy);
+        if (distance > 0)
+        {
+            c.normal = {dx / distance, dy / distance};
+            c.depth = radius[b] - distance;
+        }
+        else
+        {
+            // center inside the box, out by the nearest side
+            float sides[4] = {centerX[b] - minX[a], maxX[a] - centerX[b], centerY[b] - minY[a], maxY[a] - centerY[b]};
+            int side = (int)(std::min_element(sides, sides + 4) - sides);
+            static const Vector2 normals[4] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+            c.normal = normals[side];
+            c.depth = sides[side] + radius[b];
+        }
+        if (flip)
+        {
+            c.a = b;
+            c.b = a;
+            c.normal = {-c.normal.x, -c.normal.y};
+        }
+    }
+    else
+    {
+        float ox = std::min(maxX[a], maxX[b]) - std::max(minX[a], minX[b]);
+        float oy = std::min(maxY[a], maxY[b]) - std::max(minY[a], minY[b]);
+        if (ox < oy)
+        {
+            c.normal = {centerX[b] < centerX[a] ? -1.0f : 1.0f, 0};
+            c.depth = ox;
+        }
+        else
+        {
+            c.normal = {0, centerY[b] < centerY[a] ? -1.0f : 1.0f};
+            c.depth = oy;
+        }
+    }
+    contacts.push_back(c);
+}
+
+//*********************************************************************************************************************
+//**                         Raycast                                                                                 **
+//*********************************************************************************************************************
+
+// ray against [min, max], near distance and the axis it came in by (0 = x, 1 = y)
+static bool RaySlab(Vector2 o, Vector2 d, float minX, float minY, float maxX, float maxY, float &tNear, float &tFar, int &axis)
+{
+    tNear = -FLT_MAX;
+    tFar = FLT_MAX;
+    axis = 0;
+    const float origin[2] = {o.x, o.y};
+    const float direction[2] = {d.x, d.y};
+    const float low[2] = {minX, minY};
+    const float high[2] = {maxX, maxY};
+    for (int i = 0; i < 2; i++)
+    {
+        if (direction[i] == 0)
+        {
+            if (origin[i] < low[i] || origin[i] > high[i])
+                return false;
+            continue;
+        }
+        float inv = 1.0f / direction[i];
+        float t0 = (low[i] - origin[i]) * inv;
+        float t1 = (high[i] - origin[i]) * inv;
+        if (t0 > t1)
+            std::swap(t0, t1);
+        if (t0 > tNear)
+        {
+            tNear = t0;
+            axis = i;
+        }
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar)
+            return false;
+    }
+    return tFar >= 0;
+}
+
+static Vector2 SlabNormal(Vector2 d, int axis)
+{
+    if (axis == 0)
+        return {d.x > 0 ? -1.0f : 1.0f, 0};
+    return {0, d.y > 0 ? -1.0f : 1.0f};
+}
+
+bool CollisionSystem::rayShape(int shape, Vector2 o, Vector2 d, float maxDistance, float &distance, Vector2 &normal) const
+{
+    if (kind[shape] == ColliderType::Circle)
+    {
+        float r = radius[shape];
+        float mx = o.x - centerX[shape];
+        float my = o.y - centerY[shape];
+        float c = mx * mx + my * my - r * r;
+        if (c <= 0)
+        {
+            distance = 0;
+            normal = {-d.x, -d.y};
+            return true;
+        }
+        float b = mx * d.x + my * d.y;
+        float discriminant = b * b - c;
+        if (b > 0 || discriminant < 0)
+            return false;
+        float t = -b - sqrtf(discriminant);
+        if (t > maxDistance)
+            return false;
+        distance = t;
+        normal = {(mx + d.x * t) / r, (my + d.y * t) / r};
+        return true;
+    }
+
+    float tNear, tFar;
+    int axis;
+    if (kind[shape] == ColliderType::Box)
+    {
+        if (!RaySlab(o, d, minX[shape], minY[shape], maxX[shape], maxY[shape], tNear, tFar, axis) || tNear > maxDistance)
+            return false;
+        distance = std::max(tNear, 0.0f);
+        normal = tNear < 0 ? Vector2{-d.x, -d.y} : SlabNormal(d, axis);
+        return true;
+    }
+
+    // oriented: the ray in box coords, where the box is [-1, 1] on both axes
+    const OrientedBox &box = oriented[orientedIndex[shape]];
+    float det = box.u.x * box.v.y - box.v.x * box.u.y;
+    if (det == 0)
+        return false;
+    float inv = 1.0f / det;
+    float ox = o.x - box.center.x;
+    float oy = o.y - box.center.y;
+    Vector2 lo = {(ox * box.v.y - oy * box.v.x) * inv, (box.u.x * oy - box.u.y * ox) * inv};
+    Vector2 ld = {(d.x * box.v.y - d.y * box.v.x) * inv, (box.u.x * d.y - box.u.y * d.x) * inv};
+    if (!RaySlab(lo, ld, -1, -1, 1, 1, tNear, tFar, axis) || tNear > maxDistance)
+        return false;
+    distance = std::max(tNear, 0.0f);
+    if (tNear < 0)
+        normal = {-d.x, -d.y};
+    else
+    {
+        // axis 0 = a face along v, its normal is normal[0]
+        Vector2 n = box.normal[axis];
+        normal = (n.x * d.x + n.y * d.y) > 0 ? Vector2{-n.x, -n.y} : n;
+    }
+    return true;
+}
+
+bool CollisionSystem::rayTiles(TileLayerComponent *layer, Vector2 o, Vector2 d, float maxDistance, RaycastHit &hit) const
+{
+    float tw = (float)layer->tileWidth;
+    float th = (float)layer->tileHeight;
+    float left = layer->offset.x;
+    float top = layer->offset.y;
+    float tNear, tFar;
+    int axis;
+    if (tw <= 0 || th <= 0 || !RaySlab(o, d, left, top, left + layer->width * tw, top + layer->height * th, tNear, tFar, axis))
+        return false;
+    float t = std::max(tNear, 0.0f);
+    if (t > maxDistance)
+        return false;
+    float end = std::min(tFar, maxDistance);
+
+    // Amanatides & Woo over the tiles
+    int x = (int)floorf((o.x + d.x * t - left) / tw);
+    int y = (int)floorf((o.y + d.y * t - top) / th);
+    x = std::min(std::max(x, 0), layer->width - 1);
+    y = std::min(std::max(y, 0), layer->height - 1);
+    int stepX = d.x > 0 ? 1 : -1;
+    int stepY = d.y > 0 ? 1 : -1;
+    float nextX = d.x != 0 ? (left + (x + (stepX > 0 ? 1 : 0)) * tw - o.x) / d.x : FLT_MAX;
+    float nextY = d.y != 0 ? (top + (y + (stepY > 0 ? 1 : 0)) * th - o.y) / d.y : FLT_MAX;
+    float deltaX = d.x != 0 ? tw / fabsf(d.x) : FLT_MAX;
+    float deltaY = d.y != 0 ? th / fabsf(d.y) : FLT_MAX;
+    Vector2 normal = tNear <= 0 ? Vector2{-d.x, -d.y} : SlabNormal(d, axis);
+
+    for (;;)
+    {
+        int tile = layer->getTile(x, y);
+        if (tile >= 1)
+        {
+            hit.point = {o.x + d.x * t, o.y + d.y * t};
+            hit.normal = normal;
+            hit.distance = t;
+            hit.object = layer->object;
+            hit.layer = layer;
+            hit.tileX = x;
+            hit.tileY = y;
+            hit.tile = tile;
+            return true;
+        }
+        if (nextX < nextY)
+        {
+            t = nextX;
+            x += stepX;
+            nextX += deltaX;
+            normal = {(float)-stepX, 0};
+        }
+        else
+        {
+            t = nextY;
+            y += stepY;
+            nextY += deltaY;
+            normal = {0, (float)-stepY};
+        }
+        if (t > end || x < 0 || y < 0 || x >= layer->width || y >= layer->height)
+            return false;
+    }
+}
+
+void CollisionSystem::buildGrid()
+{
+    gridDirty = false;
+    gridColumns = 0;
+    gridRows = 0;
+    int count = (int)kind.size();
+    stamp.assign(count, 0);
+    rayStamp = 0;
+    if (count == 0)
+        return;
+
+    float left = FLT_MAX, top = FLT_MAX, right = -FLT_MAX, bottom = -FLT_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        left = std::min(left, minX[i]);
+        top = std::min(top, minY[i]);
+        right = std::max(right, maxX[i]);
+        bottom = std::max(bottom, maxY[i]);
+    }
+
+    // about one shape per cell, capped to 64K cells
+    gridX = left;
+    gridY = top;
+    gridCell = std::max(16.0f, sqrtf((right - left) * (bottom - top) / count));
+    for (;;)
+    {
+        gridColumns = (int)((right - left) / gridCell) + 1;
+        gridRows = (int)((bottom - top) / gridCell) + 1;
+        if ((long long)gridColumns * gridRows <= 65536)
+            break;
+        gridCell *= 2;
+    }
+
+    cellStart.assign(gridColumns * gridRows + 1, 0);
+    int total = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int c0 = (int)((minX[i] - gridX) / gridCell), c1 = (int)((maxX[i] - gridX) / gridCell);
+            int r0 = (int)((minY[i] - gridY) / gridCell), r1 = (int)((maxY[i] - gridY) / gridCell);
+            for (int r = r0; r <= r1; r++)
+                for (int c = c0; c <= c1; c++)
+                {
+                    if (pass == 0)
+                    {
+                        cellStart[r * gridColumns + c]++;
+                        total++;
+                    }
+                    else
+                        cellItems[--cellStart[r * gridColumns + c]] = i;
+                }
+        }
+        if (pass == 0)
+        {
+            for (int c = 1; c <= gridColumns * gridRows; c++)
+            {
+                cellStart[c] += cellStart[c - 1];
+            }
+            cellItems.resize(total);
+        }
+    }
+}
+
+// visit(cell, exit distance) returns false to stop
+template <typename Visit>
+void CollisionSystem::walkGrid(Vector2 o, Vector2 d, float maxDistance, Visit visit)
+{
+    if (gridColumns == 0)
+        return;
+    float tNear, tFar;
+    int axis;
+    if (!RaySlab(o, d, gridX, gridY, gridX + gridColumns * gridCell, gridY + gridRows * gridCell, tNear, tFar, axis))
+        return;
+    float t = std::max(tNear, 0.0f);
+    if (t > maxDistance)
+        return;
+    float end = std::min(tFar, maxDistance);
+
+    int x = std::min(std::max((int)floorf((o.x + d.x * t - gridX) / gridCell), 0), gridColumns - 1);
+    int y = std::min(std::max((int)floorf((o.y + d.y * t - gridY) / gridCell), 0), gridRows - 1);
+    int stepX = d.x > 0 ? 1 : -1;
+    int stepY = d.y > 0 ? 1 : -1;
+    float nextX = d.x != 0 ? (gridX + (x + (stepX > 0 ? 1 : 0)) * gridCell - o.x) / d.x : FLT_MAX;
+    float nextY = d.y != 0 ? (gridY + (y + (stepY > 0 ? 1 : 0)) * gridCell - o.y) / d.y : FLT_MAX;
+    float deltaX = d.x != 0 ? gridCell / fabsf(d.x) : FLT_MAX;
+    float deltaY = d.y != 0 ? gridCell / fabsf(d.y) : FLT_MAX;
+
+    for (;;)
+    {
+        if (!visit(y * gridColumns + x, std::min(nextX, nextY)))
+            return;
+        if (nextX < nextY)
+        {
+            t = nextX;
+            x += stepX;
+            nextX += deltaX;
+        }
+        else
+        {
+            t = nextY;
+            y += stepY;
+            nextY += deltaY;
+        }
+        if (t > end || x < 0 || y < 0 || x >= gridColumns || y >= gridRows)
+            return;
+    }
+}
+
+static bool RayDirection(const Ray2D &ray, Vector2 &direction)
+{
+    float length = sqrtf(ray.direction.x * ray.direction.x + ray.direction.y * ray.direction.y);
+    if (length == 0 || ray.maxDistance < 0)
+        return false;
+    direction = {ray.direction.x / length, ray.direction.y / length};
+    return true;
+}
+
+bool CollisionSystem::raycast(const Ray2D &ray, uint32_t layers, RaycastHit &hit)
+{
+    Vector2 d;
+    if (!RayDirection(ray, d))
+        return false;
+    if (gridDirty)
+        buildGrid();
+
+    Vector2 o = ray.origin;
+    float best = ray.maxDistance;
+    bool found = false;
+
+    // tiles first, they shorten the walk over the colliders
+    RaycastHit tileHit;
+    for (auto layer : tileLayers)
+    {
+        if (!(layer->object->collisionCategory & layers))
+            continue;
+        if (rayTiles(layer, o, d, best, tileHit))
+        {
+            best = tileHit.distance;
+            hit = tileHit;
+            found = true;
+        }
+    }
+
+    int nearest = -1;
+    Vector2 nearestNormal = {0, 0};
+    if (++rayStamp == 0)
+    {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        rayStamp = 1;
+    }
+    walkGrid(o, d, best, [&](int cell, float exit)
+             {
+                 for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                 {
+                     int shape = cellItems[k];
+                     if (stamp[shape] == rayStamp || !(category[shape] & layers))
+                         continue;
+                     stamp[shape] = rayStamp;
+                     float t;
+                     Vector2 normal;
+                     if (rayShape(shape, o, d, best, t, normal) && t <= best)
+                     {
+                         best = t;
+                         nearest = shape;
+                         nearestNormal = normal;
+                     }
+                 }
+                 // nothing further can be nearer than a hit inside this cell
+                 return nearest < 0 || best > exit; });
+
+    if (nearest >= 0)
+    {
+        hit.point = {o.x + d.x * best, o.y + d.y * best};
+        hit.normal = nearestNormal;
+        hit.distance = best;
+        hit.object = objects[nearest];
+        hit.layer = nullptr;
+        hit.tileX = 0;
+        hit.tileY = 0;
+        hit.tile = -1;
+        found = true;
+    }
+    return found;
+}
+
+int CollisionSystem::raycastAll(const Ray2D &ray, uint32_t layers, std::vector<RaycastHit> &hits)
+{
+    hits.clear();
+    Vector2 d;
+    if (!RayDirection(ray, d))
+        return 0;
+    if (gridDirty)
+        buildGrid();
+
+    Vector2 o = ray.origin;
+    RaycastHit hit;
+    for (auto layer : tileLayers)
+    {
+        if ((layer->object->collisionCategory & layers) && rayTiles(layer, o, d, ray.maxDistance, hit))
+            hits.push_back(hit);
+    }
+
+    if (++rayStamp == 0)
+    {
+        std::fill(stamp.begin(), stamp.end(), 0);
+        rayStamp = 1;
+    }
+    walkGrid(o, d, ray.maxDistance, [&](int cell, float)
+             {
+                 for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                 {
+                     int shape = cellItems[k];
+                     if (stamp[shape] == rayStamp || !(category[shape] & layers))
+                         continue;
+                     stamp[shape] = rayStamp;
+                     float t;
+                     Vector2 normal;
+                     if (rayShape(shape, o, d, ray.maxDistance, t, normal))
+                     {
+                         hit.point = {o.x + d.x * t, o.y + d.y * t};
+                         hit.normal = normal;
+                         hit.distance = t;
+                         hit.object = objects[shape];
+                         hit.layer = nullptr;
+                         hit.tileX = 0;
+                         hit.tileY = 0;
+                         hit.tile = -1;
+                         hits.push_back(hit);
+                     }
+                 }
+                 return true; });
+
+    std::sort(hits.begin(), hits.end(), [](const RaycastHit &a, const RaycastHit &b)
+              { return a.distance < b.distance; });
+    return (int)hits.size();
+}
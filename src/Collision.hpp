@@ -0,0 +1,148 @@
+#pragma once
+#include "Engine.hpp"
+
+//*********************************************************************************************************************
+//**                         CollisionSystem                                                                         **
+//*********************************************************************************************************************
+
+// Narrowphase over a pair list from any broadphase. Colliders are gathered once per frame into world space
+// SoA arrays. Each pair goes to a box/box, circle/circle or box/circle list, and each list is tested
+// 4 (SSE) or 8 (AVX) pairs at a time. COLLISION_NO_SIMD forces the scalar path. Pairs with an oriented
+// box are rejected on their bounds first and only the overlapping ones run the separating axis test.
+
+struct CollisionPair
+{
+    int a; // shape indexes
+    int b;
+};
+
+struct Contact
+{
+    int a;
+    int b;
+    Vector2 normal; // from a to b
+    float depth;
+};
+
+struct Ray2D
+{
+    Vector2 origin;
+    Vector2 direction; // any length
+    float maxDistance;
+};
+
+struct RaycastHit
+{
+    Vector2 point;
+    Vector2 normal;
+    float distance; // -1 = no hit (batch)
+    GameObject *object;        // collider owner, or the tile layer object
+    TileLayerComponent *layer; // tile hits only
+    int tileX;
+    int tileY;
+    int tile; // -1 for colliders
+};
+
+class CollisionSystem
+{
+public:
+    static CollisionSystem &Instance()
+    {
+        static CollisionSystem instance;
+        return instance;
+    }
+
+    // 32 named layers, layer 0 is "default", every layer collides with every layer until told otherwise
+    static const int MAX_LAYERS = 32;
+    int addLayer(const std::string &name); // -1 when all are used
+    int getLayer(const std::string &name) const;
+    const std::string &getLayerName(int layer) const;
+    void setLayerCollision(int a, int b, bool collide); // both ways, updates objects already on a or b
+    bool getLayerCollision(int a, int b) const;
+    uint32_t getLayerMask(int layer) const;
+
+    // world shapes of the collidable objects, one walk of the parent chain per object
+    void gather(const std::vector<GameObject *> &objects);
+    void clear();
+    int addBox(const Rectangle &rect, ColideComponent *collider);
+    int addCircle(Vector2 center, float radius, ColideComponent *collider);
+    int addOriented(const OrientedBox &box, ColideComponent *collider);
+
+    // sort and sweep on x, skips parent/child pairs and the ones the layers filter out
+    void sweep(std::vector<CollisionPair> &pairs);
+    // pairs -> contacts (appended)
+    void test(const std::vector<CollisionPair> &pairs, std::vector<Contact> &contacts);
+
+    // rays over the gathered colliders (grid DDA) and tile layers (tile DDA), mask = collision layers
+    bool raycast(const Ray2D &ray, uint32_t mask, RaycastHit &hit);
+    // every collider hit and the first solid tile of each layer, nearest first
+    int raycastAll(const Ray2D &ray, uint32_t mask, std::vector<RaycastHit> &hits);
+    unsigned long frame; // scene frame of the last gather
+
+    int getCount() const { return (int)kind.size(); }
+    ColideComponent *getCollider(int shape) const { return colliders[shape]; }
+    GameObject *getObject(int shape) const { return objects[shape]; }
+
+    // scene pairs and contacts of the last Scene::Collision
+    std::vector<CollisionPair> pairs;
+    std::vector<Contact> contacts;
+
+private:
+    CollisionSystem();
+
+    void boxBox(std::vector<Contact> &contacts);
+    void circleCircle(std::vector<Contact> &contacts);
+    void boxCircle(std::vector<Contact> &contacts);
+    void orientedPairs(std::vector<Contact> &contacts);
+    OrientedBox orientedBox(int shape) const;
+    void contact(int a, int b, bool flip, std::vector<Contact> &contacts);
+    void attach(ColideComponent *collider);
+    void buildGrid();
+    template <typename Visit>
+    void walkGrid(Vector2 origin, Vector2 direction, float maxDistance, Visit visit);
+    bool rayShape(int shape, Vector2 origin, Vector2 direction, float maxDistance, float &distance, Vector2 &normal) const;
+    bool rayTiles(TileLayerComponent *layer, Vector2 origin, Vector2 direction, float maxDistance, RaycastHit &hit) const;
+
+    // shapes SoA, boxes and circles share the bound
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> radius; // 0 = box
+    std::vector<ColliderType> kind;
+    std::vector<int> orientedIndex; // into oriented, -1 for the other kinds
+    std::vector<OrientedBox> oriented;
+    std::vector<ColideComponent *> colliders;
+    std::vector<GameObject *> objects;
+    std::vector<uint32_t> category;
+    std::vector<uint32_t> mask;
+    std::vector<unsigned char> fixed; // solid objects
+
+    std::vector<TileLayerComponent *> tileLayers;
+
+    // ray grid over the shapes, built on the first ray after a gather
+    bool gridDirty;
+    float gridX;
+    float gridY;
+    float gridCell;
+    int gridColumns;
+    int gridRows;
+    std::vector<int> cellStart;
+    std::vector<int> cellItems;
+    std::vector<unsigned int> stamp; // per shape, last ray that tested it
+    unsigned int rayStamp;
+
+    std::string layerNames[MAX_LAYERS];
+    uint32_t layerMatrix[MAX_LAYERS];
+    int layerCount;
+
+    // pairs split by kernel, box first on boxCircle
+    std::vector<CollisionPair> boxes;
+    std::vector<CollisionPair> circles;
+    std::vector<CollisionPair> mixed;
+    std::vector<unsigned char> flipped;
+    std::vector<CollisionPair> rotated; // any side oriented
+    std::vector<int> order; // sweep
+};
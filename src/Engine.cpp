@@ -1,5 +1,6 @@
 #include "Scene.hpp"
 #include "Engine.hpp"
+#include "Collision.hpp"
 #include <string>
 #include <sstream>
 
@@ -136,7 +137,15 @@ Component::~Component()
 //**                         SpriteComponent                                                                              **
 //*********************************************************************************************************************
 
-SpriteComponent::SpriteComponent(const std::string &fileName) : Component()
+SpriteComponent::SpriteComponent(const std::string &fileName) : SpriteComponent(Assets::Instance().getGraphID(fileName))
+{
+}
+
+SpriteComponent::SpriteComponent(GraphKey key) : SpriteComponent(Assets::Instance().getGraphID(key))
+{
+}
+
+SpriteComponent::SpriteComponent(int graphID) : Component()
 {
     depth = 1;
     this->color = WHITE;
@@ -146,9 +155,28 @@ SpriteComponent::SpriteComponent(const std::string &fileName) : Component()
     clip.y = 0;
     clip.width = 1;
     clip.height = 1;
-    graphID = fileName;
+    this->graphID = graphID;
+
+    graph = Assets::Instance().getGraph(graphID);
+    if (graph)
+    {
+        clip.x = 0;
+        clip.y = 0;
+        clip.width = graph->width;
+        clip.height = graph->height;
+    }
+    else
+    {
+        Log(LOG_WARNING, "Graph %s not found", Assets::Instance().getGraphName(graphID).c_str());
+    }
+}
 
-    graph = Assets::Instance().getGraph(fileName);
+void SpriteComponent::SetGraph(int graphID)
+{
+    if (this->graphID == graphID)
+        return;
+    this->graphID = graphID;
+    graph = Assets::Instance().getGraph(graphID);
     if (graph)
     {
         clip.x = 0;
@@ -158,6 +186,16 @@ SpriteComponent::SpriteComponent(const std::string &fileName) : Component()
     }
 }
 
+void SpriteComponent::SetGraph(const std::string &name)
+{
+    SetGraph(Assets::Instance().getGraphID(name));
+}
+
+void SpriteComponent::SetGraph(GraphKey key)
+{
+    SetGraph(Assets::Instance().getGraphID(key));
+}
+
 void SpriteComponent::OnInit()
 {
     object->centerOrigin();
@@ -198,6 +236,41 @@ void SpriteComponent::OnDraw()
     }
 }
 
+static Matrix2D SpriteMaskTransform(SpriteComponent *sprite)
+{
+    Matrix2D mat = sprite->object->transform->GetWorldTransformation();
+    // flipped sprites read the clip mirrored
+    if (sprite->FlipX)
+    {
+        mat.tx += mat.a * sprite->clip.width;
+        mat.ty += mat.b * sprite->clip.width;
+        mat.a = -mat.a;
+        mat.b = -mat.b;
+    }
+    if (sprite->FlipY)
+    {
+        mat.tx += mat.c * sprite->clip.height;
+        mat.ty += mat.d * sprite->clip.height;
+        mat.c = -mat.c;
+        mat.d = -mat.d;
+    }
+    return mat;
+}
+
+bool SpriteComponent::PixelCollide(SpriteComponent *other)
+{
+    if (!graph || !other || !other->graph || graph->mask.empty() || other->graph->mask.empty())
+        return false;
+
+    Matrix2D a = SpriteMaskTransform(this);
+    Matrix2D b = SpriteMaskTransform(other);
+    bool plain = a.a == 1 && a.d == 1 && a.b == 0 && a.c == 0 && b.a == 1 && b.d == 1 && b.b == 0 && b.c == 0;
+    if (plain)
+        return MaskCollide(graph->mask, clip, (int)floorf(a.tx + 0.5f), (int)floorf(a.ty + 0.5f),
+                           other->graph->mask, other->clip, (int)floorf(b.tx + 0.5f), (int)floorf(b.ty + 0.5f));
+    return MaskCollide(graph->mask, clip, a, other->graph->mask, other->clip, b);
+}
+
 void SpriteComponent::SetClip(float x, float y, float width, float height)
 {
     clip.x = x;
@@ -246,6 +319,9 @@ GameObject::GameObject() : name("GameObject"),
     persistent = false;
     collidable = true;
     pickable = false;
+    collisionLayer = -1;
+    collisionCategory = 1;
+    collisionMask = 0xFFFFFFFF;
 
     word_position.x = transform->position.x;
     word_position.y = transform->position.y;
@@ -457,6 +533,18 @@ bool GameObject::place_meeting_layer(float x, float y, int layer)
     return scene->place_meeting_layer(this, x, y, layer);
 }
 
+void GameObject::setCollisionLayer(int layer)
+{
+    if (layer < 0 || layer >= CollisionSystem::MAX_LAYERS)
+    {
+        Log(LOG_WARNING, "GameObject::setCollisionLayer  invalid layer %d", layer);
+        return;
+    }
+    collisionLayer = layer;
+    collisionCategory = 1u << layer;
+    collisionMask = CollisionSystem::Instance().getLayerMask(layer);
+}
+
 bool GameObject::collideWith(GameObject *e, float x, float y)
 {
     if (!scene || !e)
@@ -14,6 +14,8 @@
 
 
 #include "Utils.hpp"
+#include "FileSystem.hpp"
+#include <memory>
 
 
 
@@ -41,27 +43,141 @@ class Scene;
 class Graph
 {
 public:
-    Graph() : width(0), height(0)
+    Graph() : id(-1), width(0), height(0), memory(0), refCount(0), resident(false), orphan(false), inLru(false)
     {
+        texture.id = 0;
     }
     Graph(const Graph &other)
-        : texture(other.texture), width(other.width), height(other.height)
+        : id(-1), texture(other.texture), width(other.width), height(other.height), mask(other.mask),
+          memory(0), refCount(0), resident(false), orphan(false), inLru(false)
     {
     }
-    Graph(const char *filepath)
+    Graph(const char *filepath) : Graph()
     {
         texture = LoadTexture(filepath);
         width = texture.width;
         height = texture.height;
         filename = filepath;
+        resident = texture.id != 0;
+        memory = (size_t)width * height * 4;
         //  Log(LOG_INFO, "Graph %s loaded %d %d ", filepath, width, height);
     }
+    Graph(const char *filepath, const unsigned char *data, size_t size, int maskThreshold = -1) : Graph()
+    {
+        filename = filepath;
+        load(data, size, maskThreshold);
+    }
+
+    // decode straight from the buffer (pack mapping or file bytes), maskThreshold >= 0 builds the collision mask
+    bool load(const unsigned char *data, size_t size, int maskThreshold = -1)
+    {
+        Image image = LoadImageFromMemory(GetFileExtension(filename.c_str()), data, (int)size);
+        if (maskThreshold >= 0)
+            mask.create(image, (unsigned char)maskThreshold);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+        width = texture.width;
+        height = texture.height;
+        resident = texture.id != 0;
+        memory = (size_t)width * height * 4;
+        return resident;
+    }
+
+    void unload()
+    {
+        if (resident)
+            UnloadTexture(texture);
+        texture.id = 0;
+        resident = false;
+    }
 
     std::string filename;
     std::string key;
+    int id;
     Texture2D texture;
     int width;
     int height;
+    BitMask mask; // pixel collision, kept when the texture is evicted
+
+    size_t memory;  // texture bytes (RGBA)
+    int refCount;   // GraphHandles pointing here
+    bool resident;  // texture in VRAM, false when evicted
+    bool orphan;    // removed from Assets while still referenced, deleted on the last release
+    bool inLru;
+    std::list<Graph *>::iterator lruIt;
+};
+
+// hashed graph name, "player_run"_graph is computed by the compiler
+struct GraphKey
+{
+    uint32_t hash;
+    constexpr explicit GraphKey(uint32_t hash) : hash(hash) {}
+};
+
+constexpr GraphKey operator"" _graph(const char *str, size_t)
+{
+    return GraphKey(HashFNV(str));
+}
+
+// Counted reference to a Graph, unreferenced graphs go to the Assets LRU and can be evicted
+class GraphHandle
+{
+public:
+    GraphHandle() : graph(nullptr) {}
+    GraphHandle(Graph *graph);
+    GraphHandle(const GraphHandle &other);
+    ~GraphHandle();
+
+    GraphHandle &operator=(const GraphHandle &other);
+    GraphHandle &operator=(Graph *other);
+
+    Graph *get() const { return graph; }
+    Graph *operator->() const { return graph; }
+    operator Graph *() const { return graph; }
+
+private:
+    Graph *graph;
+};
+
+// one frame of an animated tile (Tiled <animation><frame tileid duration/>)
+struct TileFrame
+{
+    int tile;
+    float duration; // seconds
+};
+
+struct TileAnimation
+{
+    int tile;
+    std::vector<TileFrame> frames;
+    float length;
+};
+
+struct Tileset
+{
+    Tileset() : firstgid(1), tileWidth(0), tileHeight(0), spacing(0), margin(0), clock(-1) {}
+
+    std::string name;
+    std::string imageSource;
+    int firstgid;
+    int tileWidth;
+    int tileHeight;
+    int spacing;
+    int margin;
+
+    // animated tiles share one clock, the table is evaluated once per frame
+    // and the layers draw remap[tile] instead of tile
+    std::vector<TileAnimation> animations;
+    std::vector<int> remap;
+    double clock;
+
+    void addAnimation(int tile, const std::vector<TileFrame> &frames);
+    void update(double time);
+    bool isAnimated() const { return !animations.empty(); }
+    int map(int tile) const
+    {
+        return tile >= 0 && tile < (int)remap.size() ? remap[tile] : tile;
+    }
 };
 
 class Assets
@@ -78,12 +194,66 @@ public:
         auto it = graphs.find(key);
         if (it != graphs.end())
         {
+            touch(it->second);
             return it->second;
         }
         Log(LOG_WARNING, "Graph %s not found", key.c_str());
         return nullptr;
     }
 
+    // O(1) lookups, no hashing of strings
+    Graph *getGraph(int id)
+    {
+        if (id < 0 || id >= (int)graphByID.size())
+            return nullptr;
+        Graph *graph = graphByID[id];
+        if (graph)
+            touch(graph);
+        return graph;
+    }
+
+    Graph *getGraph(GraphKey key)
+    {
+        return getGraph(getGraphID(key));
+    }
+
+    // intern a graph name into a dense id, the graph can be loaded later
+    int getGraphID(const std::string &key)
+    {
+        auto it = graphIDs.find(key);
+        if (it != graphIDs.end())
+            return it->second;
+
+        int id = (int)graphNames.size();
+        graphNames.push_back(key);
+        graphByID.push_back(nullptr);
+        graphIDs[key] = id;
+
+        uint32_t hash = HashFNV(key.c_str());
+        auto h = graphHashes.find(hash);
+        if (h != graphHashes.end())
+            Log(LOG_WARNING, "Graph %s hash collides with %s", key.c_str(), graphNames[h->second].c_str());
+        else
+            graphHashes[hash] = id;
+        return id;
+    }
+
+    int getGraphID(GraphKey key) const
+    {
+        auto it = graphHashes.find(key.hash);
+        if (it != graphHashes.end())
+            return it->second;
+        return -1;
+    }
+
+    const std::string &getGraphName(int id) const
+    {
+        static const std::string empty;
+        if (id < 0 || id >= (int)graphNames.size())
+            return empty;
+        return graphNames[id];
+    }
+
     bool hasGraph(const std::string &key)
     {
         auto it = graphs.find(key);
@@ -94,60 +264,32 @@ public:
         return false;
     }
 
-    Graph *loadGraph(const std::string &key, const std::string &filepath)
+    // maskThreshold >= 0 builds the 1-bit collision mask (alpha > threshold)
+    Graph *loadGraph(const std::string &key, const std::string &filepath, int maskThreshold = -1)
     {
-        Graph *graph = getGraph(key);
-        if (graph != nullptr)
+        if (hasGraph(key))
         {
+            Graph *graph = getGraph(key);
+            if (maskThreshold >= 0 && graph->mask.empty())
+                createMask(graph, maskThreshold);
             return graph;
         }
 
-        if (FileExists(filepath.c_str()))
-        {
-            graph = new Graph(filepath.c_str());
-        }
-        else if (FileExists((std::string("assets/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("assets/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("assets/images/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("assets/images/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("assets/textures/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("assets/textures/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("assets/levels/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("assets/levels/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("../assets/levels/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("../assets/levels/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("../assets/images/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("..assets/images/") + filepath).c_str());
-        }
-        else if (FileExists((std::string("../assets/textures/") + filepath).c_str()))
-        {
-            graph = new Graph((std::string("../assets/textures/") + filepath).c_str());
-        }
-        else
+        FileBuffer file;
+        if (!FileSystem::Instance().load(filepath, file))
         {
             Log(LOG_ERROR, "Failed to load  image %s", filepath.c_str());
             return nullptr;
         }
-
-        // if (FileExists(filepath.c_str()) == false)
-        // {
-        //     Log(LOG_WARNING, "File %s not found", filepath.c_str());
-        //     return nullptr;
-        // }
+        Graph *graph = new Graph(filepath.c_str(), file.data, file.size, maskThreshold);
 
         graph->key = key;
+        graph->id = getGraphID(key);
         graphs[key] = graph;
+        graphByID[graph->id] = graph;
+        memoryUsed += graph->memory;
+        pushLru(graph);
+        trim();
         return graph;
     }
 
@@ -156,28 +298,215 @@ public:
         auto it = graphs.find(key);
         if (it != graphs.end())
         {
-            UnloadTexture(it->second->texture);
+            Graph *graph = it->second;
             graphs.erase(it);
+            graphByID[graph->id] = nullptr;
+            discard(graph);
+        }
+    }
+    Tileset *addTileset(const std::string &name)
+    {
+        Tileset *&tileset = tilesets[name];
+        if (!tileset)
+        {
+            tileset = new Tileset();
+            tileset->name = name;
         }
+        return tileset;
     }
+
+    Tileset *getTileset(const std::string &name)
+    {
+        auto it = tilesets.find(name);
+        if (it != tilesets.end())
+            return it->second;
+        Log(LOG_WARNING, "Tileset %s not found", name.c_str());
+        return nullptr;
+    }
+
     void clear()
     {
+        for (auto &tileset : tilesets)
+        {
+            delete tileset.second;
+        }
+        tilesets.clear();
         for (auto &graph : graphs)
         {
             Log(LOG_WARNING, " Unload image  %s ", graph.second->filename.c_str());
-            UnloadTexture(graph.second->texture);
-            delete graph.second;
+            discard(graph.second);
         }
         graphs.clear();
+        std::fill(graphByID.begin(), graphByID.end(), nullptr);
+    }
+
+    // bytes of texture memory allowed before unreferenced graphs are evicted (0 = no limit)
+    void setBudget(size_t bytes)
+    {
+        budget = bytes;
+        trim();
     }
+    size_t getBudget() const { return budget; }
+    size_t getMemoryUsed() const { return memoryUsed; }
 
-    Assets() {}
+    void retain(Graph *graph)
+    {
+        if (graph->refCount++ == 0 && graph->inLru)
+        {
+            lru.erase(graph->lruIt);
+            graph->inLru = false;
+        }
+        if (!graph->resident && !graph->orphan)
+        {
+            reload(graph);
+            trim();
+        }
+    }
+
+    void release(Graph *graph)
+    {
+        if (--graph->refCount > 0)
+            return;
+        if (graph->orphan)
+        {
+            delete graph;
+            return;
+        }
+        pushLru(graph);
+        trim();
+    }
+
+    Assets() : memoryUsed(0), budget(256 * 1024 * 1024) {}
     Assets(const Assets &) = delete;
     Assets &operator=(const Assets &) = delete;
 
     std::unordered_map<std::string, Graph *> graphs;
+    std::unordered_map<std::string, Tileset *> tilesets;
+
+private:
+    std::unordered_map<std::string, int> graphIDs;
+    std::unordered_map<uint32_t, int> graphHashes;
+    std::vector<std::string> graphNames;
+    std::vector<Graph *> graphByID;
+    std::list<Graph *> lru; // unreferenced graphs, most recently used first
+    size_t memoryUsed;
+    size_t budget;
+
+    void pushLru(Graph *graph)
+    {
+        if (graph->inLru)
+            lru.erase(graph->lruIt);
+        lru.push_front(graph);
+        graph->lruIt = lru.begin();
+        graph->inLru = true;
+    }
+
+    void touch(Graph *graph)
+    {
+        if (graph->inLru)
+            pushLru(graph);
+        if (!graph->resident)
+        {
+            reload(graph);
+            trim();
+        }
+    }
+
+    bool createMask(Graph *graph, int threshold)
+    {
+        FileBuffer file;
+        if (!FileSystem::Instance().load(graph->filename, file))
+        {
+            Log(LOG_ERROR, "Failed to load mask %s", graph->filename.c_str());
+            return false;
+        }
+        Image image = LoadImageFromMemory(GetFileExtension(graph->filename.c_str()), file.data, (int)file.size);
+        graph->mask.create(image, (unsigned char)threshold);
+        UnloadImage(image);
+        return true;
+    }
+
+    bool reload(Graph *graph)
+    {
+        FileBuffer file;
+        if (!FileSystem::Instance().load(graph->filename, file) || !graph->load(file.data, file.size))
+        {
+            Log(LOG_ERROR, "Failed to reload image %s", graph->filename.c_str());
+            return false;
+        }
+        memoryUsed += graph->memory;
+        return true;
+    }
+
+    void evict(Graph *graph)
+    {
+        if (graph->resident)
+            memoryUsed -= graph->memory;
+        graph->unload();
+    }
+
+    // evict the least recently used unreferenced graphs until the budget fits
+    void trim()
+    {
+        while (budget > 0 && memoryUsed > budget && !lru.empty())
+        {
+            Graph *graph = lru.back();
+            lru.pop_back();
+            graph->inLru = false;
+            evict(graph);
+        }
+    }
+
+    void discard(Graph *graph)
+    {
+        if (graph->inLru)
+        {
+            lru.erase(graph->lruIt);
+            graph->inLru = false;
+        }
+        evict(graph);
+        if (graph->refCount > 0)
+            graph->orphan = true;
+        else
+            delete graph;
+    }
 };
 
+inline GraphHandle::GraphHandle(Graph *graph) : graph(graph)
+{
+    if (graph)
+        Assets::Instance().retain(graph);
+}
+
+inline GraphHandle::GraphHandle(const GraphHandle &other) : graph(other.graph)
+{
+    if (graph)
+        Assets::Instance().retain(graph);
+}
+
+inline GraphHandle::~GraphHandle()
+{
+    if (graph)
+        Assets::Instance().release(graph);
+}
+
+inline GraphHandle &GraphHandle::operator=(const GraphHandle &other)
+{
+    return *this = other.graph;
+}
+
+inline GraphHandle &GraphHandle::operator=(Graph *other)
+{
+    if (other == graph)
+        return *this;
+    if (other)
+        Assets::Instance().retain(other);
+    if (graph)
+        Assets::Instance().release(graph);
+    graph = other;
+    return *this;
+}
+
 
 class GameObject;
 
@@ -204,11 +533,13 @@ public:
 enum ColliderType
 {
     Box,
-    Circle
+    Circle,
+    Oriented
 };
 
 class CircleColiderComponent;
 class BoxColiderComponent;
+class OrientedColiderComponent;
 
 class ColideComponent : public Component
 {
@@ -263,6 +594,33 @@ public:
     void OnColide(ColideComponent *other) override;
 };
 
+// box that follows the rotation/scale of the object, rect is in object local space
+class OrientedColiderComponent : public ColideComponent
+{
+public:
+    Rectangle rect;
+    OrientedColiderComponent(float x, float y, float w, float h)
+    {
+        this->rect.x = x;
+        this->rect.y = y;
+        this->rect.width = w;
+        this->rect.height = h;
+        type = ColliderType::Oriented;
+    }
+    void OnInit() override;
+
+    Vector2 GetWorldPosition() override;
+    // world axes from the transform matrix, valid until the next call
+    const OrientedBox &GetWorldBox();
+
+    void OnDebug() override;
+    bool IsColide(ColideComponent *other) override;
+    void OnColide(ColideComponent *other) override;
+
+private:
+    OrientedBox world;
+};
+
 //*********************************************************************************************************************
 //**                         TransformComponent                                                                       **
 //*********************************************************************************************************************
@@ -293,14 +651,16 @@ class SpriteComponent : public Component
 {
 
 public:
-    Graph *graph;
+    GraphHandle graph;
     Color color;
     bool FlipX;
     bool FlipY;
     Rectangle clip;
-    std::string graphID;
+    int graphID;
 
     SpriteComponent(const std::string &fileName);
+    SpriteComponent(int graphID);
+    SpriteComponent(GraphKey key);
     void OnDraw() override;
     void OnDebug() override;
     void OnInit() override;
@@ -308,23 +668,19 @@ public:
     void SetClip(Rectangle clip);
     void SetClip(float x, float y, float width, float height);
 
+    void SetGraph(int graphID);
+    void SetGraph(const std::string &name);
+    void SetGraph(GraphKey key);
+
+    // pixel perfect through the graph masks (Assets::loadGraph with a mask threshold), follows the world transforms
+    bool PixelCollide(SpriteComponent *other);
+
   
 
 private:
     bool isLoad;
 };
 
-struct Tileset
-{
-    std::string name;
-    std::string imageSource;
-    int firstgid;
-    int tileWidth;
-    int tileHeight;
-    int spacing;
-    int margin;
-};
-
 struct TileLayer
 {
     std::vector<int> data;
@@ -338,14 +694,151 @@ struct TileLayer
     std::string name;
 };
 
+// cells of a tile layer, tile + 1 per cell (0 = empty) in 1 or 2 bytes, widened when a bigger id is set.
+// Can also point straight into a mapped map file, the cells are copied on the first write.
+class TileCells
+{
+public:
+    TileCells() : cells(nullptr), count(0), cellSize(1) {}
+    TileCells(const TileCells &other);
+    TileCells(TileCells &&other) noexcept : TileCells() { swap(other); }
+    TileCells &operator=(TileCells other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    int get(size_t index) const
+    {
+        return (cellSize == 1 ? (int)cells[index] : (int)((const uint16_t *)cells)[index]) - 1;
+    }
+    int operator[](size_t index) const { return get(index); }
+
+    void set(size_t index, int tile);
+    void assign(const int *tiles, size_t count);
+    void assign(const unsigned char *data, size_t count, int cellSize, const std::shared_ptr<FileBuffer> &source);
+    void resize(size_t count);
+    void push_back(int tile);
+    void swap(TileCells &other);
+    void clear();
+
+    size_t size() const { return count; }
+    int getCellSize() const { return cellSize; }
+    const unsigned char *data() const { return cells; }
+    size_t memory() const { return storage.capacity(); }
+    bool isMapped() const { return source != nullptr; }
+
+private:
+    void own();
+    void widen();
+
+    const unsigned char *cells;
+    size_t count;
+    int cellSize;
+    std::vector<unsigned char> storage;
+    std::shared_ptr<FileBuffer> source;
+};
+
+// tile layer cells in 16x16 chunks, an empty layer costs only the chunk directory:
+// uniform chunks keep one value, the others 256 cells (1 or 2 bytes) of their own
+// or read in place from mapped TileCells (copied on the first write).
+struct TileChunk
+{
+    const unsigned char *cells; // mapped, rows are the layer width apart
+    int block;                  // own cells, -1 = uniform or mapped
+    uint16_t value;             // tile + 1 of a uniform chunk
+    uint8_t cellSize;
+};
+
+class TileChunks
+{
+public:
+    static const int SHIFT = 4;
+    static const int SIZE = 1 << SHIFT;
+    static const int MASK = SIZE - 1;
+
+    TileChunks();
+
+    void create(int width, int height); // every cell empty
+    void assign(const int *tiles, int width, int height);
+    void assign(const TileCells &cells, int width, int height);
+    void toCells(TileCells &out) const;
+
+    int get(int x, int y) const
+    {
+        return getTile(chunks[(y >> SHIFT) * columns + (x >> SHIFT)], x & MASK, y & MASK);
+    }
+    void set(int x, int y, int tile);
+    void push_back(int tile); // next cell in row order since create/clear
+    void clear();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getColumns() const { return columns; }
+    int getRows() const { return rows; }
+    const TileChunk &getChunk(int column, int row) const { return chunks[row * columns + column]; }
+    bool isUniform(const TileChunk &chunk) const { return chunk.block < 0 && !chunk.cells; }
+    bool isEmpty(const TileChunk &chunk) const { return isUniform(chunk) && chunk.value == 0; }
+    // x, y inside the chunk
+    int getTile(const TileChunk &chunk, int x, int y) const
+    {
+        const unsigned char *cells;
+        int stride;
+        if (chunk.block >= 0)
+        {
+            cells = blocks[chunk.block].data();
+            stride = SIZE;
+        }
+        else if (chunk.cells)
+        {
+            cells = chunk.cells;
+            stride = width;
+        }
+        else
+            return chunk.value - 1;
+        size_t index = (size_t)y * stride + x;
+        return (chunk.cellSize == 1 ? (int)cells[index] : (int)((const uint16_t *)cells)[index]) - 1;
+    }
+
+    bool isModified() const { return modified; }
+    // directory + own cells + mapped chunks
+    size_t memory() const;
+
+private:
+    template <class Get>
+    void build(Get get);
+    void own(TileChunk &chunk, int column, int row);
+    void widen(TileChunk &chunk);
+
+    std::vector<TileChunk> chunks;
+    std::vector<std::vector<unsigned char>> blocks;
+    TileCells source;
+    int width;
+    int height;
+    int columns;
+    int rows;
+    size_t next;
+    bool modified;
+};
+
+// csv of tile ids parsed/written in place, no stream or string per cell
+// parse: any char that is not a digit or '-' is a separator, returns the number of cells
+size_t ParseTileCSV(const char *text, size_t size, int shift, std::vector<int> &out);
+// columns > 0: one line per row ending with '\n', columns = 0: a single line
+void WriteTileCSV(const int *tiles, size_t count, int columns, std::string &out);
+void WriteTileCSV(const TileCells &tiles, int columns, std::string &out);
+void WriteTileCSV(const TileChunks &tiles, int columns, std::string &out);
+
+class NavGrid;
+
 class TileLayerComponent : public Component
 {
 
 public:
-    Graph *graph;
+    GraphHandle graph;
     Tileset *tileset;
-    std::vector<int> tileMap;
-    std::string graphID;
+    TileChunks tileMap;
+    int graphID;
     int tileWidth;
     int tileHeight;
     int spacing;
@@ -354,8 +847,13 @@ public:
     int height;
     int worldWidth;
     int worldHeight;
+    Vector2 offset; // world position of tile 0,0 (set before OnInit)
+    NavGrid *navGrid; // set by NavGrid::build, told about every tile change
 
     TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, const std::string &fileName);
+    TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, int graphID);
+    TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, GraphKey key);
+    ~TileLayerComponent();
     void OnDraw() override;
     void OnDebug() override;
     void OnInit() override;
@@ -368,6 +866,8 @@ public:
 
     std::string  getCSV() const;
     void loadFromString(const std::string &str,int shift);
+    // Tiled gids (0 = empty) -> tileset ids
+    void loadFromLayer(const TileLayer &layer, int firstgid);
 
     void clear();
     void addTile(int index);
@@ -376,6 +876,8 @@ public:
     int getTile(int x, int y);
     Rectangle getClip(int id);
 
+    void setTileset(Tileset *tileset) { this->tileset = tileset; }
+
     bool isWithinBounds(int x, int y) const
     {
         return x >= 0 && x < width && y >= 0 && y < height;
@@ -388,6 +890,101 @@ private:
     bool isLoad;
 };
 
+// one layer of a TileMapComponent
+struct MapLayer
+{
+    std::string name;
+    TileChunks cells;
+    int depth; // scene layer it is drawn on
+    bool visible;
+};
+
+class TileMapDepthComponent;
+
+// N layers of the same size over one tileset: the uv of every tile id is computed once,
+// the visible cells once per frame, and all the layers of a depth go to the batch in one pass.
+// Layers on another depth are drawn by a proxy object on that scene layer, so objects can sit between them.
+class TileMapComponent : public Component
+{
+public:
+    GraphHandle graph;
+    Tileset *tileset;
+    int graphID;
+    int tileWidth;
+    int tileHeight;
+    int spacing;
+    int margin;
+    int width;
+    int height;
+    Vector2 offset; // world position of tile 0,0 (set before OnInit)
+
+    TileMapComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, int graphID);
+    void OnInit() override;
+    void OnDraw() override;
+    void OnDebug() override;
+    void OnDestroy() override;
+
+    // depth -1 = the layer of the object
+    int addLayer(const std::string &name, int depth = -1);
+    int getLayerIndex(const std::string &name) const;
+    int getLayerCount() const { return (int)layers.size(); }
+    MapLayer *getLayer(int index) { return index >= 0 && index < (int)layers.size() ? &layers[index] : nullptr; }
+
+    void setTile(int layer, int x, int y, int tile);
+    int getTile(int layer, int x, int y) const;
+    void loadFromArray(int layer, const int *tiles);
+    // Tiled gids (0 = empty) -> tileset ids
+    void loadFromLayer(int layer, const TileLayer &tiled, int firstgid);
+    void setTileset(Tileset *tileset) { this->tileset = tileset; }
+
+    bool isWithinBounds(int x, int y) const
+    {
+        return x >= 0 && x < width && y >= 0 && y < height;
+    }
+
+    // every visible layer of that depth
+    void draw(int depth);
+
+private:
+    friend class TileMapDepthComponent;
+
+    struct TileUV
+    {
+        float left;
+        float top;
+        float right;
+        float bottom;
+    };
+
+    void buildClips();
+    void updateRange();
+
+    std::vector<MapLayer> layers;
+    std::vector<TileUV> clips;
+    std::vector<TileMapDepthComponent *> proxies;
+    // scratch of draw(), layers of the depth and their non empty chunks
+    std::vector<const MapLayer *> drawing;
+    std::vector<const MapLayer *> chunkLayers;
+    std::vector<const TileChunk *> chunkCells;
+    int startX;
+    int startY;
+    int endX;
+    int endY;
+    unsigned long rangeFrame;
+};
+
+// draws the layers of one depth of a TileMapComponent
+class TileMapDepthComponent : public Component
+{
+public:
+    TileMapComponent *map;
+    int layerDepth;
+
+    TileMapDepthComponent(TileMapComponent *map, int depth) : map(map), layerDepth(depth) {}
+    void OnDraw() override;
+    void OnDestroy() override;
+};
+
 //*********************************************************************************************************************
 //**                         ANIMATION                                                                              **
 //*********************************************************************************************************************
@@ -399,78 +996,171 @@ enum AnimationMode
     Stop,
     Once
 };
-class Animation
+// immutable clip definition, registered once in the AnimationLibrary and shared by every Animator
+struct AnimationClip
 {
-public:
-    Graph *graph;
-
+    std::string name;
+    int graphID;
     int rows;
     int columns;
-    int imageWidth;
-    int imageHeight;
-
     int frameCount;
-    int currentFrame;
-    float frameDuration;
-    float currentTime;
-    bool isReversed;
-    std::string graphID;
-    
+    AnimationMode mode;
+    std::vector<Rectangle> frames;
+    std::vector<float> durations; // seconds per frame
+    float length;                 // sum of the durations
+};
 
-    
-    Animation(const std::string &graphID, int rows, int columns, int frameCount, float frameDuration);
+class AnimationLibrary
+{
+public:
+    static AnimationLibrary &Instance()
+    {
+        static AnimationLibrary instance;
+        return instance;
+    }
+
+    // same definition -> same clip, so 1000 enemies share one copy of the frame tables
+    int addClip(const std::string &name, int graphID, int rows, int columns, int frameCount, float framesPerSecond, AnimationMode mode = Loop);
+    int addClip(const std::string &name, int graphID, const std::vector<Rectangle> &frames, const std::vector<float> &durations, AnimationMode mode = Loop);
+
+    const AnimationClip *getClip(int id) const
+    {
+        if (id < 0 || id >= (int)clips.size())
+            return nullptr;
+        return clips[id];
+    }
+    int count() const { return (int)clips.size(); }
+    const std::vector<AnimationClip *> &getClips() const { return clips; }
+
+    // only when no Animator uses the clips anymore (ex: scene clear)
+    void clear();
+
+    AnimationLibrary(const AnimationLibrary &) = delete;
+    AnimationLibrary &operator=(const AnimationLibrary &) = delete;
+
+private:
+    AnimationLibrary() {}
+    ~AnimationLibrary() { clear(); }
 
-    Rectangle GetFrame();
-    void Update(float deltaTime, AnimationMode mode);
+    int registerClip(AnimationClip *clip, const std::string &key);
+
+    std::vector<AnimationClip *> clips;
+    std::unordered_map<std::string, int> clipIDs; // definition -> id
 };
 
-class Animator : public Component
+const uint8_t ANIM_PLAYING = 1 << 0;
+const uint8_t ANIM_REVERSED = 1 << 1;
+const uint8_t ANIM_AWAKE = 1 << 2;    // owner was updated this frame (alive, active, not solid)
+const uint8_t ANIM_DIRTY = 1 << 3;    // frame changed, write the sprite clip
+const uint8_t ANIM_NEW_CLIP = 1 << 4; // clip changed, write the sprite graph too
+const uint8_t ANIM_MODE_OVERRIDE = 1 << 5;
+const uint8_t ANIM_VISIBLE = 1 << 6;  // owner bound inside the camera view + margin
+const uint8_t ANIM_FINISHED = 1 << 7; // Stop/Once reached the end of the last frame
+
+class Animator;
+
+// valid until the next AnimationSystem::update
+struct AnimationEvent
+{
+    Animator *animator;
+    int clip;
+};
+
+// playback state of every animator in SoA, advanced in one loop by the Scene after the objects update.
+// Animators out of the view only accumulate time, the frame is solved when they show up again
+// (or when a script asks for it). The ones waiting for an event (Once/Stop end, queued animation)
+// are always advanced so the events happen on the right frame.
+class AnimationSystem
 {
 public:
-    std::vector<std::pair<std::string, Animation *>> animations;
-    std::string currentAnimation;
-    std::string nextAnimation;
-    bool isPlaying;
+    static AnimationSystem &Instance()
+    {
+        static AnimationSystem instance;
+        return instance;
+    }
 
-    AnimationMode mode;
-    SpriteComponent *sprite;
+    int add(Animator *animator);
+    void remove(int slot);
 
-    int frameCount;
-    int currentFrame;
-    float frameDuration;
-    float currentTime;
-    bool isReversed;
+    void update(float deltaTime);
+
+    // frame/time/direction of one slot, returns true when the frame changed
+    static bool advance(const AnimationClip &clip, AnimationMode mode, float deltaTime, float &time, int &frame, uint8_t &state);
+
+    void play(int slot, int clipID);
+    void sync(int slot);
+    void resolve(int slot);
+    void reset(int slot);
+
+    int count() const { return (int)owners.size(); }
+
+    std::vector<float> time;
+    std::vector<float> pending; // time not applied yet (out of view)
+    std::vector<int> frame;
+    std::vector<int> clip;
+    std::vector<int> next;
+    std::vector<uint8_t> mode;
+    std::vector<uint8_t> flags;
+    std::vector<Animator *> owners;
+
+    std::vector<AnimationEvent> events; // Stop/Once finished this update
+    float margin;                       // pixels around the camera view still animated
+
+    AnimationSystem(const AnimationSystem &) = delete;
+    AnimationSystem &operator=(const AnimationSystem &) = delete;
+
+private:
+    AnimationSystem() : margin(64) {}
+};
+
+// the playback state lives in the AnimationSystem, the frames in the shared clips
+class Animator : public Component
+{
+public:
+    std::vector<int> clips; // ids in the AnimationLibrary
+    SpriteComponent *sprite;
     bool isLoad;
-    
+    int slot;
 
     Animator();
+    ~Animator();
 
-    void OnDestroy() override;
     void OnDebug() override;
     void OnInit() override;
     void OnUpdate(float delta) override;
-    Animation *GetAnimation();
+    const AnimationClip *GetClip() const { return AnimationLibrary::Instance().getClip(AnimationSystem::Instance().clip[slot]); }
 
-    
     void Add(const std::string &name, const std::string &graph, int rows, int columns, int frameCount, float framesPerSecond);
-    
-    void AddAnimation(const std::string& name, Animation *animation);
+    void Add(const std::string &name, int graphID, int rows, int columns, int frameCount, float framesPerSecond);
+    void Add(const std::string &name, GraphKey key, int rows, int columns, int frameCount, float framesPerSecond);
+
+    void AddClip(int clipID);
+
+    // resolve the name once and keep the id, SetAnimation(int) is just a compare
+    int GetAnimationID(const std::string &name) const;
 
     void SetMode(AnimationMode mode);
     void SetAnimation(const std::string &name, bool now = true);
+    void SetAnimation(int clipID, bool now = true);
     void Play();
     void Pause();
     void Stop();
 
+    bool IsPlaying() const { return (AnimationSystem::Instance().flags[slot] & ANIM_PLAYING) != 0; }
+    bool IsFinished() const { return (AnimationSystem::Instance().flags[slot] & ANIM_FINISHED) != 0; }
+    bool IsVisible() const { return (AnimationSystem::Instance().flags[slot] & ANIM_VISIBLE) != 0; }
+    int getFrameCount() const;
+    int getCurrentFrame() const;
+    float getFrameDuration() const;
+    float getCurrentTime() const;
+    bool getIsReversed() const;
+    AnimationMode getMode() const { return (AnimationMode)AnimationSystem::Instance().mode[slot]; }
+    int getAnimationID() const { return AnimationSystem::Instance().clip[slot]; }
+    std::string getName() const;
 
-
-    bool IsPlaying() { return isPlaying; }
-    int getFrameCount() { return frameCount; }
-    int getCurrentFrame() { return currentFrame; }
-    float getFrameDuration() { return frameDuration; }
-    float getCurrentTime() { return currentTime; }
-    bool getIsReversed() { return isReversed; }
-    std::string getName() { return currentAnimation; }
+private:
+    friend class AnimationSystem;
+    void writeSprite(const AnimationClip &clip, int frame, bool newClip);
 };
 
 //*********************************************************************************************************************
@@ -508,6 +1198,9 @@ public:
     int originY;
     bool collidable;
     bool pickable;
+    int collisionLayer;         // set by setCollisionLayer, -1 = category/mask set by hand
+    uint32_t collisionCategory; // layer bits of this object (CollisionSystem layers)
+    uint32_t collisionMask;     // layers it collides with
 
     bool solid;
 
@@ -550,6 +1243,13 @@ public:
     Vec2 GetLocalPoint(float x, float y);
 
     bool collideWith(GameObject *e, float x, float y);
+    // category = the layer, mask = the layer row of the collision matrix (kept in sync by setLayerCollision)
+    void setCollisionLayer(int layer);
+    // layers both ways, solids never test against solids
+    bool canCollide(const GameObject *other) const
+    {
+        return (collisionCategory & other->collisionMask) && (other->collisionCategory & collisionMask) && !(solid && other->solid);
+    }
     bool place_free(float x, float y);
     bool place_meeting(float x, float y, const std::string &name);
     bool place_meeting_layer(float x, float y, int layer);
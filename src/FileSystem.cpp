@@ -0,0 +1,438 @@
+#include "FileSystem.hpp"
+#include "Pack.hpp"
+#include "Utils.hpp"
+#include <sstream>
+#include <cstdio>
+
+#if defined(_WIN32)
+#define FILESYSTEM_NO_MMAP
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// sub folders of assets that are searched by name only, in this order
+static const char *assetFolders[] = {"", "images", "textures", "levels", "sounds"};
+
+void FileBuffer::clear()
+{
+#if !defined(FILESYSTEM_NO_MMAP)
+    if (mapping)
+        munmap(mapping, mappingSize);
+#endif
+    mapping = nullptr;
+    mappingSize = 0;
+    archive.reset();
+    data = nullptr;
+    size = 0;
+    storage.clear();
+    storage.shrink_to_fit();
+}
+
+bool MapFile(const std::string &fileName, FileBuffer &out)
+{
+    out.clear();
+
+#if defined(FILESYSTEM_NO_MMAP)
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0)
+    {
+        fclose(file);
+        return false;
+    }
+    out.storage.resize((size_t)size + 1);
+    size_t count = fread(out.storage.data(), 1, (size_t)size, file);
+    fclose(file);
+    out.storage[count] = 0;
+    out.data = out.storage.data();
+    out.size = count;
+    return true;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    out.mapping = data;
+    out.mappingSize = (size_t)st.st_size;
+    out.data = (const unsigned char *)data;
+    out.size = (size_t)st.st_size;
+    return true;
+#endif
+}
+
+std::string NormalizePath(const std::string &path)
+{
+    std::string result;
+    result.reserve(path.size());
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        char c = path[i] == '\\' ? '/' : path[i];
+        if (c == '/' && !result.empty() && result.back() == '/')
+            continue;
+        result += c;
+    }
+    while (result.size() >= 2 && result[0] == '.' && result[1] == '/')
+        result.erase(0, 2);
+    while (result.size() > 1 && result.back() == '/')
+        result.pop_back();
+    return result;
+}
+
+FileSystem::FileSystem()
+{
+    mountDefaults();
+}
+
+FileSystem::~FileSystem()
+{
+    unmountPacks();
+}
+
+void FileSystem::mountDefaults()
+{
+    for (const char *folder : assetFolders)
+    {
+        std::string sub = *folder ? std::string("/") + folder : "";
+        mount("assets" + sub);
+        mount("../assets" + sub);
+    }
+    Log(LOG_INFO, "FileSystem: %d files indexed", (int)files.size());
+
+    if (FileExists("assets.pak"))
+        mountPack("assets.pak");
+}
+
+bool FileSystem::mountPack(const std::string &fileName)
+{
+    std::shared_ptr<PackArchive> archive(new PackArchive());
+    if (!archive->open(fileName))
+        return false;
+    archives.push_back(archive);
+
+    // same rules as the loose files: full name, root/name, then name inside the asset folders
+    std::unordered_map<std::string, PackedFile> names;
+    const std::string &root = archive->getRoot();
+    for (const char *folder : assetFolders)
+    {
+        std::string prefix = *folder ? std::string(folder) + "/" : "";
+        for (int i = 0; i < archive->count(); i++)
+        {
+            PackedFile file;
+            file.archive = archive;
+            file.entry = archive->getEntry(i);
+            std::string name = archive->getName(file.entry);
+            if (prefix.empty())
+            {
+                names[name] = file;
+                if (!root.empty())
+                    names[root + "/" + name] = file;
+            }
+            else if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0)
+            {
+                names.emplace(name.substr(prefix.size()), file);
+            }
+        }
+    }
+    for (auto &name : names)
+    {
+        packed[name.first] = name.second;
+    }
+
+    Log(LOG_INFO, "FileSystem: pack %s %d entries", fileName.c_str(), archive->count());
+    return true;
+}
+
+void FileSystem::unmountPacks()
+{
+    // a pack still read in place by a FileBuffer is closed with the last one
+    packed.clear();
+    archives.clear();
+}
+
+bool FileSystem::readPacked(const PackedFile &file, FileBuffer &out) const
+{
+    if (!file.archive->read(file.entry, out))
+        return false;
+    if (out.isMapped())
+        out.archive = file.archive;
+    return true;
+}
+
+bool FileSystem::load(const std::string &path, FileBuffer &out) const
+{
+    out.clear();
+
+    auto it = packed.find(path);
+    if (it != packed.end())
+        return readPacked(it->second, out);
+
+    std::string fileName;
+    if (!resolve(path, fileName))
+        return false;
+
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    out.storage.resize((size_t)size + 1);
+    size_t count = fread(out.storage.data(), 1, (size_t)size, file);
+    fclose(file);
+    out.storage[count] = 0;
+    out.data = out.storage.data();
+    out.size = count;
+    return true;
+}
+
+bool FileSystem::map(const std::string &path, FileBuffer &out) const
+{
+    out.clear();
+
+    auto it = packed.find(path);
+    if (it != packed.end())
+        return readPacked(it->second, out);
+
+    std::string fileName;
+    if (!resolve(path, fileName))
+        return false;
+    return MapFile(fileName, out);
+}
+
+const std::vector<std::string> *FileSystem::getListing(const std::string &root)
+{
+    auto it = listings.find(root);
+    if (it != listings.end())
+        return &it->second;
+
+    // sub folder of a root already scanned, filter the parent listing
+    const std::vector<std::string> *parent = nullptr;
+    for (const auto &listing : listings)
+    {
+        const std::string &key = listing.first;
+        if (root.size() > key.size() && root.compare(0, key.size(), key) == 0 && root[key.size()] == '/')
+        {
+            parent = &listing.second;
+            break;
+        }
+    }
+    if (parent)
+    {
+        std::vector<std::string> files;
+        for (const std::string &p : *parent)
+        {
+            if (p.size() > root.size() && p.compare(0, root.size(), root) == 0 && p[root.size()] == '/')
+                files.push_back(p);
+        }
+        std::vector<std::string> &result = listings[root];
+        result.swap(files);
+        return &result;
+    }
+
+    if (!DirectoryExists(root.c_str()))
+        return nullptr;
+
+    std::vector<std::string> &files = listings[root];
+    FilePathList list = LoadDirectoryFilesEx(root.c_str(), NULL, true);
+    files.reserve(list.count);
+    for (unsigned int i = 0; i < list.count; i++)
+    {
+        files.push_back(NormalizePath(list.paths[i]));
+    }
+    UnloadDirectoryFiles(list);
+    return &files;
+}
+
+bool FileSystem::apply(const MountPoint &mount)
+{
+    const std::vector<std::string> *listing = getListing(mount.root);
+    if (!listing)
+        return false;
+
+    for (const std::string &p : *listing)
+    {
+        physical.insert(p);
+        std::string logical = p.substr(mount.root.size() + 1);
+        if (mount.overlay)
+            files[logical] = p;
+        else
+            files.emplace(logical, p);
+    }
+    return true;
+}
+
+bool FileSystem::mount(const std::string &root, bool overlay)
+{
+    MountPoint mount;
+    mount.root = NormalizePath(root);
+    mount.overlay = overlay;
+    mounts.push_back(mount);
+    return apply(mount);
+}
+
+void FileSystem::unmountAll()
+{
+    mounts.clear();
+    files.clear();
+    physical.clear();
+}
+
+void FileSystem::rebuild()
+{
+    files.clear();
+    physical.clear();
+    for (const MountPoint &mount : mounts)
+    {
+        apply(mount);
+    }
+}
+
+void FileSystem::refresh()
+{
+    listings.clear();
+    rebuild();
+}
+
+void FileSystem::addFile(const std::string &path)
+{
+    std::string p = NormalizePath(path);
+    for (MountPoint &mount : mounts)
+    {
+        const std::string &root = mount.root;
+        if (p.size() > root.size() && p.compare(0, root.size(), root) == 0 && p[root.size()] == '/')
+        {
+            auto it = listings.find(root);
+            if (it != listings.end() && std::find(it->second.begin(), it->second.end(), p) == it->second.end())
+                it->second.push_back(p);
+            physical.insert(p);
+            std::string logical = p.substr(root.size() + 1);
+            if (mount.overlay)
+                files[logical] = p;
+            else
+                files.emplace(logical, p);
+        }
+    }
+}
+
+bool FileSystem::resolve(const std::string &path, std::string &out) const
+{
+    if (physical.find(path) != physical.end())
+    {
+        out = path;
+        return true;
+    }
+    auto it = files.find(path);
+    if (it != files.end())
+    {
+        out = it->second;
+        return true;
+    }
+
+    // outside the mounts (absolute paths, files next to the executable...), one probe only
+    if (FileExists(path.c_str()))
+    {
+        out = path;
+        return true;
+    }
+    return false;
+}
+
+bool FileSystem::exists(const std::string &path) const
+{
+    if (packed.find(path) != packed.end())
+        return true;
+    std::string p;
+    return resolve(path, p);
+}
+
+std::string FileSystem::getPath(const std::string &path) const
+{
+    auto it = files.find(path);
+    if (it != files.end())
+        return it->second;
+    return path;
+}
+
+bool FileSystem::loadManifest(const std::string &fileName)
+{
+    char *text = LoadFileText(fileName.c_str());
+    if (text == nullptr)
+    {
+        Log(LOG_ERROR, "FileSystem: reading manifest %s", fileName.c_str());
+        return false;
+    }
+
+    listings.clear();
+    std::istringstream stream(text);
+    std::vector<std::string> *current = nullptr;
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        if (line[0] == '@')
+            current = &listings[NormalizePath(line.substr(1))];
+        else if (current)
+            current->push_back(line);
+    }
+    UnloadFileText(text);
+
+    rebuild();
+    Log(LOG_INFO, "FileSystem: manifest %s %d files indexed", fileName.c_str(), (int)files.size());
+    return true;
+}
+
+bool FileSystem::saveManifest(const std::string &fileName) const
+{
+    std::string content;
+    for (const auto &listing : listings)
+    {
+        // sub folders are rebuilt from the parent listing
+        bool child = false;
+        for (const auto &other : listings)
+        {
+            const std::string &parent = other.first;
+            if (listing.first.size() > parent.size() && listing.first.compare(0, parent.size(), parent) == 0 && listing.first[parent.size()] == '/')
+                child = true;
+        }
+        if (child)
+            continue;
+
+        content += "@" + listing.first + "\n";
+        for (const std::string &p : listing.second)
+        {
+            content += p + "\n";
+        }
+    }
+
+    if (!SaveFileText(fileName.c_str(), const_cast<char *>(content.c_str())))
+    {
+        Log(LOG_ERROR, "FileSystem: saving manifest %s", fileName.c_str());
+        return false;
+    }
+    return true;
+}
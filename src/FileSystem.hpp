@@ -0,0 +1,123 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+//*********************************************************************************************************************
+//**                         FileSystem                                                                              **
+//*********************************************************************************************************************
+
+// Virtual file system: the asset roots are scanned once (or read from a manifest) and every
+// logical name is resolved with a hash lookup, no FileExists probing per load.
+// Mounts are resolved in the order they were added (the first one wins) unless mounted as overlay,
+// in that case the new entries replace the old ones (patches, mods, ...).
+
+class PackArchive;
+struct PackEntry;
+
+// bytes of a file, memory mapped (from a pack or MapFile, no copy) or loaded from disk,
+// files loaded from disk are always followed by a 0 so text files can be parsed in place
+class FileBuffer
+{
+public:
+    FileBuffer() : data(nullptr), size(0), mapping(nullptr), mappingSize(0) {}
+    ~FileBuffer() { clear(); }
+
+    const unsigned char *data;
+    size_t size;
+    std::vector<unsigned char> storage;
+    std::shared_ptr<PackArchive> archive; // read in place from a pack, keeps it mapped after unmountPacks
+
+    const char *text() const { return (const char *)data; }
+    bool isMapped() const { return data != nullptr && storage.empty(); }
+    void clear();
+
+    FileBuffer(const FileBuffer &) = delete;
+    FileBuffer &operator=(const FileBuffer &) = delete;
+
+private:
+    friend bool MapFile(const std::string &fileName, FileBuffer &out);
+    void *mapping; // owned mmap of a whole file
+    size_t mappingSize;
+};
+
+// mmap a file from disk (read only), read into storage where there is no mmap
+bool MapFile(const std::string &fileName, FileBuffer &out);
+
+struct PackedFile
+{
+    std::shared_ptr<PackArchive> archive;
+    const PackEntry *entry;
+};
+
+struct MountPoint
+{
+    std::string root;
+    bool overlay;
+};
+
+class FileSystem
+{
+public:
+    static FileSystem &Instance()
+    {
+        static FileSystem instance;
+        return instance;
+    }
+
+    // same order as the old GetPath/FileInPath/loadGraph prefix lists
+    void mountDefaults();
+
+    bool mount(const std::string &root, bool overlay = false);
+    void unmountAll();
+
+    // drop the cached directory listings and scan the roots again
+    void refresh();
+
+    // manifest = the directory listings, so a build can skip the scan at startup
+    bool loadManifest(const std::string &fileName);
+    bool saveManifest(const std::string &fileName) const;
+
+    // pack entries take priority over loose files, the last pack mounted wins
+    bool mountPack(const std::string &fileName);
+    void unmountPacks();
+
+    // read a whole file, from a pack when it is there
+    bool load(const std::string &path, FileBuffer &out) const;
+    // same, but loose files are memory mapped instead of read (binary data used in place)
+    bool map(const std::string &path, FileBuffer &out) const;
+
+    // register a file created at runtime (ex: editor saves)
+    void addFile(const std::string &path);
+
+    bool resolve(const std::string &path, std::string &out) const;
+    bool exists(const std::string &path) const;
+    std::string getPath(const std::string &path) const;
+
+    size_t count() const { return files.size(); }
+    size_t countPacked() const { return packed.size(); }
+    const std::vector<MountPoint> &getMounts() const { return mounts; }
+
+    FileSystem(const FileSystem &) = delete;
+    FileSystem &operator=(const FileSystem &) = delete;
+
+private:
+    FileSystem();
+    ~FileSystem();
+
+    void rebuild();
+    bool apply(const MountPoint &mount);
+    bool readPacked(const PackedFile &file, FileBuffer &out) const;
+    const std::vector<std::string> *getListing(const std::string &root);
+
+    std::vector<MountPoint> mounts;
+    std::unordered_map<std::string, std::string> files;             // logical -> physical
+    std::unordered_set<std::string> physical;                       // every physical path under a mount
+    std::unordered_map<std::string, std::vector<std::string>> listings; // scanned root -> physical paths
+    std::unordered_map<std::string, PackedFile> packed;             // logical and physical -> pack entry
+    std::vector<std::shared_ptr<PackArchive>> archives;
+};
+
+std::string NormalizePath(const std::string &path);
@@ -0,0 +1,406 @@
+#include "Pack.hpp"
+#include "Utils.hpp"
+#include <cstdio>
+
+static_assert(sizeof(PackHeader) == 64, "PackHeader layout");
+static_assert(sizeof(PackEntry) == 32, "PackEntry layout");
+
+//*********************************************************************************************************************
+//**                         LZ4                                                                                     **
+//*********************************************************************************************************************
+
+// LZ4 block format, greedy compressor (good enough for an offline packer) and a safe decoder
+
+static const int LZ4_MINMATCH = 4;
+static const int LZ4_LASTLITERALS = 5;
+static const int LZ4_MFLIMIT = 12;
+static const int LZ4_HASHBITS = 12;
+
+static uint32_t Lz4Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4_HASHBITS);
+}
+
+static void Lz4Length(std::vector<unsigned char> &out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back((unsigned char)length);
+}
+
+static void Lz4Literals(std::vector<unsigned char> &out, const unsigned char *literals, size_t count, int matchLength)
+{
+    unsigned char token = (unsigned char)((count >= 15 ? 15 : count) << 4);
+    if (matchLength >= 0)
+        token |= (unsigned char)(matchLength >= 15 ? 15 : matchLength);
+    out.push_back(token);
+    if (count >= 15)
+        Lz4Length(out, count - 15);
+    out.insert(out.end(), literals, literals + count);
+}
+
+int Lz4Compress(const unsigned char *src, int size, std::vector<unsigned char> &out)
+{
+    out.clear();
+    out.reserve(size + size / 255 + 16);
+
+    std::vector<int> table(1 << LZ4_HASHBITS, -1);
+    int anchor = 0;
+    int ip = 0;
+    int matchLimit = size - LZ4_LASTLITERALS;
+    int ipLimit = size - LZ4_MFLIMIT;
+
+    while (ip < ipLimit)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, src + ip, 4);
+        uint32_t h = Lz4Hash(sequence);
+        int ref = table[h];
+        table[h] = ip;
+
+        uint32_t refSequence = 0;
+        if (ref >= 0)
+            memcpy(&refSequence, src + ref, 4);
+        if (ref < 0 || ip - ref > 65535 || refSequence != sequence)
+        {
+            ip++;
+            continue;
+        }
+
+        int length = LZ4_MINMATCH;
+        while (ip + length < matchLimit && src[ref + length] == src[ip + length])
+            length++;
+
+        int offset = ip - ref;
+        int matchLength = length - LZ4_MINMATCH;
+        Lz4Literals(out, src + anchor, ip - anchor, matchLength);
+        out.push_back((unsigned char)(offset & 0xFF));
+        out.push_back((unsigned char)(offset >> 8));
+        if (matchLength >= 15)
+            Lz4Length(out, matchLength - 15);
+
+        ip += length;
+        anchor = ip;
+    }
+
+    Lz4Literals(out, src + anchor, size - anchor, -1);
+    return (int)out.size();
+}
+
+int Lz4Decompress(const unsigned char *src, int srcSize, unsigned char *dst, int dstCapacity)
+{
+    const unsigned char *ip = src;
+    const unsigned char *iend = src + srcSize;
+    unsigned char *op = dst;
+    unsigned char *oend = dst + dstCapacity;
+
+    while (ip < iend)
+    {
+        unsigned int token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            unsigned int s;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                literals += s;
+            } while (s == 255);
+        }
+        if ((size_t)(iend - ip) < literals || (size_t)(oend - op) < literals)
+            return -1;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip >= iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst))
+            return -1;
+
+        size_t length = token & 15;
+        if (length == 15)
+        {
+            unsigned int s;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                length += s;
+            } while (s == 255);
+        }
+        length += LZ4_MINMATCH;
+        if ((size_t)(oend - op) < length)
+            return -1;
+
+        // the match can overlap the output, copy forward byte by byte
+        const unsigned char *match = op - offset;
+        for (size_t i = 0; i < length; i++)
+            op[i] = match[i];
+        op += length;
+    }
+    return (int)(op - dst);
+}
+
+//*********************************************************************************************************************
+//**                         PackArchive                                                                             **
+//*********************************************************************************************************************
+
+PackArchive::PackArchive() : header(nullptr), entries(nullptr), names(nullptr)
+{
+}
+
+PackArchive::~PackArchive()
+{
+    close();
+}
+
+bool PackArchive::open(const std::string &fileName)
+{
+    close();
+
+    if (!MapFile(fileName, file))
+    {
+        Log(LOG_ERROR, "Pack: open %s", fileName.c_str());
+        return false;
+    }
+    if (file.size < sizeof(PackHeader))
+    {
+        Log(LOG_ERROR, "Pack: %s is empty", fileName.c_str());
+        close();
+        return false;
+    }
+
+    header = (const PackHeader *)file.data;
+    if (memcmp(header->magic, "URPK", 4) != 0 || header->version != PACK_VERSION ||
+        header->tocOffset + (uint64_t)header->count * sizeof(PackEntry) > file.size ||
+        header->namesOffset + header->namesSize > file.size || header->rootLength > header->namesSize)
+    {
+        Log(LOG_ERROR, "Pack: %s is not a valid pack", fileName.c_str());
+        close();
+        return false;
+    }
+
+    entries = (const PackEntry *)(file.data + header->tocOffset);
+    names = (const char *)(file.data + header->namesOffset);
+
+    // names and blobs are read without checks after this
+    for (uint32_t i = 0; i < header->count; i++)
+    {
+        const PackEntry &entry = entries[i];
+        if ((uint64_t)entry.nameOffset + entry.nameLength > header->namesSize ||
+            entry.offset > file.size || entry.size > file.size - entry.offset)
+        {
+            Log(LOG_ERROR, "Pack: %s entry %u is out of range", fileName.c_str(), i);
+            close();
+            return false;
+        }
+    }
+
+    root.assign(names, header->rootLength);
+    this->fileName = fileName;
+    return true;
+}
+
+void PackArchive::close()
+{
+    file.clear();
+    header = nullptr;
+    entries = nullptr;
+    names = nullptr;
+    root.clear();
+}
+
+std::string PackArchive::getName(const PackEntry *entry) const
+{
+    return std::string(names + entry->nameOffset, entry->nameLength);
+}
+
+const PackEntry *PackArchive::find(const std::string &name) const
+{
+    int lo = 0;
+    int hi = count() - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        const PackEntry &entry = entries[mid];
+        size_t length = std::min((size_t)entry.nameLength, name.size());
+        int cmp = memcmp(names + entry.nameOffset, name.data(), length);
+        if (cmp == 0)
+            cmp = (int)entry.nameLength - (int)name.size();
+        if (cmp == 0)
+            return &entry;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return nullptr;
+}
+
+bool PackArchive::read(const PackEntry *entry, FileBuffer &out) const
+{
+    out.clear();
+    if (!entry || entry->offset + entry->size > file.size)
+        return false;
+
+    const unsigned char *blob = file.data + entry->offset;
+    if ((entry->flags & PACK_LZ4) == 0)
+    {
+        out.data = blob;
+        out.size = entry->size;
+        return true;
+    }
+
+    out.storage.resize((size_t)entry->rawSize + 1);
+    int count = Lz4Decompress(blob, (int)entry->size, out.storage.data(), (int)entry->rawSize);
+    if (count != (int)entry->rawSize)
+    {
+        Log(LOG_ERROR, "Pack: corrupted entry %s", getName(entry).c_str());
+        out.clear();
+        return false;
+    }
+    out.storage[entry->rawSize] = 0;
+    out.data = out.storage.data();
+    out.size = entry->rawSize;
+    return true;
+}
+
+//*********************************************************************************************************************
+//**                         PackWriter                                                                              **
+//*********************************************************************************************************************
+
+void PackWriter::add(const std::string &name, const std::string &fileName)
+{
+    files.push_back(std::make_pair(NormalizePath(name), fileName));
+}
+
+int PackWriter::addDirectory(const std::string &path)
+{
+    root = NormalizePath(path);
+    if (!DirectoryExists(root.c_str()))
+    {
+        Log(LOG_ERROR, "Pack: folder %s not found", root.c_str());
+        return 0;
+    }
+
+    FilePathList list = LoadDirectoryFilesEx(root.c_str(), NULL, true);
+    for (unsigned int i = 0; i < list.count; i++)
+    {
+        std::string fileName = NormalizePath(list.paths[i]);
+        add(fileName.substr(root.size() + 1), fileName);
+    }
+    UnloadDirectoryFiles(list);
+    return (int)list.count;
+}
+
+static uint64_t PackAlign(uint64_t value)
+{
+    return (value + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1);
+}
+
+bool PackWriter::save(const std::string &fileName)
+{
+    std::sort(files.begin(), files.end());
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "URPK", 4);
+    header.version = PACK_VERSION;
+    header.count = (uint32_t)files.size();
+    header.rootLength = (uint32_t)root.size();
+    header.tocOffset = sizeof(PackHeader);
+    header.namesOffset = header.tocOffset + files.size() * sizeof(PackEntry);
+
+    std::string names = root;
+    std::vector<PackEntry> entries(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        memset(&entries[i], 0, sizeof(PackEntry));
+        entries[i].nameOffset = (uint32_t)names.size();
+        entries[i].nameLength = (uint32_t)files[i].first.size();
+        names += files[i].first;
+    }
+    header.namesSize = names.size();
+
+    FILE *file = fopen(fileName.c_str(), "wb");
+    if (!file)
+    {
+        Log(LOG_ERROR, "Pack: create %s", fileName.c_str());
+        return false;
+    }
+
+    // blobs first, the toc is written at the end when all the offsets are known
+    uint64_t offset = PackAlign(header.namesOffset + header.namesSize);
+    std::vector<unsigned char> packed;
+    size_t rawTotal = 0;
+    size_t storedTotal = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        int bytesRead = 0;
+        unsigned char *data = LoadFileData(files[i].second.c_str(), &bytesRead);
+        if (!data && bytesRead != 0)
+        {
+            Log(LOG_ERROR, "Pack: reading %s", files[i].second.c_str());
+            fclose(file);
+            return false;
+        }
+
+        const unsigned char *blob = data;
+        uint32_t stored = (uint32_t)bytesRead;
+        entries[i].rawSize = (uint32_t)bytesRead;
+
+        // only keep the compressed version when it pays (png/ogg are already compressed)
+        if (compress && bytesRead > 64)
+        {
+            int count = Lz4Compress(data, bytesRead, packed);
+            if (count < bytesRead - bytesRead / 10)
+            {
+                blob = packed.data();
+                stored = (uint32_t)count;
+                entries[i].flags |= PACK_LZ4;
+            }
+        }
+
+        entries[i].offset = offset;
+        entries[i].size = stored;
+        fseek(file, (long)offset, SEEK_SET);
+        if (stored > 0)
+            fwrite(blob, 1, stored, file);
+        unsigned char zero = 0;
+        fwrite(&zero, 1, 1, file);
+        offset = PackAlign(offset + stored + 1);
+
+        rawTotal += bytesRead;
+        storedTotal += stored;
+        if (data)
+            UnloadFileData(data);
+    }
+
+    // pad the last blob so the file size is aligned too
+    fseek(file, (long)offset - 1, SEEK_SET);
+    unsigned char zero = 0;
+    fwrite(&zero, 1, 1, file);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    if (!entries.empty())
+        fwrite(entries.data(), sizeof(PackEntry), entries.size(), file);
+    fwrite(names.data(), 1, names.size(), file);
+    fclose(file);
+
+    Log(LOG_INFO, "Pack: %s %d files %.2f MB (%.2f MB raw)", fileName.c_str(), (int)files.size(), memoryInMB(storedTotal), memoryInMB(rawTotal));
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "FileSystem.hpp"
+#include <cstdint>
+
+//*********************************************************************************************************************
+//**                         Pack                                                                                    **
+//*********************************************************************************************************************
+
+// Layout of a .pak file (little endian):
+//   PackHeader
+//   PackEntry[count]      sorted by name, binary searched at runtime
+//   names                 pack root + entry names, not terminated
+//   blobs                 each one 4K aligned and followed by a 0 byte, so text can be used in place
+// The file is memory mapped, uncompressed entries are served straight from the mapping.
+
+const uint32_t PACK_VERSION = 1;
+const uint32_t PACK_ALIGN = 4096;
+const uint32_t PACK_LZ4 = 1 << 0;
+
+struct PackHeader
+{
+    char magic[4]; // URPK
+    uint32_t version;
+    uint32_t count;
+    uint32_t rootLength;
+    uint64_t tocOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint8_t reserved[24];
+};
+
+struct PackEntry
+{
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint64_t offset;
+    uint32_t size;    // bytes stored in the pack
+    uint32_t rawSize; // bytes after decompression
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+class PackArchive
+{
+public:
+    PackArchive();
+    ~PackArchive();
+
+    bool open(const std::string &fileName);
+    void close();
+
+    const PackEntry *find(const std::string &name) const;
+    bool read(const PackEntry *entry, FileBuffer &out) const;
+
+    int count() const { return header ? (int)header->count : 0; }
+    const PackEntry *getEntry(int index) const { return &entries[index]; }
+    std::string getName(const PackEntry *entry) const;
+    const std::string &getRoot() const { return root; }
+    const std::string &getFileName() const { return fileName; }
+
+    PackArchive(const PackArchive &) = delete;
+    PackArchive &operator=(const PackArchive &) = delete;
+
+private:
+    std::string fileName;
+    std::string root;
+    FileBuffer file;
+    const PackHeader *header;
+    const PackEntry *entries;
+    const char *names;
+};
+
+class PackWriter
+{
+public:
+    PackWriter() : compress(false) {}
+
+    bool compress;
+
+    void add(const std::string &name, const std::string &fileName);
+    int addDirectory(const std::string &root);
+    bool save(const std::string &fileName);
+
+private:
+    std::string root;
+    std::vector<std::pair<std::string, std::string>> files; // name -> file on disk
+};
+
+int Lz4Compress(const unsigned char *src, int size, std::vector<unsigned char> &out);
+int Lz4Decompress(const unsigned char *src, int srcSize, unsigned char *dst, int dstCapacity);
@@ -0,0 +1,451 @@
+#include "Particles.hpp"
+#include <cfloat>
+#include <cmath>
+
+#if !defined(PARTICLES_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define PARTICLES_AVX
+#elif !defined(PARTICLES_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define PARTICLES_SSE
+#endif
+
+//*********************************************************************************************************************
+//**                         ParticleSystemComponent                                                                 **
+//*********************************************************************************************************************
+
+ParticleEmitter::ParticleEmitter()
+    : shape(ShapePoint), width(0), height(0), rate(0),
+      lifeMin(1), lifeMax(1), speedMin(0), speedMax(0), angleMin(0), angleMax(360), spinMin(0), spinMax(0),
+      sizeStart(8), sizeEnd(8), colorStart(WHITE), colorEnd(WHITE), gravity({0, 0}), damping(1), frames(1), blend(BLEND_ALPHA)
+{
+}
+
+static uint32_t particleSeeds = 2463534242u;
+
+ParticleSystemComponent::ParticleSystemComponent(int graphID, int capacity)
+    : graphID(graphID), emitting(true), count(0), capacity(std::max(capacity, 0)), pending(0), accumulator(0), slot(-1)
+{
+    graph = Assets::Instance().getGraph(graphID);
+    if (!graph)
+        Log(LOG_ERROR, "ParticleSystemComponent::ParticleSystemComponent  %s ", Assets::Instance().getGraphName(graphID).c_str());
+
+    x.resize(this->capacity);
+    y.resize(this->capacity);
+    vx.resize(this->capacity);
+    vy.resize(this->capacity);
+    life.resize(this->capacity);
+    invLife.resize(this->capacity);
+    size.resize(this->capacity);
+    rotation.resize(this->capacity);
+    spin.resize(this->capacity);
+
+    particleSeeds += 0x9E3779B9u;
+    seed = particleSeeds | 1;
+    origin = {0, 0};
+    bounds = {0, 0, 0, 0};
+}
+
+ParticleSystemComponent::ParticleSystemComponent(const std::string &fileName, int capacity)
+    : ParticleSystemComponent(Assets::Instance().getGraphID(fileName), capacity)
+{
+}
+
+ParticleSystemComponent::ParticleSystemComponent(GraphKey key, int capacity)
+    : ParticleSystemComponent(Assets::Instance().getGraphID(key), capacity)
+{
+}
+
+ParticleSystemComponent::~ParticleSystemComponent()
+{
+    if (slot >= 0)
+        ParticleSystem::Instance().remove(slot);
+}
+
+void ParticleSystemComponent::OnInit()
+{
+    slot = ParticleSystem::Instance().add(this);
+    Vec2 p = object->GetWorldPoint(0, 0);
+    origin = {p.x, p.y};
+}
+
+void ParticleSystemComponent::OnUpdate(float deltaTime)
+{
+    (void)deltaTime;
+    Vec2 p = object->GetWorldPoint(0, 0);
+    origin = {p.x, p.y};
+}
+
+// xorshift, one state per emitter so the steps can run on any thread
+float ParticleSystemComponent::random(float min, float max)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return min + (max - min) * (float)(seed >> 8) * (1.0f / 16777216.0f);
+}
+
+void ParticleSystemComponent::spawn(int amount)
+{
+    amount = std::min(amount, capacity - count);
+    bool spinning = emitter.spinMin != 0 || emitter.spinMax != 0;
+    for (int k = 0; k < amount; k++)
+    {
+        int i = count++;
+        float ox = 0;
+        float oy = 0;
+        switch (emitter.shape)
+        {
+        case ShapeCircle:
+        case ShapeRing:
+        {
+            float a = random(0, 2 * PI);
+            float r = emitter.shape == ShapeRing ? emitter.width : emitter.width * sqrtf(random(0, 1));
+            ox = cosf(a) * r;
+            oy = sinf(a) * r;
+            break;
+        }
+        case ShapeRectangle:
+            ox = random(-0.5f, 0.5f) * emitter.width;
+            oy = random(-0.5f, 0.5f) * emitter.height;
+            break;
+        default:
+            break;
+        }
+        x[i] = origin.x + ox;
+        y[i] = origin.y + oy;
+
+        float angle = random(emitter.angleMin, emitter.angleMax) * DEG2RAD;
+        float speed = random(emitter.speedMin, emitter.speedMax);
+        vx[i] = cosf(angle) * speed;
+        vy[i] = sinf(angle) * speed;
+
+        float l = std::max(random(emitter.lifeMin, emitter.lifeMax), 0.001f);
+        life[i] = l;
+        invLife[i] = 1.0f / l;
+        size[i] = emitter.sizeStart;
+        rotation[i] = spinning ? random(0, 360) : 0;
+        spin[i] = spinning ? random(emitter.spinMin, emitter.spinMax) : 0;
+    }
+}
+
+void ParticleSystemComponent::simulate(float deltaTime)
+{
+    if (emitting && emitter.rate > 0)
+    {
+        accumulator += emitter.rate * deltaTime;
+        int amount = (int)accumulator;
+        accumulator -= amount;
+        pending += amount;
+    }
+    if (pending > 0)
+    {
+        spawn(pending);
+        pending = 0;
+    }
+
+    const float dt = deltaTime;
+    const float gx = emitter.gravity.x * dt;
+    const float gy = emitter.gravity.y * dt;
+    const float damp = emitter.damping >= 1.0f ? 1.0f : powf(std::max(emitter.damping, 0.0f), dt);
+    const float sizeEnd = emitter.sizeEnd;
+    const float sizeRange = emitter.sizeStart - emitter.sizeEnd;
+
+    float *px = x.data();
+    float *py = y.data();
+    float *pvx = vx.data();
+    float *pvy = vy.data();
+    float *pl = life.data();
+    const float *pinv = invLife.data();
+    float *psize = size.data();
+    float *prot = rotation.data();
+    const float *pspin = spin.data();
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    int i = 0;
+
+#if defined(PARTICLES_AVX)
+    {
+        const __m256 vdt = _mm256_set1_ps(dt);
+        const __m256 vgx = _mm256_set1_ps(gx);
+        const __m256 vgy = _mm256_set1_ps(gy);
+        const __m256 vdamp = _mm256_set1_ps(damp);
+        const __m256 vend = _mm256_set1_ps(sizeEnd);
+        const __m256 vrange = _mm256_set1_ps(sizeRange);
+        __m256 lox = _mm256_set1_ps(FLT_MAX), loy = lox;
+        __m256 hix = _mm256_set1_ps(-FLT_MAX), hiy = hix;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 l = _mm256_sub_ps(_mm256_loadu_ps(pl + i), vdt);
+            __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(pvx + i), vgx), vdamp);
+            __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(pvy + i), vgy), vdamp);
+            __m256 nx = _mm256_add_ps(_mm256_loadu_ps(px + i), _mm256_mul_ps(u, vdt));
+            __m256 ny = _mm256_add_ps(_mm256_loadu_ps(py + i), _mm256_mul_ps(v, vdt));
+            __m256 r = _mm256_add_ps(_mm256_loadu_ps(prot + i), _mm256_mul_ps(_mm256_loadu_ps(pspin + i), vdt));
+            __m256 s = _mm256_add_ps(vend, _mm256_mul_ps(vrange, _mm256_mul_ps(l, _mm256_loadu_ps(pinv + i))));
+            _mm256_storeu_ps(pl + i, l);
+            _mm256_storeu_ps(pvx + i, u);
+            _mm256_storeu_ps(pvy + i, v);
+            _mm256_storeu_ps(px + i, nx);
+            _mm256_storeu_ps(py + i, ny);
+            _mm256_storeu_ps(prot + i, r);
+            _mm256_storeu_ps(psize + i, s);
+            lox = _mm256_min_ps(lox, nx);
+            loy = _mm256_min_ps(loy, ny);
+            hix = _mm256_max_ps(hix, nx);
+            hiy = _mm256_max_ps(hiy, ny);
+        }
+        float a[8], b[8], c[8], d[8];
+        _mm256_storeu_ps(a, lox);
+        _mm256_storeu_ps(b, loy);
+        _mm256_storeu_ps(c, hix);
+        _mm256_storeu_ps(d, hiy);
+        for (int k = 0; k < 8; k++)
+        {
+            minX = std::min(minX, a[k]);
+            minY = std::min(minY, b[k]);
+            maxX = std::max(maxX, c[k]);
+            maxY = std::max(maxY, d[k]);
+        }
+    }
+#elif defined(PARTICLES_SSE)
+    {
+        const __m128 vdt = _mm_set1_ps(dt);
+        const __m128 vgx = _mm_set1_ps(gx);
+        const __m128 vgy = _mm_set1_ps(gy);
+        const __m128 vdamp = _mm_set1_ps(damp);
+        const __m128 vend = _mm_set1_ps(sizeEnd);
+        const __m128 vrange = _mm_set1_ps(sizeRange);
+        __m128 lox = _mm_set1_ps(FLT_MAX), loy = lox;
+        __m128 hix = _mm_set1_ps(-FLT_MAX), hiy = hix;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 l = _mm_sub_ps(_mm_loadu_ps(pl + i), vdt);
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(pvx + i), vgx), vdamp);
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(pvy + i), vgy), vdamp);
+            __m128 nx = _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(u, vdt));
+            __m128 ny = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(v, vdt));
+            __m128 r = _mm_add_ps(_mm_loadu_ps(prot + i), _mm_mul_ps(_mm_loadu_ps(pspin + i), vdt));
+            __m128 s = _mm_add_ps(vend, _mm_mul_ps(vrange, _mm_mul_ps(l, _mm_loadu_ps(pinv + i))));
+            _mm_storeu_ps(pl + i, l);
+            _mm_storeu_ps(pvx + i, u);
+            _mm_storeu_ps(pvy + i, v);
+            _mm_storeu_ps(px + i, nx);
+            _mm_storeu_ps(py + i, ny);
+            _mm_storeu_ps(prot + i, r);
+            _mm_storeu_ps(psize + i, s);
+            lox = _mm_min_ps(lox, nx);
+            loy = _mm_min_ps(loy, ny);
+            hix = _mm_max_ps(hix, nx);
+            hiy = _mm_max_ps(hiy, ny);
+        }
+        float a[4], b[4], c[4], d[4];
+        _mm_storeu_ps(a, lox);
+        _mm_storeu_ps(b, loy);
+        _mm_storeu_ps(c, hix);
+        _mm_storeu_ps(d, hiy);
+        for (int k = 0; k < 4; k++)
+        {
+            minX = std::min(minX, a[k]);
+            minY = std::min(minY, b[k]);
+            maxX = std::max(maxX, c[k]);
+            maxY = std::max(maxY, d[k]);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        pl[i] -= dt;
+        pvx[i] = (pvx[i] + gx) * damp;
+        pvy[i] = (pvy[i] + gy) * damp;
+        px[i] += pvx[i] * dt;
+        py[i] += pvy[i] * dt;
+        prot[i] += pspin[i] * dt;
+        psize[i] = sizeEnd + sizeRange * pl[i] * pinv[i];
+        minX = std::min(minX, px[i]);
+        minY = std::min(minY, py[i]);
+        maxX = std::max(maxX, px[i]);
+        maxY = std::max(maxY, py[i]);
+    }
+
+    // dead ones out, the last live particle takes the slot
+    for (int j = 0; j < count;)
+    {
+        if (pl[j] > 0)
+        {
+            j++;
+            continue;
+        }
+        int last = --count;
+        px[j] = px[last];
+        py[j] = py[last];
+        pvx[j] = pvx[last];
+        pvy[j] = pvy[last];
+        pl[j] = pl[last];
+        invLife[j] = invLife[last];
+        psize[j] = psize[last];
+        prot[j] = prot[last];
+        spin[j] = spin[last];
+    }
+
+    if (count == 0)
+    {
+        bounds = {origin.x, origin.y, 0, 0};
+        return;
+    }
+    // half diagonal of the biggest quad
+    float pad = std::max(emitter.sizeStart, emitter.sizeEnd) * 0.75f;
+    if (graph && emitter.frames > 0)
+        pad *= std::max(1.0f, (float)graph->height * emitter.frames / std::max(graph->width, 1));
+    bounds = {minX - pad, minY - pad, maxX - minX + pad * 2, maxY - minY + pad * 2};
+}
+
+void ParticleSystemComponent::OnDraw()
+{
+    if (!graph || count == 0)
+        return;
+
+    const int frames = std::max(emitter.frames, 1);
+    const float frameU = 1.0f / frames;
+    const float aspect = (float)graph->height * frames / std::max(graph->width, 1);
+    const bool rotate = emitter.spinMin != 0 || emitter.spinMax != 0;
+    const Color a = emitter.colorStart;
+    const Color b = emitter.colorEnd;
+    const unsigned int texture = graph->texture.id;
+
+    const bool blend = emitter.blend != BLEND_ALPHA;
+    if (blend)
+        BeginBlendMode(emitter.blend);
+
+    const int BATCH = 1024;
+    for (int start = 0; start < count; start += BATCH)
+    {
+        int end = std::min(count, start + BATCH);
+        rlCheckRenderBatchLimit(4 * (end - start));
+        rlSetTexture(texture);
+        rlBegin(RL_QUADS);
+        rlNormal3f(0.0f, 0.0f, 1.0f);
+        for (int i = start; i < end; i++)
+        {
+            // t goes from 1 (born) to 0 (dead)
+            float t = Clamp(life[i] * invLife[i], 0.0f, 1.0f);
+            rlColor4ub((unsigned char)(b.r + (a.r - b.r) * t),
+                       (unsigned char)(b.g + (a.g - b.g) * t),
+                       (unsigned char)(b.b + (a.b - b.b) * t),
+                       (unsigned char)(b.a + (a.a - b.a) * t));
+            int frame = std::min((int)((1.0f - t) * frames), frames - 1);
+            float u0 = frame * frameU;
+            float u1 = u0 + frameU;
+
+            float hw = size[i] * 0.5f;
+            float hh = hw * aspect;
+            float cx = x[i];
+            float cy = y[i];
+            if (!rotate)
+            {
+                rlTexCoord2f(u0, 0.0f);
+                rlVertex2f(cx - hw, cy - hh);
+                rlTexCoord2f(u0, 1.0f);
+                rlVertex2f(cx - hw, cy + hh);
+                rlTexCoord2f(u1, 1.0f);
+                rlVertex2f(cx + hw, cy + hh);
+                rlTexCoord2f(u1, 0.0f);
+                rlVertex2f(cx + hw, cy - hh);
+                continue;
+            }
+
+            float cs = cosf(rotation[i] * DEG2RAD);
+            float sn = sinf(rotation[i] * DEG2RAD);
+            rlTexCoord2f(u0, 0.0f);
+            rlVertex2f(cx - hw * cs + hh * sn, cy - hw * sn - hh * cs);
+            rlTexCoord2f(u0, 1.0f);
+            rlVertex2f(cx - hw * cs - hh * sn, cy - hw * sn + hh * cs);
+            rlTexCoord2f(u1, 1.0f);
+            rlVertex2f(cx + hw * cs - hh * sn, cy + hw * sn + hh * cs);
+            rlTexCoord2f(u1, 0.0f);
+            rlVertex2f(cx + hw * cs + hh * sn, cy + hw * sn - hh * cs);
+        }
+        rlEnd();
+    }
+
+    if (blend)
+        EndBlendMode();
+}
+
+void ParticleSystemComponent::OnDebug()
+{
+    DrawRectangleLines((int)bounds.x, (int)bounds.y, (int)bounds.width, (int)bounds.height, RED);
+}
+
+//*********************************************************************************************************************
+//**                         ParticleSystem                                                                          **
+//*********************************************************************************************************************
+
+ParticleSystem::ParticleSystem() : next(0), delta(0)
+{
+}
+
+ParticleSystem::~ParticleSystem()
+{
+    setThreads(1);
+}
+
+int ParticleSystem::add(ParticleSystemComponent *system)
+{
+    systems.push_back(system);
+    return (int)systems.size() - 1;
+}
+
+void ParticleSystem::remove(int slot)
+{
+    if (slot < 0 || slot >= (int)systems.size())
+        return;
+    systems[slot] = systems.back();
+    systems[slot]->slot = slot;
+    systems.pop_back();
+}
+
+int ParticleSystem::getCount() const
+{
+    int total = 0;
+    for (auto system : systems)
+    {
+        total += system->count;
+    }
+    return total;
+}
+
+void ParticleSystem::setThreads(int count)
+{
+    pool.setThreads(count);
+}
+
+void ParticleSystem::run()
+{
+    for (int i = next++; i < (int)systems.size(); i = next++)
+    {
+        systems[i]->simulate(delta);
+    }
+}
+
+void ParticleSystem::update(float deltaTime)
+{
+    if (systems.empty())
+        return;
+
+    delta = deltaTime;
+    next = 0;
+    if (pool.getThreads() == 1 || systems.size() < 2)
+        run();
+    else
+        pool.run([this](int)
+                 { run(); });
+
+    // the scene culls by the object bound
+    for (auto system : systems)
+    {
+        if (system->object)
+            system->object->bound = system->bounds;
+    }
+}
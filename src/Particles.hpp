@@ -0,0 +1,129 @@
+#pragma once
+#include "Engine.hpp"
+#include <atomic>
+
+//*********************************************************************************************************************
+//**                         Particles                                                                               **
+//*********************************************************************************************************************
+
+// Particles are plain SoA arrays owned by a ParticleSystemComponent, not GameObjects.
+// The ParticleSystem steps every emitter once per frame (SSE/AVX kernel, scalar fallback,
+// PARTICLES_NO_SIMD forces the scalar path) and the component writes the live ones straight to the batch.
+
+enum EmitterShape
+{
+    ShapePoint,
+    ShapeCircle,    // inside a circle of radius width
+    ShapeRing,      // on a circle of radius width
+    ShapeRectangle  // inside width x height
+};
+
+// emitter settings, min/max ranges are picked per particle
+struct ParticleEmitter
+{
+    ParticleEmitter();
+
+    EmitterShape shape;
+    float width;
+    float height;
+    float rate; // particles per second while emitting
+    float lifeMin;
+    float lifeMax;
+    float speedMin;
+    float speedMax;
+    float angleMin; // direction, degrees
+    float angleMax;
+    float spinMin; // degrees per second, 0/0 = no rotation
+    float spinMax;
+    float sizeStart; // pixels
+    float sizeEnd;
+    Color colorStart;
+    Color colorEnd;
+    Vector2 gravity; // pixels per second^2
+    float damping;   // velocity kept after one second (1 = no drag)
+    int frames;      // horizontal strip played over the life
+    int blend;       // raylib BlendMode
+};
+
+class ParticleSystemComponent : public Component
+{
+public:
+    ParticleSystemComponent(int graphID, int capacity);
+    ParticleSystemComponent(const std::string &fileName, int capacity);
+    ParticleSystemComponent(GraphKey key, int capacity);
+    ~ParticleSystemComponent();
+
+    ParticleEmitter emitter;
+    GraphHandle graph;
+    int graphID;
+    bool emitting;
+
+    void OnInit() override;
+    void OnUpdate(float deltaTime) override;
+    void OnDraw() override;
+    void OnDebug() override;
+
+    // emitted on the next step
+    void burst(int count) { pending += count; }
+    void clear() { count = 0; }
+    int getCount() const { return count; }
+    int getCapacity() const { return capacity; }
+
+    // one step of the particles, called by the ParticleSystem (maybe on a worker thread)
+    void simulate(float deltaTime);
+
+private:
+    friend class ParticleSystem;
+
+    void spawn(int amount);
+    float random(float min, float max);
+
+    // SoA, capacity entries each
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> life;
+    std::vector<float> invLife;
+    std::vector<float> size;
+    std::vector<float> rotation;
+    std::vector<float> spin;
+    int count;
+    int capacity;
+    int pending;
+    float accumulator;
+    uint32_t seed;
+    Vector2 origin;   // emitter position, copied on the main thread
+    Rectangle bounds; // live particles, world
+    int slot;
+};
+
+class ParticleSystem
+{
+public:
+    static ParticleSystem &Instance()
+    {
+        static ParticleSystem instance;
+        return instance;
+    }
+    ~ParticleSystem();
+
+    int add(ParticleSystemComponent *system);
+    void remove(int slot);
+
+    // steps every emitter, split over the worker threads when there are any
+    void update(float deltaTime);
+    // 1 = main thread only
+    void setThreads(int count);
+    int getCount() const;
+
+private:
+    ParticleSystem();
+
+    void run();
+
+    std::vector<ParticleSystemComponent *> systems;
+    WorkerPool pool;
+    std::atomic<int> next;
+    float delta;
+};
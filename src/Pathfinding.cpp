@@ -0,0 +1,948 @@
+#include "Pathfinding.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+//*********************************************************************************************************************
+//**                         NavGrid                                                                                 **
+//*********************************************************************************************************************
+
+NavGrid::NavGrid()
+    : cacheSize(256), width(0), height(0), regionSize(16), regionColumns(0), regionRows(0), origin{0, 0},
+      tileWidth(1), tileHeight(1), weighted(0), version(0), layer(nullptr), useCount(0)
+{
+}
+
+NavGrid::~NavGrid()
+{
+    detach();
+    PathFinder::Instance().cancel(this);
+}
+
+void NavGrid::build(TileLayerComponent *layer, int regionSize)
+{
+    detach();
+    if (!layer)
+        return;
+    this->layer = layer;
+    this->regionSize = std::max(1, regionSize);
+    layer->navGrid = this;
+    refresh();
+}
+
+void NavGrid::detach()
+{
+    if (layer && layer->navGrid == this)
+        layer->navGrid = nullptr;
+    layer = nullptr;
+}
+
+void NavGrid::refresh()
+{
+    version++;
+    cache.clear();
+    if (!layer)
+        return;
+
+    width = layer->width;
+    height = layer->height;
+    origin = layer->offset;
+    tileWidth = (float)std::max(1, layer->tileWidth);
+    tileHeight = (float)std::max(1, layer->tileHeight);
+    regionColumns = (width + regionSize - 1) / regionSize;
+    regionRows = (height + regionSize - 1) / regionSize;
+    weighted = 0;
+    cost.assign((size_t)width * height, 1);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (layer->getTile(x, y) >= 1)
+                cost[y * width + x] = 0;
+        }
+    }
+}
+
+void NavGrid::onTile(int x, int y, int tile)
+{
+    setCost(x, y, tile >= 1 ? 0 : 1);
+}
+
+void NavGrid::setCost(int x, int y, unsigned char value)
+{
+    if (!isInside(x, y))
+        return;
+    unsigned char &cell = cost[y * width + x];
+    if (cell == value)
+        return;
+    if (cell > 1)
+        weighted--;
+    if (value > 1)
+        weighted++;
+    bool cheaper = value != 0 && (cell == 0 || value < cell);
+    cell = value;
+    changed(x, y, cheaper);
+}
+
+void NavGrid::changed(int x, int y, bool cheaper)
+{
+    version++;
+
+    // a cell that opens or gets cheaper can shorten a path anywhere
+    if (cheaper)
+    {
+        cache.clear();
+        return;
+    }
+
+    // a dearer cell only matters to the paths through it, their regions are enough
+    int rx = x / regionSize;
+    int ry = y / regionSize;
+    for (auto it = cache.begin(); it != cache.end();)
+    {
+        const CachedPath &path = it->second;
+        if (rx >= path.minX - 1 && rx <= path.maxX + 1 && ry >= path.minY - 1 && ry <= path.maxY + 1)
+            it = cache.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool NavGrid::toCell(Vector2 point, int &x, int &y) const
+{
+    x = (int)floorf((point.x - origin.x) / tileWidth);
+    y = (int)floorf((point.y - origin.y) / tileHeight);
+    return isInside(x, y);
+}
+
+Vector2 NavGrid::toWorld(int x, int y) const
+{
+    return {origin.x + (x + 0.5f) * tileWidth, origin.y + (y + 0.5f) * tileHeight};
+}
+
+bool NavGrid::findCached(int start, int goal, std::vector<int> &cells)
+{
+    auto it = cache.find(((unsigned long long)cellRegion(start) << 32) | (unsigned int)cellRegion(goal));
+    if (it == cache.end() || it->second.goal != goal)
+        return false;
+
+    // the rest of an optimal path is optimal too
+    const std::vector<int> &path = it->second.cells;
+    auto at = std::find(path.begin(), path.end(), start);
+    if (at == path.end())
+        return false;
+    cells.assign(at, path.end());
+    it->second.used = ++useCount;
+    return true;
+}
+
+void NavGrid::storeCached(int start, int goal, const std::vector<int> &cells)
+{
+    if (cacheSize == 0 || cells.empty())
+        return;
+
+    unsigned long long key = ((unsigned long long)cellRegion(start) << 32) | (unsigned int)cellRegion(goal);
+    if (cache.size() >= cacheSize && cache.find(key) == cache.end())
+    {
+        auto oldest = cache.begin();
+        for (auto it = cache.begin(); it != cache.end(); ++it)
+        {
+            if (it->second.used < oldest->second.used)
+                oldest = it;
+        }
+        cache.erase(oldest);
+    }
+
+    CachedPath &path = cache[key];
+    path.goal = goal;
+    path.used = ++useCount;
+    path.cells = cells;
+    path.minX = path.minY = INT_MAX;
+    path.maxX = path.maxY = INT_MIN;
+    for (int cell : cells)
+    {
+        int rx = (cell % width) / regionSize;
+        int ry = (cell / width) / regionSize;
+        path.minX = std::min(path.minX, rx);
+        path.minY = std::min(path.minY, ry);
+        path.maxX = std::max(path.maxX, rx);
+        path.maxY = std::max(path.maxY, ry);
+    }
+}
+
+//*********************************************************************************************************************
+//**                         PathFinder                                                                              **
+//*********************************************************************************************************************
+
+static const float SQRT2 = 1.41421356f;
+static const int DIRECTION_X[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+static const int DIRECTION_Y[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+
+static int Sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+static float Octile(int dx, int dy)
+{
+    dx = abs(dx);
+    dy = abs(dy);
+    return (float)(dx + dy) + (SQRT2 - 2.0f) * (float)std::min(dx, dy);
+}
+
+static void CellsToPoints(const NavGrid &grid, const std::vector<int> &cells, std::vector<Vector2> &points)
+{
+    points.clear();
+    points.reserve(cells.size());
+    for (int cell : cells)
+    {
+        points.push_back(grid.toWorld(cell % grid.width, cell / grid.width));
+    }
+}
+
+PathFinder::PathFinder() : budget(4000), searching(false), nextID(1), expanded(0)
+{
+    current.id = 0;
+    current.grid = nullptr;
+    current.start = current.goal = -1;
+    current.mode = PathMode::JPS;
+}
+
+void PathFinder::Search::begin(NavGrid *grid, int start, int goal, PathMode mode)
+{
+    this->grid = grid;
+    this->start = start;
+    this->goal = goal;
+    goalX = goal % grid->width;
+    goalY = goal / grid->width;
+    jump = mode == PathMode::JPS && grid->weighted == 0;
+    version = grid->version;
+
+    size_t count = (size_t)grid->width * grid->height;
+    if (g.size() < count)
+    {
+        g.resize(count);
+        parent.resize(count);
+        seen.resize(count, 0);
+        closed.resize(count, 0);
+    }
+    if (++stamp == 0)
+    {
+        std::fill(seen.begin(), seen.end(), 0);
+        std::fill(closed.begin(), closed.end(), 0);
+        stamp = 1;
+    }
+    heap.clear();
+    open(start, -1, 0);
+}
+
+float PathFinder::Search::heuristic(int x, int y) const
+{
+    return Octile(x - goalX, y - goalY);
+}
+
+void PathFinder::Search::open(int cell, int from, float cost)
+{
+    if (closed[cell] == stamp || (seen[cell] == stamp && g[cell] <= cost))
+        return;
+    seen[cell] = stamp;
+    g[cell] = cost;
+    parent[cell] = from;
+    heap.push_back({cost + heuristic(cell % grid->width, cell / grid->width), cell});
+    std::push_heap(heap.begin(), heap.end());
+}
+
+int PathFinder::Search::step(int &budget, int &expanded)
+{
+    while (!heap.empty())
+    {
+        if (budget <= 0)
+            return 0;
+        int cell = heap.front().cell;
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        if (closed[cell] == stamp)
+            continue; // stale entry, reached again cheaper
+        closed[cell] = stamp;
+        budget--;
+        expanded++;
+        if (cell == goal)
+            return 1;
+
+        int x = cell % grid->width;
+        int y = cell / grid->width;
+        if (jump)
+            expandJump(cell, x, y);
+        else
+            expandStar(cell, x, y);
+    }
+    return -1;
+}
+
+void PathFinder::Search::expandStar(int cell, int x, int y)
+{
+    const NavGrid &nav = *grid;
+    for (int i = 0; i < 8; i++)
+    {
+        int dx = DIRECTION_X[i];
+        int dy = DIRECTION_Y[i];
+        if (!nav.isWalkable(x + dx, y + dy))
+            continue;
+        if (i >= 4 && (!nav.isWalkable(x + dx, y) || !nav.isWalkable(x, y + dy)))
+            continue; // no corner cutting
+        int next = cell + dy * nav.width + dx;
+        float move = (i >= 4 ? SQRT2 : 1.0f) * nav.cost[next];
+        open(next, cell, g[cell] + move);
+    }
+}
+
+// next jump point from (x, y) moving (dx, dy), entered from (x - dx, y - dy), -1 = none
+int PathFinder::Search::jumpFrom(int x, int y, int dx, int dy) const
+{
+    const NavGrid &nav = *grid;
+    for (;;)
+    {
+        if (!nav.isWalkable(x, y))
+            return -1;
+        if (dx && dy && (!nav.isWalkable(x - dx, y) || !nav.isWalkable(x, y - dy)))
+            return -1;
+
+        int cell = y * nav.width + x;
+        if (cell == goal)
+            return cell;
+
+        if (dx && dy)
+        {
+            if (jumpFrom(x + dx, y, dx, 0) >= 0 || jumpFrom(x, y + dy, 0, dy) >= 0)
+                return cell;
+        }
+        else if (dx)
+        {
+            // a wall behind a side opening forces a turn here
+            if ((nav.isWalkable(x, y - 1) && !nav.isWalkable(x - dx, y - 1)) ||
+                (nav.isWalkable(x, y + 1) && !nav.isWalkable(x - dx, y + 1)))
+                return cell;
+        }
+        else
+        {
+            if ((nav.isWalkable(x - 1, y) && !nav.isWalkable(x - 1, y - dy)) ||
+                (nav.isWalkable(x + 1, y) && !nav.isWalkable(x + 1, y - dy)))
+                return cell;
+        }
+        x += dx;
+        y += dy;
+    }
+}
+
+void PathFinder::Search::expandJump(int cell, int x, int y)
+{
+    int directions[8][2];
+    int count = 0;
+    int from = parent[cell];
+    if (from < 0)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            directions[count][0] = DIRECTION_X[i];
+            directions[count++][1] = DIRECTION_Y[i];
+        }
+    }
+    else
+    {
+        // pruned neighbours, without corner cutting a side cell is only reached by a straight step
+        int dx = Sign(x - from % grid->width);
+        int dy = Sign(y - from / grid->width);
+        if (dx && dy)
+        {
+            const int list[3][2] = {{0, dy}, {dx, 0}, {dx, dy}};
+            for (int i = 0; i < 3; i++)
+            {
+                directions[count][0] = list[i][0];
+                directions[count++][1] = list[i][1];
+            }
+        }
+        else if (dx)
+        {
+            const int list[5][2] = {{dx, 0}, {0, 1}, {0, -1}, {dx, 1}, {dx, -1}};
+            for (int i = 0; i < 5; i++)
+            {
+                directions[count][0] = list[i][0];
+                directions[count++][1] = list[i][1];
+            }
+        }
+        else
+        {
+            const int list[5][2] = {{0, dy}, {1, 0}, {-1, 0}, {1, dy}, {-1, dy}};
+            for (int i = 0; i < 5; i++)
+            {
+                directions[count][0] = list[i][0];
+                directions[count++][1] = list[i][1];
+            }
+        }
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int dx = directions[i][0];
+        int dy = directions[i][1];
+        int point = jumpFrom(x + dx, y + dy, dx, dy);
+        if (point < 0)
+            continue;
+        int px = point % grid->width;
+        int py = point / grid->width;
+        open(point, cell, g[cell] + Octile(px - x, py - y));
+    }
+}
+
+void PathFinder::Search::cells(std::vector<int> &out) const
+{
+    out.clear();
+    for (int cell = goal; cell >= 0; cell = parent[cell])
+    {
+        out.push_back(cell);
+    }
+    std::reverse(out.begin(), out.end());
+    if (!jump || out.size() < 2)
+        return;
+
+    // jump points -> every cell between them, the segments are straight or diagonal
+    std::vector<int> points;
+    points.swap(out);
+    int width = grid->width;
+    out.push_back(points[0]);
+    for (size_t i = 1; i < points.size(); i++)
+    {
+        int x = points[i - 1] % width;
+        int y = points[i - 1] / width;
+        int dx = Sign(points[i] % width - x);
+        int dy = Sign(points[i] / width - y);
+        while (y * width + x != points[i])
+        {
+            x += dx;
+            y += dy;
+            out.push_back(y * width + x);
+        }
+    }
+}
+
+bool PathFinder::resolve(NavGrid &grid, int start, int goal, std::vector<Vector2> &path)
+{
+    if (!grid.findCached(start, goal, cellPath))
+        return false;
+    CellsToPoints(grid, cellPath, path);
+    return true;
+}
+
+bool PathFinder::findPath(NavGrid &grid, int startX, int startY, int goalX, int goalY, std::vector<Vector2> &path, PathMode mode)
+{
+    path.clear();
+    expanded = 0;
+    if (!grid.isWalkable(startX, startY) || !grid.isWalkable(goalX, goalY))
+        return false;
+
+    int start = startY * grid.width + startX;
+    int goal = goalY * grid.width + goalX;
+    if (resolve(grid, start, goal, path))
+        return true;
+
+    int left = INT_MAX;
+    now.begin(&grid, start, goal, mode);
+    if (now.step(left, expanded) != 1)
+        return false;
+    now.cells(cellPath);
+    grid.storeCached(start, goal, cellPath);
+    CellsToPoints(grid, cellPath, path);
+    return true;
+}
+
+bool PathFinder::findPath(NavGrid &grid, Vector2 from, Vector2 to, std::vector<Vector2> &path, PathMode mode)
+{
+    int startX, startY, goalX, goalY;
+    if (!grid.toCell(from, startX, startY) || !grid.toCell(to, goalX, goalY))
+    {
+        path.clear();
+        return false;
+    }
+    return findPath(grid, startX, startY, goalX, goalY, path, mode);
+}
+
+unsigned int PathFinder::request(NavGrid *grid, Vector2 from, Vector2 to, Callback done, PathMode mode)
+{
+    if (!grid)
+    {
+        Log(LOG_ERROR, "PathFinder::request without a grid");
+        return 0;
+    }
+
+    Request request;
+    request.id = nextID++;
+    request.grid = grid;
+    request.start = -1;
+    request.goal = -1;
+    request.mode = mode;
+    request.done = done;
+
+    // blocked ends fail on the next update without a search
+    int x, y;
+    if (grid->toCell(from, x, y) && grid->isWalkable(x, y))
+        request.start = y * grid->width + x;
+    if (grid->toCell(to, x, y) && grid->isWalkable(x, y))
+        request.goal = y * grid->width + x;
+    queue.push_back(request);
+    return request.id;
+}
+
+void PathFinder::cancel(unsigned int id)
+{
+    if (searching && current.id == id)
+    {
+        searching = false;
+        return;
+    }
+    for (auto it = queue.begin(); it != queue.end(); ++it)
+    {
+        if (it->id == id)
+        {
+            queue.erase(it);
+            return;
+        }
+    }
+}
+
+void PathFinder::cancel(NavGrid *grid)
+{
+    if (searching && current.grid == grid)
+        searching = false;
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [grid](const Request &request)
+                               { return request.grid == grid; }),
+                queue.end());
+}
+
+void PathFinder::clear()
+{
+    queue.clear();
+    searching = false;
+}
+
+void PathFinder::finish(const Request &request, bool found)
+{
+    if (found)
+        CellsToPoints(*request.grid, cellPath, points);
+    else
+        points.clear();
+    if (request.done)
+        request.done(request.id, found, points);
+}
+
+void PathFinder::update()
+{
+    expanded = 0;
+    int left = budget;
+    while (left > 0)
+    {
+        if (!searching)
+        {
+            if (queue.empty())
+                return;
+            current = queue.front();
+            queue.pop_front();
+            if (current.start < 0 || current.goal < 0)
+            {
+                finish(current, false);
+                continue;
+            }
+            if (current.grid->findCached(current.start, current.goal, cellPath))
+            {
+                left--;
+                finish(current, true);
+                continue;
+            }
+            queued.begin(current.grid, current.start, current.goal, current.mode);
+            searching = true;
+        }
+
+        // the grid changed under a sliced search, start over
+        if (queued.version != current.grid->version)
+        {
+            NavGrid &grid = *current.grid;
+            if (!grid.isWalkable(current.start % grid.width, current.start / grid.width) ||
+                !grid.isWalkable(current.goal % grid.width, current.goal / grid.width))
+            {
+                searching = false;
+                Request request = current;
+                finish(request, false);
+                continue;
+            }
+            queued.begin(current.grid, current.start, current.goal, current.mode);
+        }
+
+        int result = queued.step(left, expanded);
+        if (result == 0)
+            return;
+        searching = false;
+        if (result > 0)
+        {
+            queued.cells(cellPath);
+            current.grid->storeCached(current.start, current.goal, cellPath);
+        }
+        Request request = current;
+        finish(request, result > 0);
+    }
+}
+
+//*********************************************************************************************************************
+//**                         FlowField                                                                               **
+//*********************************************************************************************************************
+
+static const float FLOW_FAR = FLT_MAX;
+
+FlowField::FlowField()
+    : grid(nullptr), gridVersion(0), width(0), height(0), goal(-1), nextGoal(-1), seedGoal(false), offset(0),
+      walked(0), relaxing(false), next(0)
+{
+    heaps.resize(1);
+}
+
+FlowField::~FlowField()
+{
+    setThreads(1);
+}
+
+void FlowField::setGrid(NavGrid *grid)
+{
+    this->grid = grid;
+    goal = -1;
+    nextGoal = -1;
+    width = height = 0; // rebuilt by the next update
+}
+
+bool FlowField::setGoal(Vector2 point)
+{
+    int x, y;
+    if (!grid || !grid->toCell(point, x, y))
+        return false;
+    return setGoal(x, y);
+}
+
+bool FlowField::setGoal(int x, int y)
+{
+    if (!grid || !grid->isWalkable(x, y))
+        return false;
+    nextGoal = y * grid->width + x;
+    return true;
+}
+
+void FlowField::setThreads(int count)
+{
+    pool.setThreads(count);
+    heaps.resize(std::max(1, count));
+}
+
+void FlowField::run(int index)
+{
+    std::vector<Item> &heap = heaps[index];
+    for (int i = next++; i < (int)jobs.size(); i = next++)
+    {
+        if (relaxing)
+            relax(jobs[i], heap);
+        else
+            directions(jobs[i]);
+    }
+}
+
+void FlowField::dispatch(bool relaxing)
+{
+    this->relaxing = relaxing;
+    next = 0;
+    if (pool.getThreads() == 1 || jobs.size() < 2)
+        run(0);
+    else
+        pool.run([this](int index)
+                 { run(index); });
+}
+
+// from (x, y) to the next cell, FLOW_FAR when the move is not allowed
+float FlowField::moveCost(int x, int y, int dx, int dy) const
+{
+    const NavGrid &nav = *grid;
+    if (!nav.isWalkable(x + dx, y + dy))
+        return FLOW_FAR;
+    if (dx && dy)
+    {
+        if (!nav.isWalkable(x + dx, y) || !nav.isWalkable(x, y + dy))
+            return FLOW_FAR;
+        return SQRT2 * nav.cost[(y + dy) * width + x + dx];
+    }
+    return nav.cost[(y + dy) * width + x + dx];
+}
+
+void FlowField::reset()
+{
+    width = grid->width;
+    height = grid->height;
+    gridVersion = grid->version;
+    offset = 0;
+    size_t regions = (size_t)grid->regionColumns * grid->regionRows;
+    distance.assign((size_t)width * height, FLOW_FAR);
+    direction.assign((size_t)width * height, 255);
+    active.assign(regions, 0);
+    wake.assign(regions, 0);
+    touched.assign(regions, 1); // every direction is redone
+}
+
+void FlowField::relax(int region, std::vector<Item> &heap)
+{
+    const NavGrid &nav = *grid;
+    int size = nav.regionSize;
+    int x0 = (region % nav.regionColumns) * size;
+    int y0 = (region / nav.regionColumns) * size;
+    int x1 = std::min(width, x0 + size);
+    int y1 = std::min(height, y0 + size);
+    heap.clear();
+    wake[region] = 0;
+
+    if (seedGoal && goal % width >= x0 && goal % width < x1 && goal / width >= y0 && goal / width < y1)
+        heap.push_back({distance[goal], goal});
+
+    // pull across the border from the neighbour regions
+    for (int y = y0; y < y1; y++)
+    {
+        int stride = (y == y0 || y == y1 - 1) ? 1 : std::max(1, x1 - 1 - x0);
+        for (int x = x0; x < x1; x += stride)
+        {
+            if (!nav.isWalkable(x, y))
+                continue;
+            int cell = y * width + x;
+            float best = distance[cell];
+            for (int i = 0; i < 8; i++)
+            {
+                int nx = x + DIRECTION_X[i];
+                int ny = y + DIRECTION_Y[i];
+                if (nx >= x0 && nx < x1 && ny >= y0 && ny < y1)
+                    continue;
+                float move = moveCost(x, y, DIRECTION_X[i], DIRECTION_Y[i]);
+                if (move < FLOW_FAR && distance[ny * width + nx] < FLOW_FAR)
+                    best = std::min(best, distance[ny * width + nx] + move);
+            }
+            if (best < distance[cell])
+            {
+                distance[cell] = best;
+                heap.push_back({best, cell});
+            }
+        }
+    }
+    if (heap.empty())
+        return;
+    std::make_heap(heap.begin(), heap.end());
+    touched[region] = 1;
+
+    // dijkstra inside the region, neighbours that would get shorter are woken for the next pass
+    unsigned short bits = 0;
+    while (!heap.empty())
+    {
+        Item top = heap.front();
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        if (top.distance > distance[top.cell])
+            continue;
+        int x = top.cell % width;
+        int y = top.cell / width;
+        for (int i = 0; i < 8; i++)
+        {
+            int nx = x + DIRECTION_X[i];
+            int ny = y + DIRECTION_Y[i];
+            if (!nav.isWalkable(nx, ny))
+                continue;
+            // the move from the neighbour to here
+            float move = moveCost(nx, ny, -DIRECTION_X[i], -DIRECTION_Y[i]);
+            float value = top.distance + move;
+            int cell = ny * width + nx;
+            if (move >= FLOW_FAR || value >= distance[cell])
+                continue;
+            if (nx < x0 || nx >= x1 || ny < y0 || ny >= y1)
+            {
+                int dx = nx < x0 ? -1 : (nx >= x1 ? 1 : 0);
+                int dy = ny < y0 ? -1 : (ny >= y1 ? 1 : 0);
+                bits |= 1 << ((dy + 1) * 3 + dx + 1);
+                continue;
+            }
+            distance[cell] = value;
+            heap.push_back({value, cell});
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+    wake[region] = bits;
+}
+
+void FlowField::directions(int region)
+{
+    const NavGrid &nav = *grid;
+    int size = nav.regionSize;
+    int x0 = (region % nav.regionColumns) * size;
+    int y0 = (region / nav.regionColumns) * size;
+    int x1 = std::min(width, x0 + size);
+    int y1 = std::min(height, y0 + size);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            int cell = y * width + x;
+            unsigned char way = 255;
+            if (cell != goal && distance[cell] < FLOW_FAR)
+            {
+                float best = FLOW_FAR;
+                for (int i = 0; i < 8; i++)
+                {
+                    float move = moveCost(x, y, DIRECTION_X[i], DIRECTION_Y[i]);
+                    if (move >= FLOW_FAR)
+                        continue;
+                    float value = distance[(y + DIRECTION_Y[i]) * width + x + DIRECTION_X[i]];
+                    if (value < FLOW_FAR && value + move < best)
+                    {
+                        best = value + move;
+                        way = (unsigned char)i;
+                    }
+                }
+            }
+            direction[cell] = way;
+        }
+    }
+}
+
+void FlowField::update()
+{
+    walked = 0;
+    if (!grid)
+        return;
+
+    bool full = grid->version != gridVersion || grid->width != width || grid->height != height;
+    if (nextGoal >= (int)grid->cost.size() || (nextGoal >= 0 && grid->cost[nextGoal] == 0))
+        nextGoal = -1; // the grid changed under it
+    if (nextGoal < 0)
+    {
+        if (full)
+        {
+            reset();
+            goal = -1;
+        }
+        return;
+    }
+    if (nextGoal == goal && !full)
+        return;
+
+    // a step to a next cell keeps the field, every distance gets the step longer
+    float move = FLOW_FAR;
+    if (!full && goal >= 0 && offset < 4096.0f)
+    {
+        int dx = nextGoal % width - goal % width;
+        int dy = nextGoal / width - goal / width;
+        if (abs(dx) <= 1 && abs(dy) <= 1)
+            move = moveCost(goal % width, goal / width, dx, dy);
+    }
+    if (move < FLOW_FAR)
+        offset += move;
+    else
+        reset();
+
+    goal = nextGoal;
+    distance[goal] = -offset;
+    seedGoal = true;
+
+    const NavGrid &nav = *grid;
+    int columns = nav.regionColumns;
+    int rows = nav.regionRows;
+    active[(goal / width / nav.regionSize) * columns + (goal % width) / nav.regionSize] = 1;
+
+    // the four region colours in turn until nothing gets shorter
+    for (bool more = true; more;)
+    {
+        more = false;
+        for (int colour = 0; colour < 4; colour++)
+        {
+            jobs.clear();
+            for (int ry = colour >> 1; ry < rows; ry += 2)
+            {
+                for (int rx = colour & 1; rx < columns; rx += 2)
+                {
+                    int region = ry * columns + rx;
+                    if (active[region])
+                    {
+                        active[region] = 0;
+                        jobs.push_back(region);
+                    }
+                }
+            }
+            if (jobs.empty())
+                continue;
+            walked += (int)jobs.size();
+            dispatch(true);
+            seedGoal = false;
+
+            for (int region : jobs)
+            {
+                unsigned short bits = wake[region];
+                for (int bit = 0; bits; bit++, bits >>= 1)
+                {
+                    if (!(bits & 1))
+                        continue;
+                    int rx = region % columns + bit % 3 - 1;
+                    int ry = region / columns + bit / 3 - 1;
+                    if (rx >= 0 && ry >= 0 && rx < columns && ry < rows)
+                    {
+                        active[ry * columns + rx] = 1;
+                        more = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // directions of the regions that changed and of their neighbours
+    jobs.clear();
+    for (int ry = 0; ry < rows; ry++)
+    {
+        for (int rx = 0; rx < columns; rx++)
+        {
+            bool dirty = false;
+            for (int y = std::max(0, ry - 1); y <= std::min(rows - 1, ry + 1) && !dirty; y++)
+            {
+                for (int x = std::max(0, rx - 1); x <= std::min(columns - 1, rx + 1) && !dirty; x++)
+                {
+                    dirty = touched[y * columns + x] != 0;
+                }
+            }
+            if (dirty)
+                jobs.push_back(ry * columns + rx);
+        }
+    }
+    dispatch(false);
+    std::fill(touched.begin(), touched.end(), 0);
+}
+
+Vector2 FlowField::getDirection(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return {0, 0};
+    unsigned char way = direction[y * width + x];
+    if (way == 255)
+        return {0, 0};
+    if (way < 4)
+        return {(float)DIRECTION_X[way], (float)DIRECTION_Y[way]};
+    return {DIRECTION_X[way] * 0.70710678f, DIRECTION_Y[way] * 0.70710678f};
+}
+
+Vector2 FlowField::getDirection(Vector2 point) const
+{
+    int x, y;
+    if (!grid || !grid->toCell(point, x, y))
+        return {0, 0};
+    return getDirection(x, y);
+}
+
+float FlowField::getDistance(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= width || y >= height || distance[y * width + x] >= FLOW_FAR)
+        return -1;
+    return distance[y * width + x] + offset;
+}
@@ -0,0 +1,243 @@
+#pragma once
+#include "Engine.hpp"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+//*********************************************************************************************************************
+//**                         Pathfinding                                                                             **
+//*********************************************************************************************************************
+
+// A NavGrid is the walkability of a TileLayerComponent (tile >= 1 is solid, like createSolids) cut in square
+// regions. The layer tells the grid about every setTile that changes walkability: a blocked cell drops only
+// the cached paths around its region, an opened one drops them all since it can shorten any of them.
+// Moves go 8 ways without cutting corners.
+
+enum class PathMode
+{
+    AStar,
+    JPS // jump point search, uniform costs only: A* is used while any cell costs more than 1
+};
+
+class NavGrid
+{
+public:
+    NavGrid();
+    ~NavGrid();
+
+    // reads the layer and follows its changes, regionSize in tiles
+    void build(TileLayerComponent *layer, int regionSize = 16);
+    void detach();  // the layer is gone, the grid keeps its cells
+    void refresh(); // the whole layer changed
+    void onTile(int x, int y, int tile);
+
+    // 0 = blocked, 1 = open, more = slower (A* only)
+    void setCost(int x, int y, unsigned char cost);
+    unsigned char getCost(int x, int y) const { return isInside(x, y) ? cost[y * width + x] : 0; }
+    bool isWalkable(int x, int y) const { return isInside(x, y) && cost[y * width + x] != 0; }
+    bool isInside(int x, int y) const { return x >= 0 && y >= 0 && x < width && y < height; }
+
+    bool toCell(Vector2 point, int &x, int &y) const;
+    Vector2 toWorld(int x, int y) const; // tile center
+    int getRegion(int x, int y) const { return (y / regionSize) * regionColumns + x / regionSize; }
+
+    // paths kept per start and end region, a request hits when its goal is the same cell and its start is on the path
+    bool findCached(int start, int goal, std::vector<int> &cells);
+    void storeCached(int start, int goal, const std::vector<int> &cells);
+    void clearCache() { cache.clear(); }
+    size_t cacheSize; // entries, the least used goes first
+
+    int width;
+    int height;
+    int regionSize;
+    int regionColumns;
+    int regionRows;
+    Vector2 origin;
+    float tileWidth;
+    float tileHeight;
+    std::vector<unsigned char> cost;
+    int weighted;         // cells costing more than 1
+    unsigned int version; // bumped on every change, restarts the searches in flight
+
+private:
+    struct CachedPath
+    {
+        int goal;
+        int minX; // regions the path crosses
+        int minY;
+        int maxX;
+        int maxY;
+        unsigned long used;
+        std::vector<int> cells;
+    };
+
+    void changed(int x, int y, bool cheaper);
+    int cellRegion(int cell) const { return getRegion(cell % width, cell / width); }
+
+    TileLayerComponent *layer;
+    std::unordered_map<unsigned long long, CachedPath> cache;
+    unsigned long useCount;
+};
+
+class PathFinder
+{
+public:
+    static PathFinder &Instance()
+    {
+        static PathFinder instance;
+        return instance;
+    }
+
+    typedef std::function<void(unsigned int id, bool found, const std::vector<Vector2> &path)> Callback;
+
+    // right now, points are tile centers from start to goal
+    bool findPath(NavGrid &grid, int startX, int startY, int goalX, int goalY, std::vector<Vector2> &path, PathMode mode = PathMode::JPS);
+    bool findPath(NavGrid &grid, Vector2 from, Vector2 to, std::vector<Vector2> &path, PathMode mode = PathMode::JPS);
+
+    // queued and searched a few nodes per update, done is called from update, returns the request id
+    unsigned int request(NavGrid *grid, Vector2 from, Vector2 to, Callback done, PathMode mode = PathMode::JPS);
+    void cancel(unsigned int id);
+    void cancel(NavGrid *grid); // every request of the grid
+    void clear();
+
+    // called by the Scene
+    void update();
+
+    int getPending() const { return (int)queue.size() + (searching ? 1 : 0); }
+    int getExpanded() const { return expanded; }
+
+    int budget; // nodes expanded per update over all the requests
+
+private:
+    PathFinder();
+
+    struct HeapItem
+    {
+        float f;
+        int cell;
+        bool operator<(const HeapItem &other) const { return f > other.f; } // lowest f on top
+    };
+
+    // node arrays, reused by every search, stamped instead of cleared
+    struct Search
+    {
+        Search() : grid(nullptr), start(0), goal(0), goalX(0), goalY(0), jump(false), version(0), stamp(0) {}
+
+        void begin(NavGrid *grid, int start, int goal, PathMode mode);
+        int step(int &budget, int &expanded); // 1 = found, -1 = no path, 0 = out of budget
+        void cells(std::vector<int> &out) const;
+
+        void open(int cell, int parent, float g);
+        void expandStar(int cell, int x, int y);
+        void expandJump(int cell, int x, int y);
+        int jumpFrom(int x, int y, int dx, int dy) const;
+        float heuristic(int x, int y) const;
+
+        NavGrid *grid;
+        int start;
+        int goal;
+        int goalX;
+        int goalY;
+        bool jump;
+        unsigned int version;
+        unsigned int stamp;
+        std::vector<float> g;
+        std::vector<int> parent;
+        std::vector<unsigned int> seen;
+        std::vector<unsigned int> closed;
+        std::vector<HeapItem> heap;
+    };
+
+    struct Request
+    {
+        unsigned int id;
+        NavGrid *grid;
+        int start;
+        int goal;
+        PathMode mode;
+        Callback done;
+    };
+
+    bool resolve(NavGrid &grid, int start, int goal, std::vector<Vector2> &path);
+    void finish(const Request &request, bool found);
+
+    Search now;    // findPath
+    Search queued; // requests
+    std::deque<Request> queue;
+    Request current;
+    bool searching;
+    unsigned int nextID;
+    int expanded;
+    std::vector<int> cellPath;
+    std::vector<Vector2> points;
+};
+
+//*********************************************************************************************************************
+//**                         FlowField                                                                               **
+//*********************************************************************************************************************
+
+// Distance from every cell of a NavGrid to one goal and the move to make from there, for crowds with a shared
+// target: one update per frame and O(1) per agent. The distances are relaxed region by region, regions with
+// the same parity on both axes never touch, so each of the four passes can run on the worker threads.
+// When the goal steps to a next cell the old distances stay as upper bounds and only the regions that
+// get shorter are walked again. A grid change or a longer jump rebuilds the whole field.
+
+class FlowField
+{
+public:
+    FlowField();
+    ~FlowField();
+
+    void setGrid(NavGrid *grid);
+    // false when outside or blocked, taken by the next update
+    bool setGoal(Vector2 point);
+    bool setGoal(int x, int y);
+    // recomputes what the goal or the grid changed, call once per frame
+    void update();
+
+    // unit vector to the next cell, {0, 0} at the goal and where the goal can't be reached
+    Vector2 getDirection(Vector2 point) const;
+    Vector2 getDirection(int x, int y) const;
+    float getDistance(int x, int y) const; // -1 = unreachable
+
+    // 1 = main thread only
+    void setThreads(int count);
+    int getWalked() const { return walked; } // regions relaxed by the last update
+
+private:
+    struct Item
+    {
+        float distance;
+        int cell;
+        bool operator<(const Item &other) const { return distance > other.distance; }
+    };
+
+    void reset();
+    float moveCost(int x, int y, int dx, int dy) const;
+    void relax(int region, std::vector<Item> &heap);
+    void directions(int region);
+    void dispatch(bool relaxing);
+    void run(int index);
+
+    NavGrid *grid;
+    unsigned int gridVersion;
+    int width;
+    int height;
+    int goal;     // cell, -1 = none
+    int nextGoal; // from setGoal
+    bool seedGoal;
+    float offset; // distance = stored + offset, bumped instead of the whole field when the goal steps
+    std::vector<float> distance;
+    std::vector<unsigned char> direction; // into the 8 moves, 255 = none
+    std::vector<unsigned char> active;    // regions to relax
+    std::vector<unsigned char> touched;   // regions with a shorter distance
+    std::vector<unsigned short> wake;     // per region, bit (dy + 1) * 3 + dx + 1 = that neighbour has to pull
+    std::vector<int> jobs;
+    std::vector<std::vector<Item>> heaps; // one per thread
+    int walked;
+    bool relaxing;
+
+    WorkerPool pool;
+    std::atomic<int> next;
+};
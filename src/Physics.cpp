@@ -0,0 +1,801 @@
+#include "Physics.hpp"
+#include "Scene.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//*********************************************************************************************************************
+//**                         RigidBodyComponent                                                                      **
+//*********************************************************************************************************************
+
+RigidBodyComponent::RigidBodyComponent(BodyType type, float mass)
+    : type(type), velocity({0, 0}), restitution(0), friction(0.5f), gravityScale(1), damping(0),
+      collider(nullptr), invMass(0), force({0, 0}), rest(0), sleeping(false), nextAsleep(nullptr), id(0), slot(-1), index(-1)
+{
+    setMass(mass);
+}
+
+RigidBodyComponent::~RigidBodyComponent()
+{
+    if (slot >= 0)
+        PhysicsSystem::Instance().remove(slot);
+}
+
+void RigidBodyComponent::OnInit()
+{
+    collider = object->GetComponent<BoxColiderComponent>();
+    if (!collider)
+        collider = object->GetComponent<CircleColiderComponent>();
+    if (!collider)
+        Log(LOG_WARNING, "RigidBodyComponent %s has no box or circle collider", object->name.c_str());
+    if (object->parent)
+        Log(LOG_WARNING, "RigidBodyComponent %s is not a root object", object->name.c_str());
+    if (slot < 0)
+        slot = PhysicsSystem::Instance().add(this);
+}
+
+void RigidBodyComponent::OnDebug()
+{
+    Vector2 p = collider ? collider->GetWorldPosition() : Vector2{object->getWorldX(), object->getWorldY()};
+    DrawLine((int)p.x, (int)p.y, (int)(p.x + velocity.x * 0.1f), (int)(p.y + velocity.y * 0.1f), sleeping ? GRAY : GREEN);
+}
+
+void RigidBodyComponent::setMass(float mass)
+{
+    invMass = (type == BodyDynamic && mass > 0) ? 1.0f / mass : 0.0f;
+}
+
+void RigidBodyComponent::applyForce(Vector2 f)
+{
+    force.x += f.x;
+    force.y += f.y;
+    wake();
+}
+
+void RigidBodyComponent::applyImpulse(Vector2 impulse)
+{
+    velocity.x += impulse.x * invMass;
+    velocity.y += impulse.y * invMass;
+    wake();
+}
+
+void RigidBodyComponent::wake()
+{
+    if (!sleeping)
+        return;
+    RigidBodyComponent *body = this;
+    do
+    {
+        RigidBodyComponent *next = body->nextAsleep;
+        body->sleeping = false;
+        body->rest = 0;
+        body->nextAsleep = nullptr;
+        body = next;
+    } while (body && body != this);
+}
+
+//*********************************************************************************************************************
+//**                         PhysicsSystem                                                                           **
+//*********************************************************************************************************************
+
+PhysicsSystem::PhysicsSystem()
+    : gravity({0, 980}), step(1.0f / 60.0f), maxSteps(4), iterations(8), bounceSpeed(60), sleepSpeed(8), sleepTime(0.5f), slop(0.5f), correction(0.2f),
+      seenStamp(0), gridX(0), gridY(0), gridCell(64), gridColumns(0), gridRows(0), stamp(0), nextID(1), accumulator(0)
+{
+}
+
+int PhysicsSystem::add(RigidBodyComponent *body)
+{
+    body->id = nextID++;
+    bodies.push_back(body);
+    return (int)bodies.size() - 1;
+}
+
+void PhysicsSystem::remove(int slot)
+{
+    if (slot < 0 || slot >= (int)bodies.size())
+        return;
+    RigidBodyComponent *body = bodies[slot];
+
+    // what rested on it has to fall
+    body->wake();
+    for (auto &shape : statics)
+    {
+        if (shape.body == body)
+        {
+            shape.body = nullptr;
+            shape.object = nullptr; // skipped until the next gather
+        }
+    }
+    dozing.erase(std::remove(dozing.begin(), dozing.end(), body), dozing.end());
+    awake.erase(std::remove(awake.begin(), awake.end(), body), awake.end());
+    // debug() draws the contacts of the last step
+    contacts.erase(std::remove_if(contacts.begin(), contacts.end(), [body](const Contact &c)
+                                  { return c.a == body || c.b == body; }),
+                   contacts.end());
+
+    bodies[slot] = bodies.back();
+    bodies[slot]->slot = slot;
+    bodies.pop_back();
+}
+
+void PhysicsSystem::clear()
+{
+    cache.clear();
+    statics.clear();
+    rotated.clear();
+    tileLayers.clear();
+    dozing.clear();
+    contacts.clear();
+    awake.clear();
+    gridColumns = 0;
+    gridRows = 0;
+    accumulator = 0;
+}
+
+bool PhysicsSystem::shapeOf(RigidBodyComponent *body, Shape &shape) const
+{
+    ColideComponent *collider = body->collider;
+    if (!collider)
+        return false;
+    shape.object = body->object;
+    shape.body = nullptr;
+    shape.oriented = -1;
+    shape.key = body->id;
+    if (collider->type == ColliderType::Box)
+    {
+        shape.box = static_cast<BoxColiderComponent *>(collider)->GetWorldRect();
+        shape.center = {shape.box.x + shape.box.width * 0.5f, shape.box.y + shape.box.height * 0.5f};
+        shape.radius = 0;
+    }
+    else
+    {
+        float radius = static_cast<CircleColiderComponent *>(collider)->radius;
+        shape.center = collider->GetWorldPosition();
+        shape.radius = radius;
+        shape.box = {shape.center.x - radius, shape.center.y - radius, radius * 2, radius * 2};
+    }
+    return true;
+}
+
+void PhysicsSystem::gatherStatics()
+{
+    statics.clear();
+    rotated.clear();
+    tileLayers.clear();
+    dozing.clear();
+    gridColumns = 0;
+    gridRows = 0;
+    Scene *scene = Scene::Instance();
+    if (!scene)
+        return;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (auto object : scene->gameObjects)
+    {
+        if (!object->alive || !object->active)
+            continue;
+        if (TileLayerComponent *tiles = object->GetComponent<TileLayerComponent>())
+            tileLayers.push_back(tiles);
+        if (!object->collidable)
+            continue;
+
+        Shape shape;
+        RigidBodyComponent *body = object->GetComponent<RigidBodyComponent>();
+        if (body)
+        {
+            // awake bodies move, sleeping ones are static until touched
+            if (!body->sleeping || !shapeOf(body, shape))
+                continue;
+            shape.body = body;
+        }
+        else
+        {
+            shape.object = object;
+            shape.body = nullptr;
+            shape.oriented = -1;
+            shape.key = 0x80000000u | (unsigned int)(object->id & 0x7FFFFFFF);
+            if (BoxColiderComponent *box = object->GetComponent<BoxColiderComponent>())
+            {
+                shape.box = box->GetWorldRect();
+                shape.center = {shape.box.x + shape.box.width * 0.5f, shape.box.y + shape.box.height * 0.5f};
+                shape.radius = 0;
+            }
+            else if (CircleColiderComponent *circle = object->GetComponent<CircleColiderComponent>())
+            {
+                shape.center = circle->GetWorldPosition();
+                shape.radius = circle->radius;
+                shape.box = {shape.center.x - circle->radius, shape.center.y - circle->radius, circle->radius * 2, circle->radius * 2};
+            }
+            else if (OrientedColiderComponent *oriented = object->GetComponent<OrientedColiderComponent>())
+            {
+                const OrientedBox &box = oriented->GetWorldBox();
+                shape.box = box.bound;
+                shape.center = box.center;
+                shape.radius = 0;
+                shape.oriented = (int)rotated.size();
+                rotated.push_back(box);
+            }
+            else
+                continue;
+        }
+
+        minX = std::min(minX, shape.box.x);
+        minY = std::min(minY, shape.box.y);
+        maxX = std::max(maxX, shape.box.x + shape.box.width);
+        maxY = std::max(maxY, shape.box.y + shape.box.height);
+        statics.push_back(shape);
+    }
+    seen.assign(statics.size(), 0);
+    seenStamp = 0;
+    if (statics.empty())
+        return;
+
+    // same grid as the projectiles, bigger cells when the world is wide
+    gridX = minX;
+    gridY = minY;
+    gridCell = 64;
+    for (;;)
+    {
+        gridColumns = (int)((maxX - minX) / gridCell) + 1;
+        gridRows = (int)((maxY - minY) / gridCell) + 1;
+        if ((long long)gridColumns * gridRows <= 65536)
+            break;
+        gridCell *= 2;
+    }
+
+    cellStart.assign(gridColumns * gridRows + 1, 0);
+    int total = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int s = 0; s < (int)statics.size(); s++)
+        {
+            const Rectangle &b = statics[s].box;
+            int c0 = (int)((b.x - gridX) / gridCell), c1 = (int)((b.x + b.width - gridX) / gridCell);
+            int r0 = (int)((b.y - gridY) / gridCell), r1 = (int)((b.y + b.height - gridY) / gridCell);
+            for (int r = r0; r <= r1; r++)
+                for (int c = c0; c <= c1; c++)
+                {
+                    if (pass == 0)
+                    {
+                        cellStart[r * gridColumns + c]++;
+                        total++;
+                    }
+                    else
+                        cellItems[--cellStart[r * gridColumns + c]] = s;
+                }
+        }
+        if (pass == 0)
+        {
+            for (int c = 1; c <= gridColumns * gridRows; c++)
+            {
+                cellStart[c] += cellStart[c - 1];
+            }
+            cellItems.resize(total);
+        }
+    }
+}
+
+// normal from the box to the circle
+static bool BoxCircle(const Rectangle &r, Vector2 c, float radius, Vector2 &normal, float &depth)
+{
+    float px = std::min(std::max(c.x, r.x), r.x + r.width);
+    float py = std::min(std::max(c.y, r.y), r.y + r.height);
+    float dx = c.x - px;
+    float dy = c.y - py;
+    float d2 = dx * dx + dy * dy;
+    if (d2 > radius * radius)
+        return false;
+    if (d2 > 0)
+    {
+        float d = sqrtf(d2);
+        normal = {dx / d, dy / d};
+        depth = radius - d;
+        return true;
+    }
+
+    // center inside, out through the nearest face
+    float left = c.x - r.x;
+    float right = r.x + r.width - c.x;
+    float top = c.y - r.y;
+    float bottom = r.y + r.height - c.y;
+    float best = std::min(std::min(left, right), std::min(top, bottom));
+    if (best == left)
+        normal = {-1, 0};
+    else if (best == right)
+        normal = {1, 0};
+    else if (best == top)
+        normal = {0, -1};
+    else
+        normal = {0, 1};
+    depth = best + radius;
+    return true;
+}
+
+bool PhysicsSystem::collide(const Shape &a, const Shape &b, Vector2 &normal, float &depth) const
+{
+    if (b.oriented >= 0)
+    {
+        const OrientedBox &other = rotated[b.oriented];
+        if (a.radius > 0)
+        {
+            if (!OverlapOrientedBoxCircle(other, a.center, a.radius, &normal, &depth))
+                return false;
+            normal = {-normal.x, -normal.y};
+            return true;
+        }
+        OrientedBox box;
+        box.set(a.box);
+        return OverlapOrientedBoxes(box, other, &normal, &depth);
+    }
+
+    if (a.radius > 0 && b.radius > 0)
+    {
+        float dx = b.center.x - a.center.x;
+        float dy = b.center.y - a.center.y;
+        float r = a.radius + b.radius;
+        float d2 = dx * dx + dy * dy;
+        if (d2 >= r * r)
+            return false;
+        float d = sqrtf(d2);
+        normal = d > 0 ? Vector2{dx / d, dy / d} : Vector2{0, 1};
+        depth = r - d;
+        return true;
+    }
+    if (a.radius > 0)
+    {
+        if (!BoxCircle(b.box, a.center, a.radius, normal, depth))
+            return false;
+        normal = {-normal.x, -normal.y};
+        return true;
+    }
+    if (b.radius > 0)
+        return BoxCircle(a.box, b.center, b.radius, normal, depth);
+
+    float overlapX = std::min(a.box.x + a.box.width, b.box.x + b.box.width) - std::max(a.box.x, b.box.x);
+    float overlapY = std::min(a.box.y + a.box.height, b.box.y + b.box.height) - std::max(a.box.y, b.box.y);
+    if (overlapX <= 0 || overlapY <= 0)
+        return false;
+    if (overlapX < overlapY)
+    {
+        normal = {b.center.x > a.center.x ? 1.0f : -1.0f, 0};
+        depth = overlapX;
+    }
+    else
+    {
+        normal = {0, b.center.y > a.center.y ? 1.0f : -1.0f};
+        depth = overlapY;
+    }
+    return true;
+}
+
+void PhysicsSystem::addContact(RigidBodyComponent *a, RigidBodyComponent *b, Vector2 normal, float depth, unsigned int key)
+{
+    Contact contact;
+    contact.a = a;
+    contact.b = b;
+    contact.normal = normal;
+    contact.depth = depth;
+    contact.mass = 0;
+    contact.bias = 0;
+    contact.friction = 0;
+    contact.normalImpulse = 0;
+    contact.tangentImpulse = 0;
+    contact.key = ((unsigned long long)a->id << 32) | key;
+    contacts.push_back(contact);
+}
+
+void PhysicsSystem::touchStatic(int i, const Shape &shape)
+{
+    RigidBodyComponent *body = awake[i];
+    if (!shape.object || !body->object->canCollide(shape.object))
+        return;
+    if (shape.body && !shape.body->sleeping)
+        return; // woken this update, it is in the awake list
+    Vector2 normal;
+    float depth;
+    if (!collide(awakeShapes[i], shape, normal, depth))
+        return;
+    if (shape.body)
+        toWake.push_back(shape.body);
+    if (body->invMass > 0)
+        addContact(body, nullptr, normal, depth, shape.key);
+}
+
+void PhysicsSystem::touchTiles(int i, TileLayerComponent *layer)
+{
+    RigidBodyComponent *body = awake[i];
+    if (layer->object && !body->object->canCollide(layer->object))
+        return;
+    const Shape &shape = awakeShapes[i];
+    float tw = (float)layer->tileWidth;
+    float th = (float)layer->tileHeight;
+    if (tw <= 0 || th <= 0)
+        return;
+    int x0 = std::max(0, (int)floorf((shape.box.x - layer->offset.x) / tw));
+    int y0 = std::max(0, (int)floorf((shape.box.y - layer->offset.y) / th));
+    int x1 = std::min(layer->width - 1, (int)floorf((shape.box.x + shape.box.width - layer->offset.x) / tw));
+    int y1 = std::min(layer->height - 1, (int)floorf((shape.box.y + shape.box.height - layer->offset.y) / th));
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            if (layer->getTile(x, y) < 1)
+                continue;
+            Shape tile;
+            tile.box = {layer->offset.x + x * tw, layer->offset.y + y * th, tw, th};
+            tile.center = {tile.box.x + tw * 0.5f, tile.box.y + th * 0.5f};
+            tile.radius = 0;
+            tile.oriented = -1;
+            Vector2 normal;
+            float depth;
+            if (!collide(shape, tile, normal, depth))
+                continue;
+
+            // a face against another solid tile is inside the wall, bodies would catch on the seams
+            int nx = fabsf(normal.x) >= fabsf(normal.y) ? (normal.x > 0 ? -1 : 1) : 0;
+            int ny = nx == 0 ? (normal.y > 0 ? -1 : 1) : 0;
+            if (layer->getTile(x + nx, y + ny) >= 1)
+                continue;
+            addContact(body, nullptr, normal, depth, 0x40000000u | (unsigned int)((y * layer->width + x) & 0x3FFFFFFF));
+        }
+    }
+}
+
+void PhysicsSystem::findContacts()
+{
+    contacts.clear();
+    int count = (int)awake.size();
+
+    // bodies against bodies, sort and sweep on x
+    order.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b)
+              { return awakeShapes[a].box.x < awakeShapes[b].box.x; });
+    for (int i = 0; i < count; i++)
+    {
+        int a = order[i];
+        const Shape &shapeA = awakeShapes[a];
+        for (int j = i + 1; j < count; j++)
+        {
+            int b = order[j];
+            const Shape &shapeB = awakeShapes[b];
+            if (shapeB.box.x > shapeA.box.x + shapeA.box.width)
+                break;
+            if (shapeB.box.y > shapeA.box.y + shapeA.box.height || shapeA.box.y > shapeB.box.y + shapeB.box.height)
+                continue;
+            RigidBodyComponent *bodyA = awake[a];
+            RigidBodyComponent *bodyB = awake[b];
+            if (bodyA->invMass == 0 && bodyB->invMass == 0)
+                continue;
+            if (!bodyA->object->canCollide(bodyB->object))
+                continue;
+            Vector2 normal;
+            float depth;
+            if (collide(shapeA, shapeB, normal, depth))
+                addContact(bodyA, bodyB, normal, depth, bodyB->id);
+        }
+    }
+
+    // the static world: grid, bodies asleep since it was built, tiles
+    // kinematic bodies only look for sleepers to wake
+    for (int i = 0; i < count; i++)
+    {
+        const Rectangle &b = awakeShapes[i].box;
+        if (gridColumns > 0)
+        {
+            if (++seenStamp == 0)
+            {
+                std::fill(seen.begin(), seen.end(), 0);
+                seenStamp = 1;
+            }
+            int c0 = std::max(0, (int)floorf((b.x - gridX) / gridCell));
+            int r0 = std::max(0, (int)floorf((b.y - gridY) / gridCell));
+            int c1 = std::min(gridColumns - 1, (int)floorf((b.x + b.width - gridX) / gridCell));
+            int r1 = std::min(gridRows - 1, (int)floorf((b.y + b.height - gridY) / gridCell));
+            for (int r = r0; r <= r1; r++)
+                for (int c = c0; c <= c1; c++)
+                {
+                    int cell = r * gridColumns + c;
+                    for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                    {
+                        int s = cellItems[k];
+                        if (seen[s] == seenStamp)
+                            continue;
+                        seen[s] = seenStamp;
+                        const Rectangle &o = statics[s].box;
+                        if (o.x > b.x + b.width || b.x > o.x + o.width || o.y > b.y + b.height || b.y > o.y + o.height)
+                            continue;
+                        touchStatic(i, statics[s]);
+                    }
+                }
+        }
+        for (auto body : dozing)
+        {
+            Shape shape;
+            if (body->sleeping && shapeOf(body, shape))
+            {
+                shape.body = body;
+                touchStatic(i, shape);
+            }
+        }
+        for (int t = 0; t < (int)tileLayers.size() && awake[i]->invMass > 0; t++)
+        {
+            touchTiles(i, tileLayers[t]);
+        }
+    }
+}
+
+void PhysicsSystem::solve()
+{
+    // warm start with last step's impulses of the same contacts
+    for (auto &c : contacts)
+    {
+        RigidBodyComponent *a = c.a;
+        RigidBodyComponent *b = c.b;
+        float invB = b ? b->invMass : 0.0f;
+        float k = a->invMass + invB;
+        c.mass = k > 0 ? 1.0f / k : 0.0f;
+        Vector2 vb = b ? b->velocity : Vector2{0, 0};
+        float vn = (vb.x - a->velocity.x) * c.normal.x + (vb.y - a->velocity.y) * c.normal.y;
+        float bounce = std::max(a->restitution, b ? b->restitution : 0.0f);
+        c.bias = vn < -bounceSpeed ? -bounce * vn : 0.0f;
+        c.friction = sqrtf(a->friction * (b ? b->friction : 0.5f));
+
+        auto it = cache.find(c.key);
+        if (it != cache.end() && it->second.normal.x * c.normal.x + it->second.normal.y * c.normal.y > 0.9f)
+        {
+            c.normalImpulse = it->second.normalImpulse;
+            c.tangentImpulse = it->second.tangentImpulse;
+            float px = c.normal.x * c.normalImpulse - c.normal.y * c.tangentImpulse;
+            float py = c.normal.y * c.normalImpulse + c.normal.x * c.tangentImpulse;
+            a->velocity.x -= px * a->invMass;
+            a->velocity.y -= py * a->invMass;
+            if (b)
+            {
+                b->velocity.x += px * invB;
+                b->velocity.y += py * invB;
+            }
+        }
+    }
+
+    for (int pass = 0; pass < iterations; pass++)
+    {
+        for (auto &c : contacts)
+        {
+            if (c.mass == 0)
+                continue;
+            RigidBodyComponent *a = c.a;
+            RigidBodyComponent *b = c.b;
+            float invB = b ? b->invMass : 0.0f;
+            Vector2 vb = b ? b->velocity : Vector2{0, 0};
+
+            // normal, the accumulated impulse only pushes
+            float vn = (vb.x - a->velocity.x) * c.normal.x + (vb.y - a->velocity.y) * c.normal.y;
+            float old = c.normalImpulse;
+            c.normalImpulse = std::max(old + c.mass * (c.bias - vn), 0.0f);
+            float d = c.normalImpulse - old;
+            a->velocity.x -= c.normal.x * d * a->invMass;
+            a->velocity.y -= c.normal.y * d * a->invMass;
+            if (b)
+            {
+                b->velocity.x += c.normal.x * d * invB;
+                b->velocity.y += c.normal.y * d * invB;
+                vb = b->velocity;
+            }
+
+            // friction along the tangent, inside the cone of the normal impulse
+            Vector2 t = {-c.normal.y, c.normal.x};
+            float vt = (vb.x - a->velocity.x) * t.x + (vb.y - a->velocity.y) * t.y;
+            float limit = c.friction * c.normalImpulse;
+            old = c.tangentImpulse;
+            c.tangentImpulse = std::min(std::max(old - c.mass * vt, -limit), limit);
+            d = c.tangentImpulse - old;
+            a->velocity.x -= t.x * d * a->invMass;
+            a->velocity.y -= t.y * d * a->invMass;
+            if (b)
+            {
+                b->velocity.x += t.x * d * invB;
+                b->velocity.y += t.y * d * invB;
+            }
+        }
+    }
+
+    // keep for the next step, contacts that went away are dropped
+    stamp++;
+    for (const auto &c : contacts)
+    {
+        Impulse &impulse = cache[c.key];
+        impulse.normal = c.normal;
+        impulse.normalImpulse = c.normalImpulse;
+        impulse.tangentImpulse = c.tangentImpulse;
+        impulse.stamp = stamp;
+    }
+    for (auto it = cache.begin(); it != cache.end();)
+    {
+        if (it->second.stamp != stamp)
+            it = cache.erase(it);
+        else
+            ++it;
+    }
+}
+
+int PhysicsSystem::root(int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void PhysicsSystem::islands(float h)
+{
+    int count = (int)awake.size();
+    parent.resize(count);
+    islandRest.assign(count, FLT_MAX);
+    for (int i = 0; i < count; i++)
+    {
+        parent[i] = i;
+        RigidBodyComponent *body = awake[i];
+        float speed2 = body->velocity.x * body->velocity.x + body->velocity.y * body->velocity.y;
+        body->rest = speed2 < sleepSpeed * sleepSpeed ? body->rest + h : 0.0f;
+    }
+
+    // touching dynamic bodies join, a moving kinematic body keeps what it touches awake
+    for (const auto &c : contacts)
+    {
+        if (!c.b)
+            continue;
+        if (c.a->type == BodyKinematic || c.b->type == BodyKinematic)
+        {
+            RigidBodyComponent *mover = c.a->type == BodyKinematic ? c.a : c.b;
+            RigidBodyComponent *other = mover == c.a ? c.b : c.a;
+            if (mover->velocity.x != 0 || mover->velocity.y != 0)
+                other->rest = 0;
+            continue;
+        }
+        int a = root(c.a->index);
+        int b = root(c.b->index);
+        if (a != b)
+            parent[a] = b;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (awake[i]->type == BodyKinematic)
+            continue;
+        int r = root(i);
+        islandRest[r] = std::min(islandRest[r], awake[i]->rest);
+    }
+
+    // every body of a resting island sleeps, linked in a ring so one touch wakes them all
+    std::vector<RigidBodyComponent *> last(count, nullptr); // ring tail per island
+    for (int i = 0; i < count; i++)
+    {
+        RigidBodyComponent *body = awake[i];
+        if (body->type == BodyKinematic)
+            continue;
+        int r = root(i);
+        if (islandRest[r] < sleepTime)
+            continue;
+        body->sleeping = true;
+        body->velocity = {0, 0};
+        if (last[r])
+        {
+            body->nextAsleep = last[r]->nextAsleep;
+            last[r]->nextAsleep = body;
+        }
+        else
+            body->nextAsleep = body;
+        last[r] = body;
+        dozing.push_back(body);
+    }
+
+    // a single body is its own ring
+    for (auto body : dozing)
+    {
+        if (body->nextAsleep == body)
+            body->nextAsleep = nullptr;
+    }
+}
+
+void PhysicsSystem::simulate(float h)
+{
+    // velocities of the awake bodies
+    awake.clear();
+    awakeShapes.clear();
+    for (auto body : bodies)
+    {
+        if (body->sleeping || !body->object || !body->object->alive || !body->object->active)
+            continue;
+        Shape shape;
+        if (!shapeOf(body, shape))
+            continue;
+        body->index = (int)awake.size();
+        awake.push_back(body);
+        awakeShapes.push_back(shape);
+        if (body->type == BodyDynamic && body->invMass > 0)
+        {
+            body->velocity.x += (gravity.x * body->gravityScale + body->force.x * body->invMass) * h;
+            body->velocity.y += (gravity.y * body->gravityScale + body->force.y * body->invMass) * h;
+            float keep = std::max(0.0f, 1.0f - body->damping * h);
+            body->velocity.x *= keep;
+            body->velocity.y *= keep;
+        }
+    }
+
+    toWake.clear();
+    findContacts();
+    solve();
+
+    for (auto body : awake)
+    {
+        body->object->transform->position.x += body->velocity.x * h;
+        body->object->transform->position.y += body->velocity.y * h;
+    }
+
+    // penetration is pushed out on the positions, a velocity bias would keep piles jittering
+    for (const auto &c : contacts)
+    {
+        if (c.mass == 0 || c.depth <= slop)
+            continue;
+        float push = correction * (c.depth - slop) * c.mass;
+        c.a->object->transform->position.x -= c.normal.x * push * c.a->invMass;
+        c.a->object->transform->position.y -= c.normal.y * push * c.a->invMass;
+        if (c.b)
+        {
+            c.b->object->transform->position.x += c.normal.x * push * c.b->invMass;
+            c.b->object->transform->position.y += c.normal.y * push * c.b->invMass;
+        }
+    }
+
+    std::vector<RigidBodyComponent *> woken;
+    woken.swap(toWake);
+    islands(h);
+    for (auto body : woken)
+    {
+        body->wake();
+    }
+}
+
+void PhysicsSystem::update(float deltaTime)
+{
+    if (bodies.empty())
+        return;
+
+    accumulator += deltaTime;
+    int steps = 0;
+    while (accumulator >= step && steps < maxSteps)
+    {
+        accumulator -= step;
+        steps++;
+    }
+    if (accumulator >= step)
+        accumulator = 0; // too far behind, drop the rest
+    if (steps == 0)
+        return;
+
+    gatherStatics();
+    for (int i = 0; i < steps; i++)
+    {
+        simulate(step);
+    }
+    for (auto body : bodies)
+    {
+        body->force = {0, 0};
+    }
+}
+
+void PhysicsSystem::debug()
+{
+    for (const auto &c : contacts)
+    {
+        Vector2 p = c.a->collider ? c.a->collider->GetWorldPosition() : Vector2{0, 0};
+        DrawLine((int)p.x, (int)p.y, (int)(p.x + c.normal.x * 12), (int)(p.y + c.normal.y * 12), RED);
+    }
+}
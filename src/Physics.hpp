@@ -0,0 +1,167 @@
+#pragma once
+#include "Engine.hpp"
+#include <unordered_map>
+
+//*********************************************************************************************************************
+//**                         Physics                                                                                 **
+//*********************************************************************************************************************
+
+// Impulse solver for box and circle bodies, linear only (bodies don't rotate). A RigidBodyComponent uses the
+// BoxColiderComponent or CircleColiderComponent of its object, which must be a root object. Colliders without
+// a body and the solid tiles of the tile layers are the static world. Contacts keep their impulses from step
+// to step to warm start the solver. Bodies that touch form an island, and an island that rests long enough
+// sleeps: it leaves the steps until something touches it. There is no continuous collision, a body moving
+// more than its own size in one step can pass through thin walls.
+
+enum BodyType
+{
+    BodyDynamic,
+    BodyKinematic // moved by its velocity only, pushes the others
+};
+
+class RigidBodyComponent : public Component
+{
+public:
+    RigidBodyComponent(BodyType type = BodyDynamic, float mass = 1);
+    ~RigidBodyComponent();
+
+    void OnInit() override;
+    void OnDebug() override;
+
+    BodyType type;
+    Vector2 velocity;  // pixels per second
+    float restitution; // 0 = no bounce
+    float friction;
+    float gravityScale;
+    float damping; // velocity lost per second, 0..1
+
+    void setMass(float mass); // 0 = can't be pushed
+    float getMass() const { return invMass > 0 ? 1.0f / invMass : 0.0f; }
+    void applyForce(Vector2 force); // for the next update
+    void applyImpulse(Vector2 impulse);
+    // wakes the whole island
+    void wake();
+    bool isSleeping() const { return sleeping; }
+
+private:
+    friend class PhysicsSystem;
+
+    ColideComponent *collider;
+    float invMass;
+    Vector2 force;
+    float rest; // seconds below the sleep speed
+    bool sleeping;
+    RigidBodyComponent *nextAsleep; // ring of the sleeping island
+    unsigned int id;
+    int slot;
+    int index; // into the awake list of the step
+};
+
+class PhysicsSystem
+{
+public:
+    static PhysicsSystem &Instance()
+    {
+        static PhysicsSystem instance;
+        return instance;
+    }
+
+    int add(RigidBodyComponent *body);
+    void remove(int slot);
+    void clear(); // contact cache and static world
+
+    // called by the Scene
+    void update(float deltaTime);
+    void debug();
+
+    int getCount() const { return (int)bodies.size(); }
+    int getAwake() const { return (int)awake.size(); }
+    int getContacts() const { return (int)contacts.size(); }
+
+    Vector2 gravity;   // pixels per second^2
+    float step;        // fixed step, seconds
+    int maxSteps;      // per update, the rest is dropped
+    int iterations;    // solver passes per step
+    float bounceSpeed; // slower impacts don't bounce, pixels per second
+    float sleepSpeed;  // pixels per second
+    float sleepTime;   // seconds at rest before an island sleeps
+    float slop;        // penetration left alone, pixels
+    float correction;  // share of the penetration pushed out per step
+
+private:
+    PhysicsSystem();
+
+    struct Shape
+    {
+        Rectangle box; // world bound
+        Vector2 center;
+        float radius; // 0 = box
+        int oriented; // into rotated, -1 = not rotated
+        GameObject *object;
+        RigidBodyComponent *body; // sleeping body, nullptr = static
+        unsigned int key;
+    };
+
+    struct Contact
+    {
+        RigidBodyComponent *a;
+        RigidBodyComponent *b; // nullptr = static or asleep
+        Vector2 normal;        // from a to b
+        float depth;
+        float mass;
+        float bias; // bounce
+        float friction;
+        float normalImpulse;
+        float tangentImpulse;
+        unsigned long long key;
+    };
+
+    struct Impulse
+    {
+        Vector2 normal;
+        float normalImpulse;
+        float tangentImpulse;
+        unsigned int stamp;
+    };
+
+    void gatherStatics();
+    void simulate(float h);
+    void findContacts();
+    bool shapeOf(RigidBodyComponent *body, Shape &shape) const;
+    bool collide(const Shape &a, const Shape &b, Vector2 &normal, float &depth) const;
+    void addContact(RigidBodyComponent *a, RigidBodyComponent *b, Vector2 normal, float depth, unsigned int key);
+    void touchStatic(int i, const Shape &shape);
+    void touchTiles(int i, TileLayerComponent *layer);
+    void solve();
+    void islands(float h);
+    int root(int i);
+
+    std::vector<RigidBodyComponent *> bodies;
+    std::vector<RigidBodyComponent *> awake; // this step
+    std::vector<Shape> awakeShapes;
+    std::vector<int> order; // sweep
+    std::vector<RigidBodyComponent *> toWake;
+
+    // static world, built once per update, sleeping bodies included
+    std::vector<Shape> statics;
+    std::vector<OrientedBox> rotated;
+    std::vector<TileLayerComponent *> tileLayers;
+    std::vector<RigidBodyComponent *> dozing; // asleep since the statics were built
+    std::vector<int> cellStart;               // gridColumns * gridRows + 1
+    std::vector<int> cellItems;
+    std::vector<unsigned int> seen;
+    unsigned int seenStamp;
+    float gridX;
+    float gridY;
+    float gridCell;
+    int gridColumns;
+    int gridRows;
+
+    std::vector<Contact> contacts;
+    std::unordered_map<unsigned long long, Impulse> cache;
+    std::vector<int> parent; // islands, union find over awake
+    std::vector<float> islandRest;
+    unsigned int stamp;
+    unsigned int nextID;
+    float accumulator;
+};
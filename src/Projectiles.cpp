@@ -0,0 +1,435 @@
+#include "Projectiles.hpp"
+#include "Scene.hpp"
+#include <cfloat>
+#include <cmath>
+
+//*********************************************************************************************************************
+//**                         ProjectileSystem                                                                        **
+//*********************************************************************************************************************
+
+ProjectileSystem::ProjectileSystem()
+    : step(1.0f / 60.0f), maxSteps(4), cellSize(64), area({0, 0, 0, 0}), count(0), capacity(0), nextID(1), accumulator(0),
+      gridX(0), gridY(0), gridCell(64), gridColumns(0), gridRows(0)
+{
+    grow(1024);
+}
+
+int ProjectileSystem::addType(int graphID, const Rectangle &clip, float radius, int layer, bool rotate)
+{
+    ProjectileType t;
+    t.graph = Assets::Instance().getGraph(graphID);
+    if (!t.graph)
+        Log(LOG_ERROR, "ProjectileSystem::addType  %s ", Assets::Instance().getGraphName(graphID).c_str());
+    t.graphID = graphID;
+    t.clip = clip;
+    if (t.clip.width <= 0 && t.graph)
+        t.clip = {0, 0, (float)t.graph->width, (float)t.graph->height};
+    t.radius = radius;
+    t.layer = layer;
+    t.rotate = rotate;
+    t.collisionMask = 0xFFFFFFFF;
+    types.push_back(t);
+    return (int)types.size() - 1;
+}
+
+ProjectileType *ProjectileSystem::getType(int index)
+{
+    if (index < 0 || index >= (int)types.size())
+        return nullptr;
+    return &types[index];
+}
+
+void ProjectileSystem::grow(int size)
+{
+    capacity = size;
+    x.resize(size);
+    y.resize(size);
+    vx.resize(size);
+    vy.resize(size);
+    life.resize(size);
+    type.resize(size);
+    tag.resize(size);
+    owner.resize(size);
+    ids.resize(size);
+}
+
+void ProjectileSystem::reserve(int size)
+{
+    if (size > capacity)
+        grow(size);
+}
+
+unsigned int ProjectileSystem::fire(int index, float px, float py, float pvx, float pvy, float seconds, unsigned long ownerID, int userTag)
+{
+    if (index < 0 || index >= (int)types.size())
+    {
+        Log(LOG_WARNING, "ProjectileSystem::fire  invalid type %d", index);
+        return 0;
+    }
+    if (count == capacity)
+        grow(capacity * 2);
+
+    int i = count++;
+    x[i] = px;
+    y[i] = py;
+    vx[i] = pvx;
+    vy[i] = pvy;
+    life[i] = seconds;
+    type[i] = index;
+    tag[i] = userTag;
+    owner[i] = ownerID;
+    if (nextID == 0)
+        nextID = 1;
+    ids[i] = nextID++;
+
+    int layer = types[index].layer;
+    if (layer >= (int)layerCount.size())
+        layerCount.resize(layer + 1, 0);
+    if (layer >= 0)
+        layerCount[layer]++;
+    return ids[i];
+}
+
+void ProjectileSystem::clear()
+{
+    count = 0;
+    accumulator = 0;
+    hits.clear();
+    shapes.clear();
+    std::fill(layerCount.begin(), layerCount.end(), 0);
+}
+
+void ProjectileSystem::update(float deltaTime)
+{
+    hits.clear();
+    if (count == 0)
+    {
+        accumulator = 0;
+        return;
+    }
+
+    accumulator += deltaTime;
+    int steps = (int)(accumulator / step);
+    accumulator -= steps * step;
+    if (steps > maxSteps)
+        steps = maxSteps;
+    if (steps == 0)
+        return;
+
+    // colliders move once per frame, one grid for all the steps
+    gather();
+    for (int s = 0; s < steps && count > 0; s++)
+    {
+        integrate(step);
+        collide();
+        compact();
+    }
+
+    for (size_t i = 0; i < hits.size(); i++)
+    {
+        if (onHit)
+            onHit(hits[i]);
+        hits[i].target = nullptr; // removed with the dead objects right after this update
+    }
+}
+
+void ProjectileSystem::gather()
+{
+    shapes.clear();
+    rotated.clear();
+    gridColumns = 0;
+    gridRows = 0;
+    Scene *scene = Scene::Instance();
+    if (!scene)
+        return;
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (auto object : scene->gameObjects)
+    {
+        if (!object->alive || !object->active || !object->collidable)
+            continue;
+
+        Shape shape;
+        shape.object = object;
+        shape.oriented = -1;
+        shape.category = object->collisionCategory;
+        if (BoxColiderComponent *box = object->GetComponent<BoxColiderComponent>())
+        {
+            shape.box = box->GetWorldRect();
+            shape.center = {shape.box.x + shape.box.width * 0.5f, shape.box.y + shape.box.height * 0.5f};
+            shape.radius = 0;
+        }
+        else if (CircleColiderComponent *circle = object->GetComponent<CircleColiderComponent>())
+        {
+            shape.center = circle->GetWorldPosition();
+            shape.radius = circle->radius;
+            shape.box = {shape.center.x - circle->radius, shape.center.y - circle->radius, circle->radius * 2, circle->radius * 2};
+        }
+        else if (OrientedColiderComponent *oriented = object->GetComponent<OrientedColiderComponent>())
+        {
+            const OrientedBox &box = oriented->GetWorldBox();
+            shape.box = box.bound;
+            shape.center = box.center;
+            shape.radius = 0;
+            shape.oriented = (int)rotated.size();
+            rotated.push_back(box);
+        }
+        else
+            continue;
+
+        minX = std::min(minX, shape.box.x);
+        minY = std::min(minY, shape.box.y);
+        maxX = std::max(maxX, shape.box.x + shape.box.width);
+        maxY = std::max(maxY, shape.box.y + shape.box.height);
+        shapes.push_back(shape);
+    }
+    if (shapes.empty())
+        return;
+
+    // the cells get bigger when the colliders are far apart
+    gridX = minX;
+    gridY = minY;
+    gridCell = std::max(cellSize, 1.0f);
+    for (;;)
+    {
+        gridColumns = (int)((maxX - minX) / gridCell) + 1;
+        gridRows = (int)((maxY - minY) / gridCell) + 1;
+        if ((long long)gridColumns * gridRows <= 65536)
+            break;
+        gridCell *= 2;
+    }
+
+    // counting sort of the shapes by cell, cellStart[c]..cellStart[c + 1]
+    cellStart.assign(gridColumns * gridRows + 1, 0);
+    int total = 0;
+    for (size_t s = 0; s < shapes.size(); s++)
+    {
+        const Rectangle &b = shapes[s].box;
+        int c0 = (int)((b.x - gridX) / gridCell), c1 = (int)((b.x + b.width - gridX) / gridCell);
+        int r0 = (int)((b.y - gridY) / gridCell), r1 = (int)((b.y + b.height - gridY) / gridCell);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+            {
+                cellStart[r * gridColumns + c]++;
+                total++;
+            }
+    }
+    for (int c = 1; c <= gridColumns * gridRows; c++)
+    {
+        cellStart[c] += cellStart[c - 1];
+    }
+    cellItems.resize(total);
+    for (size_t s = 0; s < shapes.size(); s++)
+    {
+        const Rectangle &b = shapes[s].box;
+        int c0 = (int)((b.x - gridX) / gridCell), c1 = (int)((b.x + b.width - gridX) / gridCell);
+        int r0 = (int)((b.y - gridY) / gridCell), r1 = (int)((b.y + b.height - gridY) / gridCell);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                cellItems[--cellStart[r * gridColumns + c]] = (int)s;
+    }
+}
+
+void ProjectileSystem::integrate(float dt)
+{
+    float *px = x.data();
+    float *py = y.data();
+    const float *pvx = vx.data();
+    const float *pvy = vy.data();
+    float *pl = life.data();
+    for (int i = 0; i < count; i++)
+    {
+        px[i] += pvx[i] * dt;
+        py[i] += pvy[i] * dt;
+        pl[i] -= dt;
+    }
+}
+
+void ProjectileSystem::collide()
+{
+    if (gridColumns == 0)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (life[i] <= 0)
+            continue;
+        float r = types[type[i]].radius;
+        uint32_t layers = types[type[i]].collisionMask;
+        float px = x[i];
+        float py = y[i];
+        int c0 = (int)floorf((px - r - gridX) / gridCell), c1 = (int)floorf((px + r - gridX) / gridCell);
+        int r0 = (int)floorf((py - r - gridY) / gridCell), r1 = (int)floorf((py + r - gridY) / gridCell);
+        if (c1 < 0 || r1 < 0 || c0 >= gridColumns || r0 >= gridRows)
+            continue;
+        c0 = std::max(c0, 0);
+        r0 = std::max(r0, 0);
+        c1 = std::min(c1, gridColumns - 1);
+        r1 = std::min(r1, gridRows - 1);
+
+        const Shape *hit = nullptr;
+        for (int row = r0; row <= r1 && !hit; row++)
+            for (int column = c0; column <= c1 && !hit; column++)
+            {
+                int cell = row * gridColumns + column;
+                for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                {
+                    const Shape &shape = shapes[cellItems[k]];
+                    if (!(shape.category & layers) || (owner[i] != 0 && shape.object->id == owner[i]))
+                        continue;
+                    if (shape.oriented >= 0)
+                    {
+                        if (OverlapOrientedBoxCircle(rotated[shape.oriented], {px, py}, r, nullptr, nullptr))
+                        {
+                            hit = &shape;
+                            break;
+                        }
+                        continue;
+                    }
+                    float dx, dy, reach;
+                    if (shape.radius > 0)
+                    {
+                        dx = px - shape.center.x;
+                        dy = py - shape.center.y;
+                        reach = r + shape.radius;
+                    }
+                    else
+                    {
+                        dx = px - Clamp(px, shape.box.x, shape.box.x + shape.box.width);
+                        dy = py - Clamp(py, shape.box.y, shape.box.y + shape.box.height);
+                        reach = r;
+                    }
+                    if (dx * dx + dy * dy <= reach * reach)
+                    {
+                        hit = &shape;
+                        break;
+                    }
+                }
+            }
+        if (!hit)
+            continue;
+
+        ProjectileHit event;
+        event.projectile = ids[i];
+        event.type = type[i];
+        event.tag = tag[i];
+        event.target = hit->object;
+        event.targetID = hit->object->id;
+        event.point = {px, py};
+        event.velocity = {vx[i], vy[i]};
+        hits.push_back(event);
+        life[i] = 0;
+    }
+}
+
+void ProjectileSystem::compact()
+{
+    bool limit = area.width > 0 && area.height > 0;
+    for (int i = 0; i < count;)
+    {
+        bool dead = life[i] <= 0;
+        if (!dead && limit)
+            dead = x[i] < area.x || y[i] < area.y || x[i] > area.x + area.width || y[i] > area.y + area.height;
+        if (!dead)
+        {
+            i++;
+            continue;
+        }
+
+        int layer = types[type[i]].layer;
+        if (layer >= 0)
+            layerCount[layer]--;
+
+        // the last one takes the slot
+        int last = --count;
+        x[i] = x[last];
+        y[i] = y[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        life[i] = life[last];
+        type[i] = type[last];
+        tag[i] = tag[last];
+        owner[i] = owner[last];
+        ids[i] = ids[last];
+    }
+}
+
+void ProjectileSystem::draw(int layer)
+{
+    if (layer < 0 || layer >= (int)layerCount.size() || layerCount[layer] == 0)
+        return;
+
+    Rectangle view = Scene::Instance()->cameraView;
+    unsigned int texture = 0;
+    const int BATCH = 1024;
+    for (int start = 0; start < count; start += BATCH)
+    {
+        int end = std::min(count, start + BATCH);
+        rlCheckRenderBatchLimit(4 * (end - start));
+        rlBegin(RL_QUADS);
+        rlNormal3f(0.0f, 0.0f, 1.0f);
+        rlColor4ub(255, 255, 255, 255);
+        for (int i = start; i < end; i++)
+        {
+            const ProjectileType &t = types[type[i]];
+            if (t.layer != layer || !t.graph)
+                continue;
+
+            float hw = t.clip.width * 0.5f;
+            float hh = t.clip.height * 0.5f;
+            float extent = std::max(hw, hh);
+            float cx = x[i];
+            float cy = y[i];
+            if (cx + extent < view.x || cy + extent < view.y || cx - extent > view.x + view.width || cy - extent > view.y + view.height)
+                continue;
+
+            // a new texture ends the current draw call
+            if (t.graph->texture.id != texture)
+            {
+                rlEnd();
+                texture = t.graph->texture.id;
+                rlSetTexture(texture);
+                rlBegin(RL_QUADS);
+                rlNormal3f(0.0f, 0.0f, 1.0f);
+                rlColor4ub(255, 255, 255, 255);
+            }
+
+            float u0 = t.clip.x / t.graph->width;
+            float v0 = t.clip.y / t.graph->height;
+            float u1 = (t.clip.x + t.clip.width) / t.graph->width;
+            float v1 = (t.clip.y + t.clip.height) / t.graph->height;
+
+            float cs = 1;
+            float sn = 0;
+            if (t.rotate)
+            {
+                float speed = sqrtf(vx[i] * vx[i] + vy[i] * vy[i]);
+                if (speed > 0)
+                {
+                    cs = vx[i] / speed;
+                    sn = vy[i] / speed;
+                }
+            }
+            rlTexCoord2f(u0, v0);
+            rlVertex2f(cx - hw * cs + hh * sn, cy - hw * sn - hh * cs);
+            rlTexCoord2f(u0, v1);
+            rlVertex2f(cx - hw * cs - hh * sn, cy - hw * sn + hh * cs);
+            rlTexCoord2f(u1, v1);
+            rlVertex2f(cx + hw * cs - hh * sn, cy + hw * sn + hh * cs);
+            rlTexCoord2f(u1, v0);
+            rlVertex2f(cx + hw * cs + hh * sn, cy + hw * sn - hh * cs);
+        }
+        rlEnd();
+    }
+    rlSetTexture(0);
+}
+
+void ProjectileSystem::debug()
+{
+    Rectangle view = Scene::Instance()->cameraView;
+    for (int i = 0; i < count; i++)
+    {
+        if (CheckCollisionPointRec({x[i], y[i]}, view))
+            DrawCircleLines((int)x[i], (int)y[i], types[type[i]].radius, ORANGE);
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include "Engine.hpp"
+#include <functional>
+
+//*********************************************************************************************************************
+//**                         Projectiles                                                                             **
+//*********************************************************************************************************************
+
+// Bullets without GameObjects: flat arrays stepped at a fixed rate. The scene colliders are put in a grid
+// once per update and every projectile queries its cells. A projectile dies on its first hit or when
+// its life runs out. Hits go to onHit and then stay in a list (getHits) until the next update; the targets
+// can die in the same frame, so the list keeps their ids and target is only set while onHit runs.
+
+struct ProjectileType
+{
+    GraphHandle graph;
+    int graphID;
+    Rectangle clip; // source rect, width 0 = whole graph
+    float radius;   // hit circle
+    int layer;      // drawn with this scene layer
+    bool rotate;    // sprite follows the velocity
+    uint32_t collisionMask; // collision layers it hits
+};
+
+struct ProjectileHit
+{
+    unsigned int projectile; // id returned by fire
+    int type;
+    int tag;
+    GameObject *target;     // inside onHit only, nullptr in getHits
+    unsigned long targetID; // GameObject id
+    Vector2 point;
+    Vector2 velocity;
+};
+
+class ProjectileSystem
+{
+public:
+    static ProjectileSystem &Instance()
+    {
+        static ProjectileSystem instance;
+        return instance;
+    }
+
+    int addType(int graphID, const Rectangle &clip, float radius, int layer, bool rotate = true);
+    ProjectileType *getType(int type);
+
+    // pool size, grows by itself when full
+    void reserve(int capacity);
+    // owner (GameObject id) is never hit by its own projectiles, returns the projectile id
+    unsigned int fire(int type, float x, float y, float vx, float vy, float life, unsigned long owner = 0, int tag = 0);
+    void clear();
+
+    // called by the Scene
+    void update(float deltaTime);
+    void draw(int layer);
+    void debug();
+
+    int getCount() const { return count; }
+    const std::vector<ProjectileHit> &getHits() const { return hits; }
+
+    std::function<void(const ProjectileHit &)> onHit;
+    float step;     // fixed step, seconds
+    int maxSteps;   // per update, the rest is dropped
+    float cellSize; // collider grid
+    Rectangle area; // projectiles outside die, width 0 = no limit
+
+private:
+    ProjectileSystem();
+
+    struct Shape
+    {
+        Rectangle box; // world bound
+        Vector2 center;
+        float radius; // 0 = box
+        int oriented; // into rotated, -1 = not rotated
+        uint32_t category;
+        GameObject *object;
+    };
+
+    void gather();
+    void integrate(float dt);
+    void collide();
+    void compact();
+    void grow(int capacity);
+
+    std::vector<ProjectileType> types;
+
+    // SoA, capacity entries each
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> life;
+    std::vector<int> type;
+    std::vector<int> tag;
+    std::vector<unsigned long> owner;
+    std::vector<unsigned int> ids;
+    int count;
+    int capacity;
+    unsigned int nextID;
+    float accumulator;
+    std::vector<int> layerCount;
+
+    std::vector<Shape> shapes;
+    std::vector<OrientedBox> rotated;
+    std::vector<int> cellStart; // gridColumns * gridRows + 1
+    std::vector<int> cellItems;
+    float gridX;
+    float gridY;
+    float gridCell;
+    int gridColumns;
+    int gridRows;
+
+    std::vector<ProjectileHit> hits;
+};
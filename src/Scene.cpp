@@ -1,5 +1,12 @@
 #include "Scene.hpp"
 #include "Engine.hpp"
+#include "World.hpp"
+#include "Particles.hpp"
+#include "Projectiles.hpp"
+#include "Collision.hpp"
+#include "Pathfinding.hpp"
+#include "Steering.hpp"
+#include "Physics.hpp"
 #include <chrono>
 #include <string>
 #include <sstream>
@@ -32,8 +39,11 @@ Scene::Scene() : lastCheckTime(0), checkInterval(5)
     enableLiveReload = true;
     showDebug = true;
     showStats = true;
+    showAssets = false;
 
     numObjectsRemoved = 0;
+    tileClock = 0;
+    frame = 0;
     currentMode = None;
     selectedObject = nullptr;
     prevMousePos = {0, 0};
@@ -103,6 +113,11 @@ int Scene::addLayers(int count)
 
 void Scene::ClearScene()
 {
+    // the non persistent objects are all queued below, the streamer must not queue them again
+    WorldStreamer::Instance().close(false);
+    ProjectileSystem::Instance().clear();
+    PathFinder::Instance().clear();
+    PhysicsSystem::Instance().clear();
 
     for (int layer = 0; layer < layersCount(); layer++)
     {
@@ -150,6 +165,10 @@ void Scene::ClearScene()
 void Scene::ClearAndFree()
 {
     Log(LOG_INFO, "Clearing and free scene GameObject");
+    WorldStreamer::Instance().close(false);
+    ProjectileSystem::Instance().clear();
+    PathFinder::Instance().clear();
+    PhysicsSystem::Instance().clear();
 
     for (int layer = 0; layer < layersCount(); layer++)
     {
@@ -426,6 +445,7 @@ void Scene::Render()
                 objectRender++;
             }
         }
+        ProjectileSystem::Instance().draw(i);
     }
 
     if (showDebug)
@@ -435,6 +455,8 @@ void Scene::Render()
             if (gameObject->visible && gameObject->active)
                 gameObject->Debug();
         }
+        ProjectileSystem::Instance().debug();
+        PhysicsSystem::Instance().debug();
     }
 
     if (timer.isPaused())
@@ -502,20 +524,45 @@ void Scene::Render()
         float y = 18;
         float s = 18;
 
-        DrawRectangle(10, 10, 220, 100, BLACK);
-        DrawRectangle(10, 10, 220, 100, Fade(SKYBLUE, 0.5f));
-        DrawRectangleLines(10, 10, 220, 100, BLUE);
+        DrawRectangle(10, 10, 220, 118, BLACK);
+        DrawRectangle(10, 10, 220, 118, Fade(SKYBLUE, 0.5f));
+        DrawRectangleLines(10, 10, 220, 118, BLUE);
 
         DrawFPS(x, y);
         DrawText(TextFormat("Objects: %i/%d", gameObjects.size(),objectRender), x, y + 1 * s, s, LIME);
         DrawText(TextFormat("Elapsed time: %.2f", timer.getElapsedTime()), x, y + 2 * s, s, LIME);
         DrawText(TextFormat("Delta time: %.2f", timer.getDeltaTime()), x, y + 3 * s, s, LIME);
+        DrawText(TextFormat("Textures: %.1f/%.0f MB", memoryInMB(Assets::Instance().getMemoryUsed()), memoryInMB(Assets::Instance().getBudget())), x, y + 4 * s, s, LIME);
             //  DrawText(TextFormat("View: %f %f %f %f", cameraView.x,cameraView.y,cameraView.width,cameraView.height), x, y + 5 * s, s, LIME);
      //   DrawText(TextFormat("Camera: %f %f %f %f", camera.target.x,camera.target.y,camera.offset.x,camera.offset.y), x, y + 6 * s, s, LIME);
 
 
 
     }
+
+    if (showAssets)
+    {
+        // per graph memory, biggest first
+        std::vector<Graph *> graphs;
+        for (auto &it : Assets::Instance().graphs)
+        {
+            graphs.push_back(it.second);
+        }
+        std::sort(graphs.begin(), graphs.end(), [](const Graph *a, const Graph *b)
+                  { return a->memory > b->memory; });
+
+        int count = std::min((int)graphs.size(), 30);
+        int x = GetScreenWidth() - 340;
+        int y = 100;
+        DrawRectangle(x - 5, y - 5, 335, count * 14 + 10, Fade(BLACK, 0.7f));
+        DrawRectangleLines(x - 5, y - 5, 335, count * 14 + 10, BLUE);
+        for (int i = 0; i < count; i++)
+        {
+            Graph *graph = graphs[i];
+            DrawText(TextFormat("%-20s %4dx%-4d %8.1f KB  refs %d", graph->key.c_str(), graph->width, graph->height, memoryInKB(graph->memory), graph->refCount),
+                     x, y + i * 14, 10, graph->resident ? LIME : GRAY);
+        }
+    }
 }
 
 void Scene::LiveReload()
@@ -556,6 +603,7 @@ GameObject *Scene::GetGameObjectByName(const std::string &name)
 void Scene::Update()
 {
     timer.update();
+    frame++;
 
     objectRender=0;
     cameraView.x= (-camera.offset.x/camera.zoom) + camera.target.x - (windowSize.x/2.0f/camera.zoom);
@@ -569,6 +617,11 @@ void Scene::Update()
         showDebug = !showDebug;
     }
 
+    if (IsKeyReleased(KEY_F4))
+    {
+        showAssets = !showAssets;
+    }
+
     if (IsKeyPressed(KEY_P))
     {
         if (selectedObject != nullptr)
@@ -613,6 +666,9 @@ void Scene::Update()
 
     if (!timer.isPaused())
     {
+        // agents and bodies move before the objects so the world transforms pick it up this frame
+        SteeringSystem::Instance().update(timer.getDeltaTime());
+        PhysicsSystem::Instance().update(timer.getDeltaTime());
         for (auto gameObject : gameObjects)
         {
             if (gameObject->alive && gameObject->active)
@@ -625,32 +681,38 @@ void Scene::Update()
                 gameObjectsToRemove.push_back(gameObject);
             }
         }
+        AnimationSystem::Instance().update(timer.getDeltaTime());
+        ParticleSystem::Instance().update(timer.getDeltaTime());
+        ProjectileSystem::Instance().update(timer.getDeltaTime());
+        PathFinder::Instance().update();
+        tileClock += timer.getDeltaTime();
     }
 
   
 
     for (auto gameObject : gameObjectsToRemove)
     {
+        // queued twice (died while its region unloaded): the first one already deleted it
+        auto it = std::find(gameObjects.begin(), gameObjects.end(), gameObject);
+        if (it == gameObjects.end())
+            continue;
+
         int layerKey = gameObject->layer;
         if (layers.find(layerKey) != layers.end())
         {
             std::vector<GameObject *> &objectsInLayer = layers[layerKey];
-            auto it = std::find(objectsInLayer.begin(), objectsInLayer.end(), gameObject);
-            if (it != objectsInLayer.end())
+            auto inLayer = std::find(objectsInLayer.begin(), objectsInLayer.end(), gameObject);
+            if (inLayer != objectsInLayer.end())
             {
-                objectsInLayer.erase(it);
+                objectsInLayer.erase(inLayer);
             }
         }
 
-        auto it = std::find(gameObjects.begin(), gameObjects.end(), gameObject);
-        if (it != gameObjects.end())
-        {
-            gameObject->OnRemove();
-            gameObjects.erase(it);
-            gameObject->scene = nullptr;
-            delete gameObject;
-            gameObject = nullptr;
-        }
+        gameObject->OnRemove();
+        gameObjects.erase(it);
+        gameObject->scene = nullptr;
+        delete gameObject;
+        gameObject = nullptr;
     }
     gameObjectsToRemove.clear();
 
@@ -660,6 +722,7 @@ void Scene::Update()
         AddGameObject(gameObject);
     }
     gameObjectsToAdd.clear();
+    WorldStreamer::Instance().update(cameraView);
     LiveReload();
     if (enableCollisions)
         Collision();
@@ -677,7 +740,7 @@ bool Scene::place_meeting_layer(GameObject *obj, float x, float y, int layer)
 
     for (auto other : layers[layer])
     {
-        if (!other->collidable)
+        if (!other->collidable || !obj->canCollide(other))
             continue;
         if (obj->collideWith(other, x, y))
             return true;
@@ -693,6 +756,8 @@ bool Scene::place_meeting(GameObject *obj, float x, float y, const std::string &
     {
         if ( (!other->collidable) && !inView(other->bound))
             continue;
+        if (!obj->canCollide(other))
+            continue;
 
         if (strcmp(other->name.c_str(), objname.c_str())==0)
         {
@@ -742,7 +807,7 @@ bool Scene::place_free(GameObject *obj, float x, float y)
     for (auto other : gameObjects)
     {
         
-        if ( (other->collidable))
+        if ( (other->collidable) && obj->canCollide(other))
         {
             if (obj->collideWith(other, x, y))
                 return false;
@@ -807,109 +872,54 @@ void Scene::SetCamera(float x, float y)
     // //local targetY = 2 * (WindowHeight/2)- self.y
 }
 
-void Scene::Collision()
+static CollisionSystem &RaySystem(Scene *scene)
 {
-    for (int i = 0; i < (int)gameObjects.size(); i++)
-    {
-        GameObject *a = gameObjects[i];
-        GameObject *parentA = a->parent;
-        if (!a->collidable)
-            continue;
-
-        for (int j = i + 1; j < (int)gameObjects.size(); j++)
-        {
-
-            GameObject *b = gameObjects[j];
-
-            if (!b->collidable)
-                continue;
-
-            if (a == b || b == parentA || a == b->parent)
-            {
-                continue;
-            }
+    CollisionSystem &collision = CollisionSystem::Instance();
+    if (collision.frame != scene->frame)
+        collision.gather(scene->gameObjects);
+    return collision;
+}
 
-            // Log(LOG_INFO, "Collision between %s and %s", a->name.c_str(), b->name.c_str());
+bool Scene::raycast(Vector2 origin, Vector2 direction, float maxDistance, uint32_t mask, RaycastHit &hit)
+{
+    return RaySystem(this).raycast({origin, direction, maxDistance}, mask, hit);
+}
 
-            if (a->HasComponent<BoxColiderComponent>() && b->HasComponent<BoxColiderComponent>())
-            {
-                BoxColiderComponent *colliderA = a->GetComponent<BoxColiderComponent>();
-                BoxColiderComponent *colliderB = b->GetComponent<BoxColiderComponent>();
+int Scene::raycastAll(Vector2 origin, Vector2 direction, float maxDistance, uint32_t mask, std::vector<RaycastHit> &hits)
+{
+    return RaySystem(this).raycastAll({origin, direction, maxDistance}, mask, hits);
+}
 
-                if (colliderA->IsColide(colliderB))
-                {
-                    colliderA->OnColide(colliderB);
-                    colliderB->OnColide(colliderA);
-                    //          Log(LOG_INFO, "Collision between A %s and B %s", a->name.c_str(), b->name.c_str());
-                    return;
-                }
-                if (colliderB->IsColide(colliderA))
-                {
-                    colliderB->OnColide(colliderA);
-                    colliderA->OnColide(colliderB);
-                    //   Log(LOG_INFO, "Collision between B %s and A %s", b->name.c_str(), a->name.c_str());
-                    return;
-                }
-            }
-            else if (a->HasComponent<CircleColiderComponent>() && b->HasComponent<CircleColiderComponent>())
-            {
-                CircleColiderComponent *colliderA = a->GetComponent<CircleColiderComponent>();
-                CircleColiderComponent *colliderB = b->GetComponent<CircleColiderComponent>();
+int Scene::raycastBatch(const std::vector<Ray2D> &rays, uint32_t mask, std::vector<RaycastHit> &hits)
+{
+    CollisionSystem &collision = RaySystem(this);
+    hits.resize(rays.size());
+    int count = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        if (collision.raycast(rays[i], mask, hits[i]))
+            count++;
+        else
+            hits[i].distance = -1;
+    }
+    return count;
+}
 
-                if (colliderA->IsColide(colliderB))
-                {
-                    colliderA->OnColide(colliderB);
-                    colliderB->OnColide(colliderA);
-                    //          Log(LOG_INFO, "Collision between A %s and B %s", a->name.c_str(), b->name.c_str());
-                    return;
-                }
-                if (colliderB->IsColide(colliderA))
-                {
-                    colliderB->OnColide(colliderA);
-                    colliderA->OnColide(colliderB);
-                    //   Log(LOG_INFO, "Collision between B %s and A %s", b->name.c_str(), a->name.c_str());
-                    return;
-                }
-            }
-            else if (a->HasComponent<BoxColiderComponent>() && b->HasComponent<CircleColiderComponent>())
-            {
-                BoxColiderComponent *colliderA = a->GetComponent<BoxColiderComponent>();
-                CircleColiderComponent *colliderB = b->GetComponent<CircleColiderComponent>();
-                if (colliderA->IsColide(colliderB))
-                {
-                    colliderA->OnColide(colliderB);
-                    colliderB->OnColide(colliderA);
-                    //          Log(LOG_INFO, "Collision between A %s and B %s", a->name.c_str(), b->name.c_str());
-                    return;
-                }
-                if (colliderB->IsColide(colliderA))
-                {
-                    colliderB->OnColide(colliderA);
-                    colliderA->OnColide(colliderB);
-                    //   Log(LOG_INFO, "Collision between B %s and A %s", b->name.c_str(), a->name.c_str());
-                    return;
-                }
-            }
-            else if (a->HasComponent<CircleColiderComponent>() && b->HasComponent<BoxColiderComponent>())
-            {
-                CircleColiderComponent *colliderA = a->GetComponent<CircleColiderComponent>();
-                BoxColiderComponent *colliderB = b->GetComponent<BoxColiderComponent>();
-                if (colliderA->IsColide(colliderB))
-                {
-                    colliderA->OnColide(colliderB);
-                    colliderB->OnColide(colliderA);
-                    //          Log(LOG_INFO, "Collision between A %s and B %s", a->name.c_str(), b->name.c_str());
-                    return;
-                }
-                if (colliderB->IsColide(colliderA))
-                {
-                    colliderB->OnColide(colliderA);
-                    colliderA->OnColide(colliderB);
-                    //   Log(LOG_INFO, "Collision between B %s and A %s", b->name.c_str(), a->name.c_str());
-                    return;
-                }
-            }
-        }
+void Scene::Collision()
+{
+    CollisionSystem &collision = CollisionSystem::Instance();
+    collision.gather(gameObjects);
+    collision.pairs.clear();
+    collision.contacts.clear();
+    collision.sweep(collision.pairs);
+    collision.test(collision.pairs, collision.contacts);
+
+    for (const Contact &contact : collision.contacts)
+    {
+        ColideComponent *colliderA = collision.getCollider(contact.a);
+        ColideComponent *colliderB = collision.getCollider(contact.b);
+        colliderA->OnColide(colliderB);
+        colliderB->OnColide(colliderA);
     }
 }
 
@@ -947,7 +957,11 @@ bool BoxColiderComponent::IsColide(ColideComponent *other)
     else if (other->type == ColliderType::Circle)
     {
         CircleColiderComponent *circle = (CircleColiderComponent *)other;
-        return CheckCollisionCircleRec(circle->center, circle->radius, GetWorldRect());
+        return CheckCollisionCircleRec(circle->GetWorldPosition(), circle->radius, GetWorldRect());
+    }
+    else if (other->type == ColliderType::Oriented)
+    {
+        return other->IsColide(this);
     }
     return false;
 }
@@ -986,6 +1000,10 @@ bool CircleColiderComponent::IsColide(ColideComponent *other)
         CircleColiderComponent *circle = (CircleColiderComponent *)other;
         return CheckCollisionCircles(GetWorldPosition(), radius, circle->GetWorldPosition(), circle->radius);
     }
+    else if (other->type == ColliderType::Oriented)
+    {
+        return other->IsColide(this);
+    }
     return false;
 }
 
@@ -1002,6 +1020,67 @@ void CircleColiderComponent::OnDebug()
     DrawCircleLines(p.x, p.y, radius, RED);
 }
 
+const OrientedBox &OrientedColiderComponent::GetWorldBox()
+{
+    // from the current transform, anything that moved it earlier in the frame is seen
+    world.set(object->transform->GetWorldTransformation(), rect);
+    return world;
+}
+
+Vector2 OrientedColiderComponent::GetWorldPosition()
+{
+    return GetWorldBox().center;
+}
+
+bool OrientedColiderComponent::IsColide(ColideComponent *other)
+{
+    const OrientedBox &box = GetWorldBox();
+    if (other->type == ColliderType::Oriented)
+    {
+        return OverlapOrientedBoxes(box, ((OrientedColiderComponent *)other)->GetWorldBox(), nullptr, nullptr);
+    }
+    else if (other->type == ColliderType::Box)
+    {
+        OrientedBox rect;
+        rect.set(((BoxColiderComponent *)other)->GetWorldRect());
+        return OverlapOrientedBoxes(box, rect, nullptr, nullptr);
+    }
+    else if (other->type == ColliderType::Circle)
+    {
+        CircleColiderComponent *circle = (CircleColiderComponent *)other;
+        return OverlapOrientedBoxCircle(box, circle->GetWorldPosition(), circle->radius, nullptr, nullptr);
+    }
+    return false;
+}
+
+void OrientedColiderComponent::OnColide(ColideComponent *other)
+{
+    other->object->OnCollision(this->object);
+    object->OnCollision(other->object);
+}
+
+void OrientedColiderComponent::OnDebug()
+{
+    const OrientedBox &box = GetWorldBox();
+    Vector2 c = box.center;
+    Vector2 p[4] = {{c.x - box.u.x - box.v.x, c.y - box.u.y - box.v.y},
+                    {c.x + box.u.x - box.v.x, c.y + box.u.y - box.v.y},
+                    {c.x + box.u.x + box.v.x, c.y + box.u.y + box.v.y},
+                    {c.x - box.u.x + box.v.x, c.y - box.u.y + box.v.y}};
+    for (int i = 0; i < 4; i++)
+    {
+        DrawLineEx(p[i], p[(i + 1) % 4], 2, LIME);
+    }
+}
+
+void OrientedColiderComponent::OnInit()
+{
+    if (object)
+    {
+        object->collidable = true;
+    }
+}
+
 void CircleColiderComponent::OnInit()
 {
     if (object)
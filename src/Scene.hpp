@@ -10,6 +10,8 @@
 class GameObject;
 class SpriteComponent;
 class TransformComponent;
+struct Ray2D;
+struct RaycastHit;
 
 class QuadtreeNode
 {
@@ -131,6 +133,12 @@ public:
     bool place_meeting_layer(GameObject *obj, float x, float y, int layer);
     bool place_free(GameObject *obj, float x, float y);
 
+    // rays over colliders and tile layers, mask = collision layers, the shapes are gathered once per frame
+    bool raycast(Vector2 origin, Vector2 direction, float maxDistance, uint32_t mask, RaycastHit &hit);
+    int raycastAll(Vector2 origin, Vector2 direction, float maxDistance, uint32_t mask, std::vector<RaycastHit> &hits);
+    // hits[i] is ray i (distance -1 = no hit), returns the hit count
+    int raycastBatch(const std::vector<Ray2D> &rays, uint32_t mask, std::vector<RaycastHit> &hits);
+
     std::vector<GameObject *> gameObjects;
     std::vector<GameObject *> gameObjectsToRemove;
     std::vector<GameObject *> gameObjectsToAdd;
@@ -145,6 +153,7 @@ public:
     bool showDebug;
     bool enableEditor;
     bool showStats;
+    bool showAssets;
     int objectRender;
     
  
@@ -153,6 +162,8 @@ public:
     Rectangle cameraView;
     Vector2   cameraPoint; 
     Timer timer;
+    double tileClock; // animated tiles, stops with the timer
+    unsigned long frame; // Update calls
     std::time_t lastCheckTime;
     std::time_t checkInterval;
     TransformMode currentMode;
@@ -0,0 +1,386 @@
+#include "Steering.hpp"
+#include <cfloat>
+#include <cmath>
+
+#if !defined(STEERING_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define STEERING_SSE
+#endif
+
+//*********************************************************************************************************************
+//**                         SteeringComponent                                                                       **
+//*********************************************************************************************************************
+
+static uint32_t steeringSeeds = 2463534242u;
+
+SteeringComponent::SteeringComponent(float maxSpeed, float maxForce)
+    : seekWeight(0), fleeWeight(0), arriveWeight(0), wanderWeight(0), separationWeight(0), alignmentWeight(0), cohesionWeight(0),
+      target({0, 0}), slowRadius(100), panicRadius(0), neighbourRadius(50), separationRadius(25),
+      wanderRadius(20), wanderDistance(40), wanderJitter(4), group(0),
+      maxSpeed(maxSpeed), maxForce(maxForce), face(false), velocity({0, 0}), wanderAngle(0), slot(-1)
+{
+    steeringSeeds += 0x9E3779B9u;
+    seed = steeringSeeds | 1;
+}
+
+SteeringComponent::~SteeringComponent()
+{
+    if (slot >= 0)
+        SteeringSystem::Instance().remove(slot);
+}
+
+void SteeringComponent::OnInit()
+{
+    if (slot < 0)
+        slot = SteeringSystem::Instance().add(this);
+}
+
+void SteeringComponent::OnDebug()
+{
+    Vec2 p = object->GetWorldPoint(0, 0);
+    DrawLine((int)p.x, (int)p.y, (int)(p.x + velocity.x * 0.25f), (int)(p.y + velocity.y * 0.25f), YELLOW);
+    if (neighbourRadius > 0 && (alignmentWeight != 0 || cohesionWeight != 0))
+        DrawCircleLines((int)p.x, (int)p.y, neighbourRadius, DARKGRAY);
+}
+
+//*********************************************************************************************************************
+//**                         SteeringSystem                                                                          **
+//*********************************************************************************************************************
+
+SteeringSystem::SteeringSystem() : cellSize(0), tableSize(0), cell(1)
+{
+}
+
+int SteeringSystem::add(SteeringComponent *agent)
+{
+    agents.push_back(agent);
+    return (int)agents.size() - 1;
+}
+
+void SteeringSystem::remove(int slot)
+{
+    if (slot < 0 || slot >= (int)agents.size())
+        return;
+    agents[slot] = agents.back();
+    agents[slot]->slot = slot;
+    agents.pop_back();
+}
+
+int SteeringSystem::bucket(int cx, int cy) const
+{
+    return (int)(((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & (unsigned int)(tableSize - 1));
+}
+
+void SteeringSystem::gather()
+{
+    live.clear();
+    float radius = 0;
+    for (int i = 0; i < (int)agents.size(); i++)
+    {
+        SteeringComponent *agent = agents[i];
+        GameObject *object = agent->object;
+        if (!object || !object->alive || !object->active)
+            continue;
+        live.push_back(i);
+        radius = std::max(radius, std::max(agent->neighbourRadius, agent->separationRadius));
+    }
+    cell = std::max(std::max(cellSize, radius), 1.0f);
+}
+
+// counting sort by hash bucket, the agents of a cell end next to each other
+void SteeringSystem::hash()
+{
+    int count = (int)live.size();
+    tableSize = 64;
+    while (tableSize < count * 2)
+        tableSize <<= 1;
+
+    cellStart.assign(tableSize + 1, 0);
+    cellOf.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        const Vec2 &p = agents[live[i]]->object->transform->position;
+        cellOf[i] = bucket((int)floorf(p.x / cell), (int)floorf(p.y / cell));
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (int b = 0; b < tableSize; b++)
+    {
+        cellStart[b + 1] += cellStart[b];
+    }
+
+    cursor.assign(cellStart.begin(), cellStart.end() - 1);
+    sorted.resize(count);
+    x.resize(count);
+    y.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    group.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        SteeringComponent *agent = agents[live[i]];
+        int at = cursor[cellOf[i]]++;
+        sorted[at] = live[i];
+        x[at] = agent->object->transform->position.x;
+        y[at] = agent->object->transform->position.y;
+        vx[at] = agent->velocity.x;
+        vy[at] = agent->velocity.y;
+        group[at] = agent->group;
+    }
+    live.swap(sorted);
+
+    separateX.assign(count, 0);
+    separateY.assign(count, 0);
+    alignX.assign(count, 0);
+    alignY.assign(count, 0);
+    centerX.assign(count, 0);
+    centerY.assign(count, 0);
+    near.assign(count, 0);
+}
+
+void SteeringSystem::neighbours(int i)
+{
+    const SteeringComponent *agent = agents[live[i]];
+    bool flock = agent->alignmentWeight != 0 || agent->cohesionWeight != 0;
+    bool separate = agent->separationWeight != 0;
+    if (!flock && !separate)
+        return;
+
+    const float xi = x[i];
+    const float yi = y[i];
+    const int gi = group[i];
+    const float nearRadius = flock ? agent->neighbourRadius * agent->neighbourRadius : 0;
+    const float closeRadius = separate ? agent->separationRadius * agent->separationRadius : 0;
+    const float *px = x.data();
+    const float *py = y.data();
+    const float *pvx = vx.data();
+    const float *pvy = vy.data();
+    const int *pg = group.data();
+
+    float sx = 0, sy = 0, ax = 0, ay = 0, cx = 0, cy = 0, n = 0;
+#ifdef STEERING_SSE
+    const __m128 vxi = _mm_set1_ps(xi);
+    const __m128 vyi = _mm_set1_ps(yi);
+    const __m128 vnear = _mm_set1_ps(nearRadius);
+    const __m128 vclose = _mm_set1_ps(closeRadius);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 tiny = _mm_set1_ps(1e-6f);
+    const __m128i vg = _mm_set1_epi32(gi);
+    __m128 vsx = zero, vsy = zero, vax = zero, vay = zero, vcx = zero, vcy = zero, vn = zero;
+#endif
+
+    // the 3x3 cells around, a bucket shared by two cells is walked once
+    int ci = (int)floorf(xi / cell);
+    int cj = (int)floorf(yi / cell);
+    int seen[9];
+    int walked = 0;
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        for (int dx = -1; dx <= 1; dx++)
+        {
+            int b = bucket(ci + dx, cj + dy);
+            bool twice = false;
+            for (int k = 0; k < walked; k++)
+            {
+                twice = twice || seen[k] == b;
+            }
+            if (twice)
+                continue;
+            seen[walked++] = b;
+
+            int j = cellStart[b];
+            int end = cellStart[b + 1];
+#ifdef STEERING_SSE
+            for (; j + 4 <= end; j += 4)
+            {
+                __m128 ox = _mm_sub_ps(_mm_loadu_ps(px + j), vxi);
+                __m128 oy = _mm_sub_ps(_mm_loadu_ps(py + j), vyi);
+                __m128 d2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy));
+                __m128 same = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(pg + j)), vg));
+                __m128 valid = _mm_and_ps(same, _mm_cmpgt_ps(d2, zero));
+                __m128 inNear = _mm_and_ps(valid, _mm_cmplt_ps(d2, vnear));
+                __m128 inClose = _mm_and_ps(valid, _mm_cmplt_ps(d2, vclose));
+                __m128 inv = _mm_div_ps(one, _mm_max_ps(d2, tiny));
+                vax = _mm_add_ps(vax, _mm_and_ps(inNear, _mm_loadu_ps(pvx + j)));
+                vay = _mm_add_ps(vay, _mm_and_ps(inNear, _mm_loadu_ps(pvy + j)));
+                vcx = _mm_add_ps(vcx, _mm_and_ps(inNear, ox));
+                vcy = _mm_add_ps(vcy, _mm_and_ps(inNear, oy));
+                vn = _mm_add_ps(vn, _mm_and_ps(inNear, one));
+                vsx = _mm_sub_ps(vsx, _mm_and_ps(inClose, _mm_mul_ps(ox, inv)));
+                vsy = _mm_sub_ps(vsy, _mm_and_ps(inClose, _mm_mul_ps(oy, inv)));
+            }
+#endif
+            for (; j < end; j++)
+            {
+                if (pg[j] != gi)
+                    continue;
+                float ox = px[j] - xi;
+                float oy = py[j] - yi;
+                float d2 = ox * ox + oy * oy;
+                if (d2 <= 0)
+                    continue;
+                if (d2 < nearRadius)
+                {
+                    ax += pvx[j];
+                    ay += pvy[j];
+                    cx += ox;
+                    cy += oy;
+                    n += 1;
+                }
+                if (d2 < closeRadius)
+                {
+                    // away from the neighbour, stronger when closer
+                    sx -= ox / d2;
+                    sy -= oy / d2;
+                }
+            }
+        }
+    }
+
+#ifdef STEERING_SSE
+    float lanes[4];
+    _mm_storeu_ps(lanes, vsx);
+    sx += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vsy);
+    sy += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vax);
+    ax += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vay);
+    ay += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vcx);
+    cx += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vcy);
+    cy += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vn);
+    n += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+    separateX[i] = sx;
+    separateY[i] = sy;
+    alignX[i] = ax;
+    alignY[i] = ay;
+    centerX[i] = cx;
+    centerY[i] = cy;
+    near[i] = n;
+}
+
+void SteeringSystem::steer(int i, float dt)
+{
+    SteeringComponent *agent = agents[live[i]];
+    const float px = x[i];
+    const float py = y[i];
+    float u = vx[i];
+    float v = vy[i];
+    const float maxSpeed = agent->maxSpeed;
+    float fx = 0;
+    float fy = 0;
+
+    // steering force = desired velocity - velocity
+    auto desire = [&](float dx, float dy, float speed, float weight)
+    {
+        float length = sqrtf(dx * dx + dy * dy);
+        if (length <= 0)
+            return;
+        fx += weight * (dx / length * speed - u);
+        fy += weight * (dy / length * speed - v);
+    };
+
+    float tx = agent->target.x - px;
+    float ty = agent->target.y - py;
+    if (agent->seekWeight != 0)
+        desire(tx, ty, maxSpeed, agent->seekWeight);
+    if (agent->fleeWeight != 0 && (agent->panicRadius <= 0 || tx * tx + ty * ty < agent->panicRadius * agent->panicRadius))
+        desire(-tx, -ty, maxSpeed, agent->fleeWeight);
+    if (agent->arriveWeight != 0)
+    {
+        float distance = sqrtf(tx * tx + ty * ty);
+        if (distance > 0)
+            desire(tx, ty, distance < agent->slowRadius ? maxSpeed * distance / agent->slowRadius : maxSpeed, agent->arriveWeight);
+        else
+        {
+            fx -= agent->arriveWeight * u;
+            fy -= agent->arriveWeight * v;
+        }
+    }
+    if (agent->wanderWeight != 0)
+    {
+        // xorshift, a point on a circle ahead that drifts a little every step
+        uint32_t s = agent->seed;
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        agent->seed = s;
+        agent->wanderAngle += ((s & 0xFFFFFF) / 8388607.5f - 1.0f) * agent->wanderJitter * dt;
+        float speed = sqrtf(u * u + v * v);
+        float hx = speed > 0 ? u / speed : 1.0f;
+        float hy = speed > 0 ? v / speed : 0.0f;
+        desire(hx * agent->wanderDistance + cosf(agent->wanderAngle) * agent->wanderRadius,
+               hy * agent->wanderDistance + sinf(agent->wanderAngle) * agent->wanderRadius, maxSpeed, agent->wanderWeight);
+    }
+    if (agent->separationWeight != 0)
+        desire(separateX[i], separateY[i], maxSpeed, agent->separationWeight);
+    if (near[i] > 0)
+    {
+        // sums point the same way as the averages
+        if (agent->alignmentWeight != 0)
+            desire(alignX[i], alignY[i], maxSpeed, agent->alignmentWeight);
+        if (agent->cohesionWeight != 0)
+            desire(centerX[i], centerY[i], maxSpeed, agent->cohesionWeight);
+    }
+
+    float force = sqrtf(fx * fx + fy * fy);
+    if (force > agent->maxForce && force > 0)
+    {
+        fx *= agent->maxForce / force;
+        fy *= agent->maxForce / force;
+    }
+    u += fx * dt;
+    v += fy * dt;
+    float speed = sqrtf(u * u + v * v);
+    if (speed > maxSpeed && speed > 0)
+    {
+        u *= maxSpeed / speed;
+        v *= maxSpeed / speed;
+    }
+    vx[i] = u;
+    vy[i] = v;
+    x[i] = px + u * dt;
+    y[i] = py + v * dt;
+}
+
+void SteeringSystem::scatter()
+{
+    for (int i = 0; i < (int)live.size(); i++)
+    {
+        SteeringComponent *agent = agents[live[i]];
+        TransformComponent *transform = agent->object->transform;
+        agent->velocity = {vx[i], vy[i]};
+        transform->position.x = x[i];
+        transform->position.y = y[i];
+        if (agent->face && (vx[i] != 0 || vy[i] != 0))
+            transform->rotation = getAngle(0, 0, vx[i], vy[i]);
+    }
+}
+
+void SteeringSystem::update(float deltaTime)
+{
+    if (agents.empty() || deltaTime <= 0)
+        return;
+
+    gather();
+    if (live.empty())
+        return;
+    hash();
+
+    // every sum reads the old positions, the moves come after
+    int count = (int)live.size();
+    for (int i = 0; i < count; i++)
+    {
+        neighbours(i);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        steer(i, deltaTime);
+    }
+    scatter();
+}
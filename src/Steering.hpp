@@ -0,0 +1,115 @@
+#pragma once
+#include "Engine.hpp"
+
+//*********************************************************************************************************************
+//**                         Steering                                                                                **
+//*********************************************************************************************************************
+
+// Steering agents are GameObjects with a SteeringComponent, moved all at once by the SteeringSystem:
+// positions and velocities are copied to SoA arrays sorted by the cells of a spatial hash, the neighbour
+// sums of the flock are accumulated 4 neighbours at a time (SSE, STEERING_NO_SIMD forces the scalar path)
+// and the new positions go back to the transforms in one pass, before the objects update.
+// Agents move in their parent space.
+
+class SteeringComponent : public Component
+{
+public:
+    SteeringComponent(float maxSpeed, float maxForce);
+    ~SteeringComponent();
+
+    void OnInit() override;
+    void OnDebug() override;
+
+    // behaviours, a weight of 0 turns it off
+    float seekWeight;
+    float fleeWeight;
+    float arriveWeight;
+    float wanderWeight;
+    float separationWeight;
+    float alignmentWeight;
+    float cohesionWeight;
+
+    Vector2 target;          // seek, flee and arrive
+    float slowRadius;        // arrive
+    float panicRadius;       // flee, 0 = always
+    float neighbourRadius;   // alignment and cohesion
+    float separationRadius;
+    float wanderRadius;      // circle ahead of the agent
+    float wanderDistance;
+    float wanderJitter;      // radians per second
+    int group;               // flocks only with the same group
+
+    float maxSpeed; // pixels per second
+    float maxForce; // pixels per second^2
+    bool face;      // rotation follows the velocity
+    Vector2 velocity;
+
+    void setFlock(float separation, float alignment, float cohesion)
+    {
+        separationWeight = separation;
+        alignmentWeight = alignment;
+        cohesionWeight = cohesion;
+    }
+
+private:
+    friend class SteeringSystem;
+
+    float wanderAngle;
+    uint32_t seed;
+    int slot;
+};
+
+class SteeringSystem
+{
+public:
+    static SteeringSystem &Instance()
+    {
+        static SteeringSystem instance;
+        return instance;
+    }
+
+    int add(SteeringComponent *agent);
+    void remove(int slot);
+
+    // called by the Scene
+    void update(float deltaTime);
+    int getCount() const { return (int)agents.size(); }
+
+    float cellSize; // spatial hash, never less than the largest neighbour radius
+
+private:
+    SteeringSystem();
+
+    void gather();
+    void hash();
+    void neighbours(int i);
+    void steer(int i, float dt);
+    void scatter();
+    int bucket(int cx, int cy) const;
+
+    std::vector<SteeringComponent *> agents;
+    std::vector<int> live;   // agents slots moved this update, in cell order after hash
+    std::vector<int> sorted;
+
+    // SoA, in cell order
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<int> group;
+
+    // neighbour sums
+    std::vector<float> separateX;
+    std::vector<float> separateY;
+    std::vector<float> alignX;
+    std::vector<float> alignY;
+    std::vector<float> centerX; // offsets to the neighbours
+    std::vector<float> centerY;
+    std::vector<float> near;
+
+    std::vector<int> cellStart; // tableSize + 1
+    std::vector<int> cellOf;
+    std::vector<int> cursor;
+    int tableSize;
+    float cell;
+};
@@ -1,25 +1,40 @@
 #include "Engine.hpp"
 #include "Scene.hpp"
+#include "Pathfinding.hpp"
 #include <string>
-#include <sstream>
-TileLayerComponent::TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, const std::string &fileName) : tileWidth(tileWidth), tileHeight(tileHeight), spacing(spacing), margin(margin), width(width), height(height)
+TileLayerComponent::TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, const std::string &fileName)
+    : TileLayerComponent(width, height, tileWidth, tileHeight, spacing, margin, Assets::Instance().getGraphID(fileName))
+{
+}
+
+TileLayerComponent::TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, GraphKey key)
+    : TileLayerComponent(width, height, tileWidth, tileHeight, spacing, margin, Assets::Instance().getGraphID(key))
+{
+}
+
+TileLayerComponent::TileLayerComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, int graphID) : tileWidth(tileWidth), tileHeight(tileHeight), spacing(spacing), margin(margin), width(width), height(height)
 {
 
-    graph = Assets::Instance().getGraph(fileName.c_str());
+    graph = Assets::Instance().getGraph(graphID);
     if (!graph)
     {
-        Log(LOG_ERROR, "TileLayerComponent::TileLayerComponent  %s ", fileName.c_str());
+        Log(LOG_ERROR, "TileLayerComponent::TileLayerComponent  %s ", Assets::Instance().getGraphName(graphID).c_str());
         isLoad = false;
     }
     isLoad = true;
-    graphID = fileName;
+    tileset = nullptr;
+    navGrid = nullptr;
+    offset = {0, 0};
+    this->graphID = graphID;
     worldWidth = width * tileWidth;
     worldHeight = height * tileHeight;
-    // tileMap.reserve(width * height + 1);
-    for (int i = 0; i < width * height; i++)
-    {
-        tileMap.push_back(-1);
-    }
+    tileMap.create(width, height);
+}
+
+TileLayerComponent::~TileLayerComponent()
+{
+    if (navGrid)
+        navGrid->detach();
 }
 
 
@@ -61,8 +76,8 @@ void TileLayerComponent::OnInit()
             object->originY=0;
             object->width=width*tileWidth;
             object->height=height*tileHeight;
-            object->bound.x=0;
-            object->bound.y=0;
+            object->bound.x=offset.x;
+            object->bound.y=offset.y;
             object->bound.width=width*tileWidth;
             object->bound.height=height*tileHeight;
            // object->setDebug( SHOW_BOX |  SHOW_BOUND );
@@ -76,7 +91,7 @@ void TileLayerComponent::OnDebug()
     if (!isLoad)
         return;
 
-    DrawRectangle(0,0,width*tileWidth,height*tileHeight, RED);
+    DrawRectangle((int)offset.x,(int)offset.y,width*tileWidth,height*tileHeight, RED);
 }
 
 void TileLayerComponent::OnDraw()
@@ -93,6 +108,13 @@ void TileLayerComponent::OnDraw()
 
     Scene *scene = Scene::Instance();
 
+    // one table update for every animated tile of the tileset (other layers sharing it skip)
+    const Tileset *animated = nullptr;
+    if (tileset && tileset->isAnimated())
+    {
+        tileset->update(scene->tileClock);
+        animated = tileset;
+    }
 
     // auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -101,47 +123,63 @@ void TileLayerComponent::OnDraw()
 
 //loop in view
 float zoom = scene->camera.zoom;
-Vector2 offset = scene->camera.offset;
+Vector2 camOffset = scene->camera.offset;
 Vector2 target = scene->camera.target;
 Rectangle cameraView = {
-    -offset.x/zoom + target.x - (scene->windowSize.x/2.0f/zoom),
-    -offset.y/zoom + target.y - (scene->windowSize.y/2.0f/zoom),
-    (float)scene->windowSize.x/zoom + (offset.x/zoom),
-    (float)scene->windowSize.y/zoom + (offset.y/zoom)
+    -camOffset.x/zoom + target.x - (scene->windowSize.x/2.0f/zoom),
+    -camOffset.y/zoom + target.y - (scene->windowSize.y/2.0f/zoom),
+    (float)scene->windowSize.x/zoom + (camOffset.x/zoom),
+    (float)scene->windowSize.y/zoom + (camOffset.y/zoom)
 };
 
-int startX = (int)(cameraView.x / tileWidth);
-int startY = (int)(cameraView.y / tileHeight);
-int endX = (int)((cameraView.x + cameraView.width) / tileWidth) + 1;
-int endY = (int)((cameraView.y + cameraView.height) / tileHeight) + 1;
+int startX = (int)floorf((cameraView.x - offset.x) / tileWidth);
+int startY = (int)floorf((cameraView.y - offset.y) / tileHeight);
+int endX = (int)((cameraView.x + cameraView.width - offset.x) / tileWidth) + 1;
+int endY = (int)((cameraView.y + cameraView.height - offset.y) / tileHeight) + 1;
 
     startX = Clamp(startX, 0, width);
     startY = Clamp(startY, 0, height);
     endX = Clamp(endX, 0, width);
     endY = Clamp(endY, 0, height);
 
-    for (int i = startY; i < endY; i++)
+    // only the chunks in view, the empty ones are skipped whole
+    const int SHIFT = TileChunks::SHIFT;
+    for (int row = startY >> SHIFT; startX < endX && row <= (endY - 1) >> SHIFT; row++)
     {
-        for (int j = startX; j < endX; j++)
+        for (int column = startX >> SHIFT; column <= (endX - 1) >> SHIFT; column++)
         {
-            float posX = (float)(j * tileWidth);
-            float posY = (float)(i * tileHeight);
-            Rectangle tileRect = {posX, posY, tileWidth, tileHeight};
-            if (!scene->inView(tileRect))
-                    continue;
-
-            int tile = getTile(j, i);
-            if (tile != -1)
+            const TileChunk &chunk = tileMap.getChunk(column, row);
+            if (tileMap.isEmpty(chunk))
+                continue;
+
+            int x0 = std::max(startX, column << SHIFT);
+            int y0 = std::max(startY, row << SHIFT);
+            int x1 = std::min(endX, (column + 1) << SHIFT);
+            int y1 = std::min(endY, (row + 1) << SHIFT);
+            for (int i = y0; i < y1; i++)
             {
-
-                RenderTile(graph->texture,
-                           posX, posY,
-                           tileWidth, tileHeight,
-                           getClip(tile),
-                           false, false, 0);
-                    
+                for (int j = x0; j < x1; j++)
+                {
+                    float posX = offset.x + (float)(j * tileWidth);
+                    float posY = offset.y + (float)(i * tileHeight);
+                    Rectangle tileRect = {posX, posY, tileWidth, tileHeight};
+                    if (!scene->inView(tileRect))
+                        continue;
+
+                    int tile = tileMap.getTile(chunk, j & TileChunks::MASK, i & TileChunks::MASK);
+                    if (tile != -1)
+                    {
+                        if (animated)
+                            tile = animated->map(tile);
+
+                        RenderTile(graph->texture,
+                                   posX, posY,
+                                   tileWidth, tileHeight,
+                                   getClip(tile),
+                                   false, false, 0);
+                    }
+                }
             }
-            // 736
         }
     }
 //  auto endTime = std::chrono::high_resolution_clock::now();
@@ -197,119 +235,78 @@ int endY = (int)((cameraView.y + cameraView.height) / tileHeight) + 1;
 
 void TileLayerComponent::loadFromArray(const int *tiles)
 {
-    tileMap.clear();
-    int arraSize = (tileWidth * tileHeight);
-    for (int i = 0; i < arraSize; i++)
-    {
-        tileMap.push_back(tiles[i]);
-    }
+    tileMap.assign(tiles, width, height);
+    if (navGrid)
+        navGrid->refresh();
 }
 void TileLayerComponent::loadFromCSVFile(const std::string &filename)
 {
-    //    m_tileMap.clear();
-    //    std::string tmp;
-    //    char delim = ','; // Ddefine the delimiter to split by
-    //    std::ifstream myFile(filename);
-    //    std::getline(myFile,tmp,delim);
-    //    while (std::getline(myFile,tmp,delim))
-    //   {
-    //      int index = std::stoi(tmp);
-    //      m_tileMap.push_back(index);
-    //    }
-
-    if (!FileInPath(filename))
+    FileBuffer file;
+    if (!FileSystem::Instance().load(filename, file))
     {
         Log(LOG_ERROR, "The file  %s dont exists ", filename.c_str());
         return;
     }
-    std::string path = GetPath(filename);
-    char *text = LoadFileText(path.c_str());
-
-    if (text == nullptr)
-    {
-        Log(LOG_ERROR, " Reading  %s", filename.c_str());
-        return;
-    }
-
-    std::istringstream file(text);
-    tileMap.clear();
-    tileMap.reserve(width * height);
-
-    std::string line;
-    while (std::getline(file, line))
-    {
-        std::istringstream lineStream(line);
-        std::string cell;
-        while (std::getline(lineStream, cell, ','))
-        {
-            int tile = std::stoi(cell);
-            tileMap.push_back(tile);
-        }
-    }
-
-    UnloadFileText(text);
+    std::vector<int> tiles;
+    ParseTileCSV(file.text(), file.size, 0, tiles);
+    tiles.resize((size_t)width * height, -1);
+    tileMap.assign(tiles.data(), width, height);
+    if (navGrid)
+        navGrid->refresh();
 }
 
 void TileLayerComponent::loadFromString(const std::string &text,int shift)
 {
-    std::istringstream file(text);
-    tileMap.clear();
-    tileMap.reserve(width * height);
+    std::vector<int> tiles;
+    ParseTileCSV(text.data(), text.size(), shift, tiles);
+    tiles.resize((size_t)width * height, -1);
+    tileMap.assign(tiles.data(), width, height);
+    if (navGrid)
+        navGrid->refresh();
+}
 
-    std::string line;
-    while (std::getline(file, line))
+void TileLayerComponent::loadFromLayer(const TileLayer &layer, int firstgid)
+{
+    if (layer.width != width || layer.height != height)
     {
-        std::istringstream lineStream(line);
-        std::string cell;
-        while (std::getline(lineStream, cell, ','))
-        {
-            int tile = std::stoi(cell) + shift;
-            tileMap.push_back(tile);
-        }
+        Log(LOG_ERROR, "TileLayerComponent::loadFromLayer %s is %dx%d, layer is %dx%d", layer.name.c_str(), layer.width, layer.height, width, height);
+        return;
     }
+
+    size_t size = (size_t)width * height;
+    size_t count = std::min(size, layer.data.size());
+    std::vector<int> tiles(size, -1);
+    const int *gids = layer.data.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        int gid = gids[i];
+        tiles[i] = gid != 0 ? gid - firstgid : -1;
+    }
+    tileMap.assign(tiles.data(), width, height);
+    if (navGrid)
+        navGrid->refresh();
 }
 
 std::string TileLayerComponent::getCSV() const
 {
-    std::ostringstream csvStream;
-    for (size_t i = 0; i < tileMap.size(); ++i)
-    {
-        csvStream << tileMap[i];
-
-        if (i < tileMap.size() - 1)
-        {
-            csvStream << ",";
-        }
-    }
-    return csvStream.str();
+    std::string csv;
+    WriteTileCSV(tileMap, 0, csv);
+    return csv;
 }
 
 void TileLayerComponent::saveToCSVFile(const std::string &filename)
 {
-    std::ostringstream file;
-
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x)
-        {
-            int tile = tileMap[y * width + x];
-            file << tile;
-            if (x < width - 1)
-            {
-                file << ",";
-            }
-        }
-        file << "\n";
-    }
-
-    std::string fileContent = file.str();
+    std::string fileContent;
+    WriteTileCSV(tileMap, width, fileContent);
 
     bool success = SaveFileText(filename.c_str(), const_cast<char *>(fileContent.c_str()));
 
     if (!success)
     {
         Log(LOG_ERROR, "Saving file: %s", filename.c_str());
+        return;
     }
+    FileSystem::Instance().addFile(filename);
 }
 
 void TileLayerComponent::setTile(int x, int y, int tile)
@@ -317,61 +314,61 @@ void TileLayerComponent::setTile(int x, int y, int tile)
     if (!isLoad || !isWithinBounds(x, y))
         return;
 
-    int index = (int)(x + y * width);
-    tileMap[index] = tile;
+    bool solid = tileMap.get(x, y) >= 1;
+    tileMap.set(x, y, tile);
+    if (navGrid && solid != (tile >= 1))
+        navGrid->onTile(x, y, tile);
 }
 int TileLayerComponent::getTile(int x, int y)
 {
     if (!isLoad || !isWithinBounds(x, y))
         return -1;
-    int index = (int)(x + y * width);
-    return tileMap[index];
+    return tileMap.get(x, y);
 }
 
 void TileLayerComponent::createSolids()
 {
-     int count=0;
-     for (int x = 0; x < width; x++)
+    const int SHIFT = TileChunks::SHIFT;
+    for (int row = 0; row < tileMap.getRows(); row++)
+    {
+        for (int column = 0; column < tileMap.getColumns(); column++)
         {
-            for (int y = 0; y < height; y++)
+            // tiles -1 and 0 make no solids
+            const TileChunk &chunk = tileMap.getChunk(column, row);
+            if (tileMap.isUniform(chunk) && chunk.value <= 1)
+                continue;
+
+            int x1 = std::min(width, (column + 1) << SHIFT);
+            int y1 = std::min(height, (row + 1) << SHIFT);
+            for (int y = row << SHIFT; y < y1; y++)
             {
-                int tile= getTile(x,y) ;
-                if (tile!=-1)
+                for (int x = column << SHIFT; x < x1; x++)
                 {
-                    if (tile>=1)
+                    int tile = tileMap.getTile(chunk, x & TileChunks::MASK, y & TileChunks::MASK);
+                    if (tile >= 1)
                     {
+                        GameObject *solid = new GameObject("solid", 2);
+                        solid->solid = true;
+                        solid->prefab = true;
+                        solid->transform->position.x = offset.x + x * tileWidth;
+                        solid->transform->position.y = offset.y + y * tileHeight;
 
-                     GameObject *solid = new GameObject("solid",2);
-                    solid->solid=true;
-                    solid->prefab=true;
-                    solid->transform->position.x=x*tileWidth,
-                    solid->transform->position.y=y*tileHeight;
-
-                    solid->width = tileWidth;
-                    solid->height= tileHeight;
-
-                    solid->originX=0;// (tileWidth/2) + (tileWidth/2)  +14;
-                    solid->originY=0;// (tileHeight/2) + (tileHeight/2)+14;
-                    solid->transform->pivot.x=0;
-                    solid->transform->pivot.y=0;
-
-                    solid->UpdateWorld();
-              
+                        solid->width = tileWidth;
+                        solid->height = tileHeight;
 
-     
+                        solid->originX = 0;
+                        solid->originY = 0;
+                        solid->transform->pivot.x = 0;
+                        solid->transform->pivot.y = 0;
 
-                    
-//                    solid->setDebug( SHOW_BOX );
-
-                    Scene::Instance()->AddGameObject(solid);
+                        solid->UpdateWorld();
 
+                        Scene::Instance()->AddGameObject(solid);
                     }
-
-                    count++;
                 }
             }
         }
-        
+    }
 }
 
 Rectangle TileLayerComponent::getClip(int id)
@@ -403,9 +400,805 @@ Rectangle TileLayerComponent::getClip(int id)
 void TileLayerComponent::clear()
 {
     tileMap.clear();
+    if (navGrid)
+        navGrid->refresh();
 }
 
 void TileLayerComponent::addTile(int index)
 {
     tileMap.push_back(index);
 }
+
+//*********************************************************************************************************************
+//**                         TileMapComponent                                                                        **
+//*********************************************************************************************************************
+
+TileMapComponent::TileMapComponent(int width, int height, int tileWidth, int tileHeight, int spacing, int margin, int graphID)
+    : tileset(nullptr), graphID(graphID), tileWidth(tileWidth), tileHeight(tileHeight), spacing(spacing), margin(margin), width(width), height(height),
+      startX(0), startY(0), endX(0), endY(0), rangeFrame(0)
+{
+    graph = Assets::Instance().getGraph(graphID);
+    if (!graph)
+        Log(LOG_ERROR, "TileMapComponent::TileMapComponent  %s ", Assets::Instance().getGraphName(graphID).c_str());
+    offset = {0, 0};
+    buildClips();
+}
+
+void TileMapComponent::buildClips()
+{
+    clips.clear();
+    if (!graph || tileWidth <= 0 || tileHeight <= 0)
+        return;
+
+    float widthTex = (float)graph->texture.width;
+    float heightTex = (float)graph->texture.height;
+    int columns = (graph->width - margin + spacing) / (tileWidth + spacing);
+    int rows = (graph->height - margin + spacing) / (tileHeight + spacing);
+    columns = std::max(columns, 1);
+    rows = std::max(rows, 1);
+    clips.resize((size_t)columns * rows);
+    for (int id = 0; id < (int)clips.size(); id++)
+    {
+        // same rect as TileLayerComponent::getClip, same texel fix as RenderTile
+        float x = (float)(margin + (spacing + tileWidth) * (id % columns));
+        float y = (float)(margin + (spacing + tileHeight) * (id / columns));
+        TileUV &uv = clips[id];
+        if (FIX_ARTIFACTS_BY_STRECHING_TEXEL)
+        {
+            uv.left = (2 * x + 1) / (2 * widthTex);
+            uv.right = uv.left + (tileWidth * 2 - 2) / (2 * widthTex);
+            uv.top = (2 * y + 1) / (2 * heightTex);
+            uv.bottom = uv.top + (tileHeight * 2 - 2) / (2 * heightTex);
+        }
+        else
+        {
+            uv.left = x / widthTex;
+            uv.right = (x + tileWidth) / widthTex;
+            uv.top = y / heightTex;
+            uv.bottom = (y + tileHeight) / heightTex;
+        }
+    }
+}
+
+void TileMapComponent::OnInit()
+{
+    object->originX = 0;
+    object->originY = 0;
+    object->width = width * tileWidth;
+    object->height = height * tileHeight;
+    object->bound.x = offset.x;
+    object->bound.y = offset.y;
+    object->bound.width = width * tileWidth;
+    object->bound.height = height * tileHeight;
+}
+
+void TileMapComponent::OnDestroy()
+{
+    // proxies go with the map
+    for (auto proxy : proxies)
+    {
+        proxy->map = nullptr;
+        proxy->object->alive = false;
+    }
+    proxies.clear();
+}
+
+void TileMapComponent::OnDebug()
+{
+    DrawRectangleLines((int)offset.x, (int)offset.y, width * tileWidth, height * tileHeight, RED);
+}
+
+int TileMapComponent::addLayer(const std::string &name, int depth)
+{
+    if (depth < 0)
+        depth = object ? object->layer : 0;
+
+    MapLayer layer;
+    layer.name = name;
+    layer.cells.create(width, height);
+    layer.depth = depth;
+    layer.visible = true;
+    layers.push_back(std::move(layer));
+
+    // first layer on another depth: a proxy object on that scene layer
+    bool drawn = object && depth == object->layer;
+    for (auto proxy : proxies)
+    {
+        drawn = drawn || proxy->layerDepth == depth;
+    }
+    if (!drawn && object)
+    {
+        GameObject *proxy = new GameObject(object->name + "_" + std::to_string(depth), depth);
+        proxy->collidable = false;
+        proxy->bound = object->bound;
+        proxy->width = object->width;
+        proxy->height = object->height;
+        proxies.push_back(proxy->AddComponent<TileMapDepthComponent>(this, depth));
+        Scene::Instance()->AddQueueObject(proxy);
+    }
+    return (int)layers.size() - 1;
+}
+
+int TileMapComponent::getLayerIndex(const std::string &name) const
+{
+    for (int i = 0; i < (int)layers.size(); i++)
+    {
+        if (layers[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+void TileMapComponent::setTile(int layer, int x, int y, int tile)
+{
+    if (layer < 0 || layer >= (int)layers.size() || !isWithinBounds(x, y))
+        return;
+    layers[layer].cells.set(x, y, tile);
+}
+
+int TileMapComponent::getTile(int layer, int x, int y) const
+{
+    if (layer < 0 || layer >= (int)layers.size() || !isWithinBounds(x, y))
+        return -1;
+    return layers[layer].cells.get(x, y);
+}
+
+void TileMapComponent::loadFromArray(int layer, const int *tiles)
+{
+    if (layer < 0 || layer >= (int)layers.size())
+        return;
+    layers[layer].cells.assign(tiles, width, height);
+}
+
+void TileMapComponent::loadFromLayer(int layer, const TileLayer &tiled, int firstgid)
+{
+    if (layer < 0 || layer >= (int)layers.size())
+        return;
+    if (tiled.width != width || tiled.height != height)
+    {
+        Log(LOG_ERROR, "TileMapComponent::loadFromLayer %s is %dx%d, map is %dx%d", tiled.name.c_str(), tiled.width, tiled.height, width, height);
+        return;
+    }
+
+    size_t size = (size_t)width * height;
+    size_t count = std::min(size, tiled.data.size());
+    std::vector<int> tiles(size, -1);
+    const int *gids = tiled.data.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        int gid = gids[i];
+        tiles[i] = gid != 0 ? gid - firstgid : -1;
+    }
+    layers[layer].cells.assign(tiles.data(), width, height);
+}
+
+void TileMapComponent::updateRange()
+{
+    Scene *scene = Scene::Instance();
+    if (rangeFrame == scene->frame)
+        return;
+    rangeFrame = scene->frame;
+
+    const Rectangle &view = scene->cameraView;
+    startX = Clamp((int)floorf((view.x - offset.x) / tileWidth), 0, width);
+    startY = Clamp((int)floorf((view.y - offset.y) / tileHeight), 0, height);
+    endX = Clamp((int)((view.x + view.width - offset.x) / tileWidth) + 1, 0, width);
+    endY = Clamp((int)((view.y + view.height - offset.y) / tileHeight) + 1, 0, height);
+}
+
+void TileMapComponent::OnDraw()
+{
+    if (object)
+        draw(object->layer);
+}
+
+void TileMapComponent::draw(int depth)
+{
+    if (!graph || clips.empty())
+        return;
+
+    drawing.clear();
+    for (auto &layer : layers)
+    {
+        if (layer.visible && layer.depth == depth)
+            drawing.push_back(&layer);
+    }
+    if (drawing.empty())
+        return;
+
+    Scene *scene = Scene::Instance();
+    updateRange();
+    if (startX >= endX || startY >= endY)
+        return;
+
+    const Tileset *animated = nullptr;
+    if (tileset && tileset->isAnimated())
+    {
+        tileset->update(scene->tileClock);
+        animated = tileset;
+    }
+
+    const int SHIFT = TileChunks::SHIFT;
+    const int MASK = TileChunks::MASK;
+    const int clipCount = (int)clips.size();
+    const float w = (float)tileWidth;
+    const float h = (float)tileHeight;
+    const unsigned int texture = graph->texture.id;
+    chunkLayers.resize(drawing.size());
+    chunkCells.resize(drawing.size());
+
+    for (int row = startY >> SHIFT; row <= (endY - 1) >> SHIFT; row++)
+    {
+        for (int column = startX >> SHIFT; column <= (endX - 1) >> SHIFT; column++)
+        {
+            // the chunk of every layer, the empty ones are left out
+            int count = 0;
+            for (auto layer : drawing)
+            {
+                const TileChunk &chunk = layer->cells.getChunk(column, row);
+                if (!layer->cells.isEmpty(chunk))
+                {
+                    chunkLayers[count] = layer;
+                    chunkCells[count] = &chunk;
+                    count++;
+                }
+            }
+            if (count == 0)
+                continue;
+
+            int x0 = std::max(startX, column << SHIFT);
+            int y0 = std::max(startY, row << SHIFT);
+            int x1 = std::min(endX, (column + 1) << SHIFT);
+            int y1 = std::min(endY, (row + 1) << SHIFT);
+            for (int y = y0; y < y1; y++)
+            {
+                rlCheckRenderBatchLimit(4 * (x1 - x0) * count);
+                rlSetTexture(texture);
+                rlBegin(RL_QUADS);
+                rlColor4ub(255, 255, 255, 255);
+                rlNormal3f(0.0f, 0.0f, 1.0f);
+                float py = offset.y + y * h;
+                for (int x = x0; x < x1; x++)
+                {
+                    float px = offset.x + x * w;
+                    // bottom layer first in every cell
+                    for (int i = 0; i < count; i++)
+                    {
+                        int tile = chunkLayers[i]->cells.getTile(*chunkCells[i], x & MASK, y & MASK);
+                        if (tile < 0)
+                            continue;
+                        if (animated)
+                            tile = animated->map(tile);
+                        if (tile >= clipCount)
+                            continue;
+                        const TileUV &uv = clips[tile];
+                        rlTexCoord2f(uv.left, uv.top);
+                        rlVertex2f(px, py);
+                        rlTexCoord2f(uv.left, uv.bottom);
+                        rlVertex2f(px, py + h);
+                        rlTexCoord2f(uv.right, uv.bottom);
+                        rlVertex2f(px + w, py + h);
+                        rlTexCoord2f(uv.right, uv.top);
+                        rlVertex2f(px + w, py);
+                    }
+                }
+                rlEnd();
+            }
+        }
+    }
+}
+
+void TileMapDepthComponent::OnDraw()
+{
+    if (map)
+        map->draw(layerDepth);
+}
+
+void TileMapDepthComponent::OnDestroy()
+{
+    if (!map)
+        return;
+    auto &proxies = map->proxies;
+    proxies.erase(std::remove(proxies.begin(), proxies.end(), this), proxies.end());
+    map = nullptr;
+}
+
+//*********************************************************************************************************************
+//**                         CSV                                                                                     **
+//*********************************************************************************************************************
+
+size_t ParseTileCSV(const char *text, size_t size, int shift, std::vector<int> &out)
+{
+    const char *end = text + size;
+
+    // first pass counts the cells so the map is sized once
+    size_t count = 0;
+    bool inNumber = false;
+    for (const char *p = text; p < end; p++)
+    {
+        bool digit = *p >= '0' && *p <= '9';
+        if (*p == '-' || (digit && !inNumber))
+            count++;
+        inNumber = digit || *p == '-';
+    }
+
+    out.resize(count);
+    int *tiles = out.data();
+    const char *p = text;
+    for (size_t i = 0; i < count; i++)
+    {
+        while (p < end && !((*p >= '0' && *p <= '9') || *p == '-'))
+            p++;
+        bool negative = p < end && *p == '-';
+        if (negative)
+            p++;
+        int value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        tiles[i] = (negative ? -value : value) + shift;
+    }
+    return count;
+}
+
+template <typename Tiles>
+static void WriteCells(const Tiles &tiles, size_t count, int columns, std::string &out)
+{
+    // worst case "-2147483648," per cell, one buffer for the whole map
+    out.resize(count * 12 + 1);
+    char *begin = &out[0];
+    char *p = begin;
+    for (size_t i = 0; i < count; i++)
+    {
+        int value = tiles[i];
+        unsigned int u = (unsigned int)value;
+        if (value < 0)
+        {
+            *p++ = '-';
+            u = 0u - u;
+        }
+        char digits[10];
+        int n = 0;
+        do
+        {
+            digits[n++] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u);
+        while (n)
+            *p++ = digits[--n];
+
+        bool lineEnd = columns > 0 && (i + 1) % columns == 0;
+        if (lineEnd)
+            *p++ = '\n';
+        else if (i + 1 < count)
+            *p++ = ',';
+    }
+    if (columns > 0 && count % columns != 0)
+        *p++ = '\n';
+    out.resize((size_t)(p - begin));
+}
+
+void WriteTileCSV(const int *tiles, size_t count, int columns, std::string &out)
+{
+    WriteCells(tiles, count, columns, out);
+}
+
+void WriteTileCSV(const TileCells &tiles, int columns, std::string &out)
+{
+    WriteCells(tiles, tiles.size(), columns, out);
+}
+
+void WriteTileCSV(const TileChunks &tiles, int columns, std::string &out)
+{
+    TileCells cells;
+    tiles.toCells(cells);
+    WriteCells(cells, cells.size(), columns, out);
+}
+
+//*********************************************************************************************************************
+//**                         TileCells                                                                               **
+//*********************************************************************************************************************
+
+TileCells::TileCells(const TileCells &other) : count(other.count), cellSize(other.cellSize), storage(other.storage), source(other.source)
+{
+    cells = source ? other.cells : storage.data();
+}
+
+void TileCells::own()
+{
+    if (!source)
+        return;
+    storage.assign(cells, cells + count * cellSize);
+    cells = storage.data();
+    source.reset();
+}
+
+void TileCells::widen()
+{
+    std::vector<unsigned char> wide(count * 2);
+    uint16_t *out = (uint16_t *)wide.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = cells[i];
+    }
+    storage.swap(wide);
+    source.reset();
+    cells = storage.data();
+    cellSize = 2;
+}
+
+void TileCells::set(size_t index, int tile)
+{
+    int value = tile < -1 ? 0 : tile + 1;
+    if (value > 0xFFFF)
+    {
+        Log(LOG_ERROR, "TileCells: tile %d out of range", tile);
+        return;
+    }
+    own();
+    if (value > 0xFF && cellSize == 1)
+        widen();
+    if (cellSize == 1)
+        storage[index] = (unsigned char)value;
+    else
+        ((uint16_t *)storage.data())[index] = (uint16_t)value;
+}
+
+void TileCells::assign(const int *tiles, size_t count)
+{
+    int biggest = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        biggest = std::max(biggest, tiles[i] + 1);
+    }
+
+    source.reset();
+    this->count = count;
+    cellSize = biggest > 0xFF ? 2 : 1;
+    storage.assign(count * cellSize, 0);
+    storage.shrink_to_fit();
+    cells = storage.data();
+    for (size_t i = 0; i < count; i++)
+    {
+        set(i, tiles[i]);
+    }
+}
+
+void TileCells::assign(const unsigned char *data, size_t count, int cellSize, const std::shared_ptr<FileBuffer> &source)
+{
+    storage.clear();
+    storage.shrink_to_fit();
+    this->source = source;
+    this->cells = data;
+    this->count = count;
+    this->cellSize = cellSize;
+}
+
+void TileCells::resize(size_t count)
+{
+    own();
+    storage.resize(count * cellSize, 0);
+    this->count = count;
+    cells = storage.data();
+}
+
+void TileCells::push_back(int tile)
+{
+    resize(count + 1);
+    set(count - 1, tile);
+}
+
+void TileCells::swap(TileCells &other)
+{
+    std::swap(cells, other.cells);
+    std::swap(count, other.count);
+    std::swap(cellSize, other.cellSize);
+    storage.swap(other.storage);
+    source.swap(other.source);
+}
+
+void TileCells::clear()
+{
+    source.reset();
+    storage.clear();
+    cells = storage.data();
+    count = 0;
+    cellSize = 1;
+}
+
+//*********************************************************************************************************************
+//**                         TileChunks                                                                              **
+//*********************************************************************************************************************
+
+TileChunks::TileChunks() : width(0), height(0), columns(0), rows(0), next(0), modified(false)
+{
+}
+
+void TileChunks::create(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    columns = (width + MASK) >> SHIFT;
+    rows = (height + MASK) >> SHIFT;
+    TileChunk empty = {nullptr, -1, 0, 1};
+    chunks.assign((size_t)columns * rows, empty);
+    chunks.shrink_to_fit();
+    blocks.clear();
+    blocks.shrink_to_fit();
+    source.clear();
+    next = 0;
+    modified = false;
+}
+
+template <class Get>
+void TileChunks::build(Get get)
+{
+    bool referenced = false;
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            int x0 = column << SHIFT;
+            int y0 = row << SHIFT;
+            int x1 = std::min(x0 + SIZE, width);
+            int y1 = std::min(y0 + SIZE, height);
+
+            int first = get(x0, y0);
+            int biggest = first;
+            bool uniform = true;
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    int value = get(x, y);
+                    uniform = uniform && value == first;
+                    biggest = std::max(biggest, value);
+                }
+            }
+
+            TileChunk &chunk = chunks[row * columns + column];
+            if (uniform)
+            {
+                chunk.value = (uint16_t)first;
+                continue;
+            }
+
+            // mapped cells stay where they are
+            if (source.isMapped())
+            {
+                chunk.cellSize = (uint8_t)source.getCellSize();
+                chunk.cells = source.data() + ((size_t)y0 * width + x0) * chunk.cellSize;
+                referenced = true;
+                continue;
+            }
+
+            chunk.cellSize = biggest > 0xFF ? 2 : 1;
+            chunk.block = (int)blocks.size();
+            blocks.push_back(std::vector<unsigned char>(SIZE * SIZE * chunk.cellSize, 0));
+            unsigned char *cells = blocks.back().data();
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    size_t index = (size_t)(y - y0) * SIZE + (x - x0);
+                    if (chunk.cellSize == 1)
+                        cells[index] = (unsigned char)get(x, y);
+                    else
+                        ((uint16_t *)cells)[index] = (uint16_t)get(x, y);
+                }
+            }
+        }
+    }
+    if (!referenced)
+        source.clear();
+}
+
+void TileChunks::assign(const int *tiles, int width, int height)
+{
+    create(width, height);
+    build([tiles, width](int x, int y)
+          {
+              int tile = tiles[(size_t)y * width + x];
+              return tile < -1 ? 0 : std::min(tile + 1, 0xFFFF);
+          });
+}
+
+void TileChunks::assign(const TileCells &cells, int width, int height)
+{
+    create(width, height);
+    if (cells.size() != (size_t)width * height)
+    {
+        Log(LOG_ERROR, "TileChunks: %d cells for %dx%d", (int)cells.size(), width, height);
+        return;
+    }
+    if (cells.isMapped())
+        source = cells;
+    build([&cells, width](int x, int y)
+          { return cells.get((size_t)y * width + x) + 1; });
+}
+
+void TileChunks::toCells(TileCells &out) const
+{
+    out.clear();
+    out.resize((size_t)width * height);
+    for (int row = 0; row < rows; row++)
+    {
+        for (int column = 0; column < columns; column++)
+        {
+            const TileChunk &chunk = getChunk(column, row);
+            if (isEmpty(chunk))
+                continue;
+            int x0 = column << SHIFT;
+            int y0 = row << SHIFT;
+            int x1 = std::min(x0 + SIZE, width);
+            int y1 = std::min(y0 + SIZE, height);
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    out.set((size_t)y * width + x, getTile(chunk, x - x0, y - y0));
+                }
+            }
+        }
+    }
+}
+
+void TileChunks::own(TileChunk &chunk, int column, int row)
+{
+    int cellSize = chunk.cells ? chunk.cellSize : (chunk.value > 0xFF ? 2 : 1);
+    std::vector<unsigned char> cells(SIZE * SIZE * cellSize, 0);
+    int x0 = column << SHIFT;
+    int y0 = row << SHIFT;
+    int w = std::min(SIZE, width - x0);
+    int h = std::min(SIZE, height - y0);
+    for (int y = 0; y < h; y++)
+    {
+        for (int x = 0; x < w; x++)
+        {
+            int value = getTile(chunk, x, y) + 1;
+            if (cellSize == 1)
+                cells[y * SIZE + x] = (unsigned char)value;
+            else
+                ((uint16_t *)cells.data())[y * SIZE + x] = (uint16_t)value;
+        }
+    }
+    chunk.cells = nullptr;
+    chunk.cellSize = (uint8_t)cellSize;
+    chunk.block = (int)blocks.size();
+    blocks.push_back(std::vector<unsigned char>());
+    blocks.back().swap(cells);
+}
+
+void TileChunks::widen(TileChunk &chunk)
+{
+    std::vector<unsigned char> &cells = blocks[chunk.block];
+    std::vector<unsigned char> wide(SIZE * SIZE * 2);
+    uint16_t *out = (uint16_t *)wide.data();
+    for (int i = 0; i < SIZE * SIZE; i++)
+    {
+        out[i] = cells[i];
+    }
+    cells.swap(wide);
+    chunk.cellSize = 2;
+}
+
+void TileChunks::set(int x, int y, int tile)
+{
+    int value = tile < -1 ? 0 : tile + 1;
+    if (value > 0xFFFF)
+    {
+        Log(LOG_ERROR, "TileChunks: tile %d out of range", tile);
+        return;
+    }
+    int column = x >> SHIFT;
+    int row = y >> SHIFT;
+    TileChunk &chunk = chunks[row * columns + column];
+    if (isUniform(chunk) && chunk.value == value)
+        return;
+
+    modified = true;
+    if (chunk.block < 0)
+        own(chunk, column, row);
+    if (value > 0xFF && chunk.cellSize == 1)
+        widen(chunk);
+    unsigned char *cells = blocks[chunk.block].data();
+    int index = (y & MASK) * SIZE + (x & MASK);
+    if (chunk.cellSize == 1)
+        cells[index] = (unsigned char)value;
+    else
+        ((uint16_t *)cells)[index] = (uint16_t)value;
+}
+
+void TileChunks::push_back(int tile)
+{
+    if (next >= (size_t)width * height)
+    {
+        Log(LOG_WARNING, "TileChunks: layer is full (%dx%d)", width, height);
+        return;
+    }
+    set((int)(next % width), (int)(next / width), tile);
+    next++;
+}
+
+void TileChunks::clear()
+{
+    create(width, height);
+    modified = true;
+}
+
+size_t TileChunks::memory() const
+{
+    size_t bytes = chunks.capacity() * sizeof(TileChunk) + blocks.capacity() * sizeof(std::vector<unsigned char>);
+    for (auto &chunk : chunks)
+    {
+        if (chunk.block >= 0)
+            bytes += blocks[chunk.block].capacity();
+        else if (chunk.cells)
+            bytes += SIZE * SIZE * chunk.cellSize;
+    }
+    return bytes;
+}
+
+//*********************************************************************************************************************
+//**                         Tileset                                                                                 **
+//*********************************************************************************************************************
+
+void Tileset::addAnimation(int tile, const std::vector<TileFrame> &frames)
+{
+    if (tile < 0 || frames.empty())
+        return;
+
+    TileAnimation animation;
+    animation.tile = tile;
+    animation.frames = frames;
+    animation.length = 0;
+    for (const TileFrame &frame : frames)
+    {
+        animation.length += frame.duration;
+    }
+
+    auto it = std::find_if(animations.begin(), animations.end(), [tile](const TileAnimation &a)
+                           { return a.tile == tile; });
+    if (it != animations.end())
+        *it = animation;
+    else
+        animations.push_back(animation);
+
+    // identity for every tile up to the biggest animated one
+    int size = (int)remap.size();
+    if (tile >= size)
+    {
+        remap.resize(tile + 1);
+        for (int i = size; i <= tile; i++)
+        {
+            remap[i] = i;
+        }
+    }
+    clock = -1;
+}
+
+void Tileset::update(double time)
+{
+    if (time == clock)
+        return;
+    clock = time;
+
+    for (const TileAnimation &animation : animations)
+    {
+        int tile = animation.frames[0].tile;
+        if (animation.length > 0)
+        {
+            float t = (float)fmod(time, (double)animation.length);
+            for (const TileFrame &frame : animation.frames)
+            {
+                tile = frame.tile;
+                if (t < frame.duration)
+                    break;
+                t -= frame.duration;
+            }
+        }
+        remap[animation.tile] = tile;
+    }
+}
@@ -0,0 +1,226 @@
+#include "TileMapFile.hpp"
+#include "Pack.hpp"
+#include <cstdio>
+#include <cstring>
+
+static_assert(sizeof(TileMapHeader) == 32, "TileMapHeader layout");
+static_assert(sizeof(TileMapLayer) == 64, "TileMapLayer layout");
+
+TileMapFile::TileMapFile() : header(nullptr), layers(nullptr)
+{
+}
+
+void TileMapFile::close()
+{
+    file.reset();
+    header = nullptr;
+    layers = nullptr;
+}
+
+bool TileMapFile::open(const std::string &fileName)
+{
+    close();
+
+    std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+    if (!FileSystem::Instance().map(fileName, *buffer))
+    {
+        Log(LOG_ERROR, "TileMapFile: open %s", fileName.c_str());
+        return false;
+    }
+    return attach(buffer, fileName);
+}
+
+bool TileMapFile::openFile(const std::string &path)
+{
+    close();
+
+    std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+    if (!MapFile(path, *buffer))
+        return false;
+    return attach(buffer, path);
+}
+
+bool TileMapFile::attach(const std::shared_ptr<FileBuffer> &buffer, const std::string &fileName)
+{
+    const TileMapHeader *h = (const TileMapHeader *)buffer->data;
+    if (buffer->size < sizeof(TileMapHeader) || memcmp(h->magic, "URTM", 4) != 0 || h->version != TILEMAP_VERSION ||
+        sizeof(TileMapHeader) + (uint64_t)h->layerCount * sizeof(TileMapLayer) > buffer->size)
+    {
+        Log(LOG_ERROR, "TileMapFile: %s is not a valid map", fileName.c_str());
+        return false;
+    }
+
+    const TileMapLayer *l = (const TileMapLayer *)(buffer->data + sizeof(TileMapHeader));
+    for (uint32_t i = 0; i < h->layerCount; i++)
+    {
+        if (l[i].offset + l[i].size > buffer->size || (l[i].cellSize != 1 && l[i].cellSize != 2) ||
+            (uint64_t)l[i].width * l[i].height * l[i].cellSize != l[i].rawSize)
+        {
+            Log(LOG_ERROR, "TileMapFile: %s layer %d is corrupted", fileName.c_str(), (int)i);
+            return false;
+        }
+    }
+
+    file = buffer;
+    header = h;
+    layers = l;
+    return true;
+}
+
+int TileMapFile::find(const std::string &name) const
+{
+    for (int i = 0; i < count(); i++)
+    {
+        if (strncmp(layers[i].name, name.c_str(), sizeof(layers[i].name)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+bool TileMapFile::load(int index, TileLayerComponent *layer) const
+{
+    if (index < 0 || index >= count())
+        return false;
+    const TileMapLayer &info = layers[index];
+    if ((int)info.width != layer->width || (int)info.height != layer->height)
+    {
+        Log(LOG_ERROR, "TileMapFile: layer %s is %dx%d, component is %dx%d", info.name, (int)info.width, (int)info.height, layer->width, layer->height);
+        return false;
+    }
+    TileCells cells;
+    if (!read(index, cells))
+        return false;
+    layer->tileMap.assign(cells, layer->width, layer->height);
+    return true;
+}
+
+bool TileMapFile::read(int index, TileCells &out) const
+{
+    if (index < 0 || index >= count())
+        return false;
+    const TileMapLayer &info = layers[index];
+
+    const unsigned char *blob = file->data + info.offset;
+    size_t cells = (size_t)info.width * info.height;
+    if ((info.flags & TILEMAP_LZ4) == 0)
+    {
+        out.assign(blob, cells, (int)info.cellSize, file);
+        return true;
+    }
+
+    std::shared_ptr<FileBuffer> raw(new FileBuffer());
+    raw->storage.resize(info.rawSize);
+    if (Lz4Decompress(blob, (int)info.size, raw->storage.data(), (int)info.rawSize) != (int)info.rawSize)
+    {
+        Log(LOG_ERROR, "TileMapFile: layer %s is corrupted", info.name);
+        return false;
+    }
+    raw->data = raw->storage.data();
+    raw->size = info.rawSize;
+    out.assign(raw->data, cells, (int)info.cellSize, raw);
+    return true;
+}
+
+bool TileMapFile::save(const std::string &fileName, const std::vector<TileLayerComponent *> &components, bool compress)
+{
+    if (components.empty())
+        return false;
+
+    std::vector<TileMapEntry> entries(components.size());
+    std::vector<TileCells> cells(components.size());
+    for (size_t i = 0; i < components.size(); i++)
+    {
+        TileLayerComponent *component = components[i];
+        component->tileMap.toCells(cells[i]);
+        entries[i].name = component->object ? component->object->name : "";
+        entries[i].width = component->width;
+        entries[i].height = component->height;
+        entries[i].cells = &cells[i];
+    }
+    return save(fileName, entries, components[0]->tileWidth, components[0]->tileHeight, compress);
+}
+
+bool TileMapFile::save(const std::string &fileName, const std::vector<TileMapEntry> &entries, int tileWidth, int tileHeight, bool compress)
+{
+    if (entries.empty())
+        return false;
+
+    TileMapHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "URTM", 4);
+    header.version = TILEMAP_VERSION;
+    header.layerCount = (uint32_t)entries.size();
+    header.tileWidth = (uint32_t)tileWidth;
+    header.tileHeight = (uint32_t)tileHeight;
+
+    std::vector<TileMapLayer> layers(entries.size());
+    std::vector<std::vector<unsigned char>> blobs(entries.size());
+    uint64_t offset = sizeof(TileMapHeader) + layers.size() * sizeof(TileMapLayer);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const TileMapEntry &entry = entries[i];
+        const TileCells &cells = *entry.cells;
+        TileMapLayer &layer = layers[i];
+        memset(&layer, 0, sizeof(layer));
+        strncpy(layer.name, entry.name.c_str(), sizeof(layer.name) - 1);
+        layer.width = (uint32_t)entry.width;
+        layer.height = (uint32_t)entry.height;
+        layer.cellSize = (uint32_t)cells.getCellSize();
+        layer.rawSize = (uint32_t)(cells.size() * cells.getCellSize());
+        if (cells.size() != (size_t)entry.width * entry.height)
+        {
+            Log(LOG_ERROR, "TileMapFile: layer %s has %d cells, expected %dx%d", entry.name.c_str(), (int)cells.size(), entry.width, entry.height);
+            return false;
+        }
+
+        std::vector<unsigned char> &blob = blobs[i];
+        if (compress && layer.rawSize > 0)
+        {
+            Lz4Compress(cells.data(), (int)layer.rawSize, blob);
+            if (blob.size() < layer.rawSize - layer.rawSize / 10)
+                layer.flags |= TILEMAP_LZ4;
+        }
+        if ((layer.flags & TILEMAP_LZ4) == 0)
+            blob.assign(cells.data(), cells.data() + layer.rawSize);
+
+        offset = (offset + TILEMAP_ALIGN - 1) / TILEMAP_ALIGN * TILEMAP_ALIGN;
+        layer.offset = offset;
+        layer.size = (uint32_t)blob.size();
+        offset += blob.size();
+    }
+
+    // written aside and renamed, a mapping of the old file stays valid
+    std::string temp = fileName + ".tmp";
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file)
+    {
+        Log(LOG_ERROR, "TileMapFile: saving %s", fileName.c_str());
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(layers.data(), sizeof(TileMapLayer), layers.size(), file);
+    static const unsigned char zeros[TILEMAP_ALIGN] = {0};
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        long position = ftell(file);
+        fwrite(zeros, 1, (size_t)(layers[i].offset - position), file);
+        fwrite(blobs[i].data(), 1, blobs[i].size(), file);
+    }
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    if (ok && std::rename(temp.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(fileName.c_str());
+        ok = std::rename(temp.c_str(), fileName.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        std::remove(temp.c_str());
+        Log(LOG_ERROR, "TileMapFile: saving %s", fileName.c_str());
+        return false;
+    }
+
+    FileSystem::Instance().addFile(fileName);
+    Log(LOG_INFO, "TileMapFile: %s %d layers %.2f MB", fileName.c_str(), (int)layers.size(), memoryInMB((size_t)offset));
+    return true;
+}
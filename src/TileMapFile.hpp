@@ -0,0 +1,78 @@
+#pragma once
+#include "Engine.hpp"
+#include <cstdint>
+
+//*********************************************************************************************************************
+//**                         TileMapFile                                                                             **
+//*********************************************************************************************************************
+
+// Layout of a binary map file (little endian):
+//   TileMapHeader
+//   TileMapLayer[layerCount]
+//   cells                 one block per layer, 16 byte aligned, tile + 1 per cell (0 = empty),
+//                         uint8 or uint16 (TileCells layout), optionally LZ4 compressed
+// The file is memory mapped, uncompressed layers are used in place until a tile is changed.
+
+const uint32_t TILEMAP_VERSION = 1;
+const uint32_t TILEMAP_ALIGN = 16;
+const uint32_t TILEMAP_LZ4 = 1 << 0;
+
+struct TileMapHeader
+{
+    char magic[4]; // URTM
+    uint32_t version;
+    uint32_t layerCount;
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    uint32_t reserved[3];
+};
+
+struct TileMapLayer
+{
+    char name[32]; // 0 terminated
+    uint32_t width;
+    uint32_t height;
+    uint32_t cellSize; // 1 or 2
+    uint32_t flags;
+    uint64_t offset;
+    uint32_t size;    // bytes stored in the file
+    uint32_t rawSize; // width * height * cellSize
+};
+
+struct TileMapEntry
+{
+    std::string name;
+    int width;
+    int height;
+    const TileCells *cells;
+};
+
+class TileMapFile
+{
+public:
+    TileMapFile();
+
+    bool open(const std::string &fileName);
+    // straight from disk, no FileSystem lookup (safe from a loader thread)
+    bool openFile(const std::string &path);
+    void close();
+
+    int count() const { return header ? (int)header->layerCount : 0; }
+    const TileMapLayer *getLayer(int index) const { return &layers[index]; }
+    int find(const std::string &name) const;
+
+    // cells of the layer into the component (same width/height), in place when not compressed
+    bool load(int index, TileLayerComponent *layer) const;
+    bool read(int index, TileCells &cells) const;
+
+    // layers are named after their GameObject, LZ4 is kept only when it saves more than 10%
+    static bool save(const std::string &fileName, const std::vector<TileLayerComponent *> &layers, bool compress);
+    static bool save(const std::string &fileName, const std::vector<TileMapEntry> &entries, int tileWidth, int tileHeight, bool compress);
+
+private:
+    bool attach(const std::shared_ptr<FileBuffer> &buffer, const std::string &fileName);
+
+    std::shared_ptr<FileBuffer> file;
+    const TileMapHeader *header;
+    const TileMapLayer *layers;
+};
@@ -0,0 +1,1104 @@
+#include "Tiled.hpp"
+#include <cstdlib>
+#include <cstring>
+
+// gid bits used by Tiled for flips/rotations
+static const unsigned int GID_MASK = 0x0FFFFFFF;
+
+static bool EndsWith(const std::string &text, const char *suffix)
+{
+    size_t size = strlen(suffix);
+    return text.size() >= size && text.compare(text.size() - size, size, suffix) == 0;
+}
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// parse an integer (gid or attribute) without allocations, stops at the first non digit
+static long long ParseInteger(const char *&p, const char *end)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    long long value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return negative ? -value : value;
+}
+
+static void ParseCSV(const char *p, const char *end, std::vector<int> &out)
+{
+    while (p < end)
+    {
+        if (*p >= '0' && *p <= '9')
+            out.push_back((int)((unsigned int)ParseInteger(p, end) & GID_MASK));
+        else
+            p++;
+    }
+}
+
+bool DecodeTiledLayer(const char *text, size_t size, const std::string &compression, std::vector<int> &out, size_t count)
+{
+    const char *begin = text;
+    const char *end = text + size;
+    while (begin < end && IsSpace(*begin))
+        begin++;
+    while (end > begin && IsSpace(end[-1]))
+        end--;
+
+    std::string bytes = base64_decode(std::string(begin, end));
+    const unsigned char *data = (const unsigned char *)bytes.data();
+    int dataSize = (int)bytes.size();
+
+    unsigned char *inflated = nullptr;
+    if (!compression.empty())
+    {
+        // DecompressData wants raw deflate, skip the zlib/gzip wrappers
+        int start = 0;
+        int trailer = 0;
+        if (compression == "zlib")
+        {
+            start = 2;
+            trailer = 4;
+        }
+        else if (compression == "gzip")
+        {
+            if (dataSize < 18)
+                return false;
+            int flags = data[3];
+            start = 10;
+            if (flags & 4)
+                start += 2 + (data[start] | (data[start + 1] << 8));
+            if (flags & 8)
+                while (start < dataSize && data[start++] != 0)
+                    ;
+            if (flags & 16)
+                while (start < dataSize && data[start++] != 0)
+                    ;
+            if (flags & 2)
+                start += 2;
+            trailer = 8;
+        }
+        else
+        {
+            Log(LOG_ERROR, "Tiled: compression %s not supported", compression.c_str());
+            return false;
+        }
+        if (dataSize - start - trailer <= 0)
+            return false;
+
+        inflated = DecompressData(data + start, dataSize - start - trailer, &dataSize);
+        if (!inflated)
+            return false;
+        data = inflated;
+    }
+
+    size_t tiles = (size_t)dataSize / 4;
+    if (count && tiles != count)
+        Log(LOG_WARNING, "Tiled: layer has %d tiles, expected %d", (int)tiles, (int)count);
+    out.resize(tiles);
+    for (size_t i = 0; i < tiles; i++)
+    {
+        const unsigned char *b = data + i * 4;
+        unsigned int gid = (unsigned int)b[0] | ((unsigned int)b[1] << 8) | ((unsigned int)b[2] << 16) | ((unsigned int)b[3] << 24);
+        out[i] = (int)(gid & GID_MASK);
+    }
+
+    if (inflated)
+        MemFree(inflated);
+    return true;
+}
+
+//*********************************************************************************************************************
+//**                         JSON                                                                                    **
+//*********************************************************************************************************************
+
+struct JsonReader
+{
+    const char *p;
+    const char *end;
+    bool failed;
+
+    JsonReader(const char *text, size_t size) : p(text), end(text + size), failed(false) {}
+
+    void skip()
+    {
+        while (p < end && IsSpace(*p))
+            p++;
+    }
+
+    bool peek(char c)
+    {
+        skip();
+        return p < end && *p == c;
+    }
+
+    bool expect(char c)
+    {
+        skip();
+        if (p < end && *p == c)
+        {
+            p++;
+            return true;
+        }
+        failed = true;
+        return false;
+    }
+
+    // {"key": value, ...}  call after '{'
+    bool nextKey(std::string &key)
+    {
+        skip();
+        if (failed || p >= end || *p == '}')
+        {
+            p++;
+            return false;
+        }
+        if (*p == ',')
+            p++;
+        if (!readString(key) || !expect(':'))
+            return false;
+        return true;
+    }
+
+    // [value, ...]  call after '['
+    bool nextItem()
+    {
+        skip();
+        if (failed || p >= end || *p == ']')
+        {
+            p++;
+            return false;
+        }
+        if (*p == ',')
+        {
+            p++;
+            skip();
+        }
+        return p < end;
+    }
+
+    bool readString(std::string &out)
+    {
+        out.clear();
+        if (!expect('"'))
+            return false;
+        while (p < end && *p != '"')
+        {
+            char c = *p++;
+            if (c == '\\' && p < end)
+            {
+                c = *p++;
+                switch (c)
+                {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'u':
+                    p += 4;
+                    c = '?';
+                    break;
+                default:
+                    break;
+                }
+            }
+            out += c;
+        }
+        p++;
+        return true;
+    }
+
+    double readNumber()
+    {
+        skip();
+        char *last = nullptr;
+        double value = strtod(p, &last);
+        if (last == p)
+            failed = true;
+        p = last;
+        return value;
+    }
+
+    long long readInteger()
+    {
+        skip();
+        const char *start = p;
+        long long value = ParseInteger(p, end);
+        if (p < end && (*p == '.' || *p == 'e' || *p == 'E'))
+        {
+            p = start;
+            return (long long)readNumber();
+        }
+        if (p == start)
+            failed = true;
+        return value;
+    }
+
+    bool readBool()
+    {
+        skip();
+        if (end - p >= 4 && strncmp(p, "true", 4) == 0)
+        {
+            p += 4;
+            return true;
+        }
+        if (end - p >= 5 && strncmp(p, "false", 5) == 0)
+        {
+            p += 5;
+            return false;
+        }
+        failed = true;
+        return false;
+    }
+
+    void skipValue()
+    {
+        skip();
+        if (p >= end)
+            return;
+        if (*p == '"')
+        {
+            std::string tmp;
+            readString(tmp);
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            // strings can have brackets inside
+            int level = 0;
+            while (p < end)
+            {
+                char c = *p++;
+                if (c == '"')
+                {
+                    while (p < end && *p != '"')
+                    {
+                        if (*p == '\\')
+                            p++;
+                        p++;
+                    }
+                    p++;
+                }
+                else if (c == '{' || c == '[')
+                    level++;
+                else if (c == '}' || c == ']')
+                {
+                    if (--level == 0)
+                        break;
+                }
+            }
+        }
+        else
+        {
+            while (p < end && *p != ',' && *p != '}' && *p != ']' && !IsSpace(*p))
+                p++;
+        }
+    }
+};
+
+struct TilesetBuilder
+{
+    TilesetBuilder() : firstgid(1), columns(0), tileCount(0), animationTile(-1) {}
+
+    Tileset tileset;
+    int firstgid;
+    int columns;
+    int tileCount;
+    std::string source;
+    std::vector<std::pair<int, std::vector<TileFrame>>> animations;
+
+    // xml state
+    int animationTile;
+    std::vector<TileFrame> frames;
+};
+
+static void ReadJsonTileset(JsonReader &json, TilesetBuilder &builder)
+{
+    std::string key;
+    if (!json.expect('{'))
+        return;
+    while (json.nextKey(key))
+    {
+        if (key == "firstgid")
+            builder.firstgid = (int)json.readInteger();
+        else if (key == "source")
+            json.readString(builder.source);
+        else if (key == "name")
+            json.readString(builder.tileset.name);
+        else if (key == "image")
+            json.readString(builder.tileset.imageSource);
+        else if (key == "tilewidth")
+            builder.tileset.tileWidth = (int)json.readInteger();
+        else if (key == "tileheight")
+            builder.tileset.tileHeight = (int)json.readInteger();
+        else if (key == "spacing")
+            builder.tileset.spacing = (int)json.readInteger();
+        else if (key == "margin")
+            builder.tileset.margin = (int)json.readInteger();
+        else if (key == "columns")
+            builder.columns = (int)json.readInteger();
+        else if (key == "tilecount")
+            builder.tileCount = (int)json.readInteger();
+        else if (key == "tiles" && json.expect('['))
+        {
+            while (json.nextItem())
+            {
+                int id = -1;
+                std::vector<TileFrame> frames;
+                if (!json.expect('{'))
+                    break;
+                while (json.nextKey(key))
+                {
+                    if (key == "id")
+                        id = (int)json.readInteger();
+                    else if (key == "animation" && json.expect('['))
+                    {
+                        while (json.nextItem())
+                        {
+                            TileFrame frame = {0, 0};
+                            if (!json.expect('{'))
+                                break;
+                            while (json.nextKey(key))
+                            {
+                                if (key == "tileid")
+                                    frame.tile = (int)json.readInteger();
+                                else if (key == "duration")
+                                    frame.duration = (float)json.readNumber() / 1000.0f;
+                                else
+                                    json.skipValue();
+                            }
+                            frames.push_back(frame);
+                        }
+                    }
+                    else
+                        json.skipValue();
+                }
+                if (id >= 0 && !frames.empty())
+                    builder.animations.push_back(std::make_pair(id, frames));
+            }
+        }
+        else
+            json.skipValue();
+    }
+}
+
+static void ReadJsonObject(JsonReader &json, TiledObject &object)
+{
+    std::string key;
+    object.id = 0;
+    object.gid = 0;
+    object.x = object.y = object.width = object.height = object.rotation = 0;
+    object.visible = true;
+    if (!json.expect('{'))
+        return;
+    while (json.nextKey(key))
+    {
+        if (key == "id")
+            object.id = (int)json.readInteger();
+        else if (key == "gid")
+            object.gid = (int)((unsigned int)json.readInteger() & GID_MASK);
+        else if (key == "name")
+            json.readString(object.name);
+        else if (key == "type" || key == "class")
+            json.readString(object.type);
+        else if (key == "x")
+            object.x = (float)json.readNumber();
+        else if (key == "y")
+            object.y = (float)json.readNumber();
+        else if (key == "width")
+            object.width = (float)json.readNumber();
+        else if (key == "height")
+            object.height = (float)json.readNumber();
+        else if (key == "rotation")
+            object.rotation = (float)json.readNumber();
+        else if (key == "visible")
+            object.visible = json.readBool();
+        else
+            json.skipValue();
+    }
+}
+
+// one entry of "layers", group layers are flattened
+static void ReadJsonLayer(JsonReader &json, TiledMap &map)
+{
+    std::string key;
+    std::string type;
+    std::string encoding;
+    std::string compression;
+    std::string payload;
+    TileLayer layer;
+    layer.width = map.width;
+    layer.height = map.height;
+    layer.x = layer.y = 0;
+    layer.opacity = 1;
+    layer.visible = true;
+    TiledObjectLayer objects;
+
+    if (!json.expect('{'))
+        return;
+    while (json.nextKey(key))
+    {
+        if (key == "type")
+            json.readString(type);
+        else if (key == "name")
+            json.readString(layer.name);
+        else if (key == "width")
+            layer.width = (int)json.readInteger();
+        else if (key == "height")
+            layer.height = (int)json.readInteger();
+        else if (key == "x")
+            layer.x = (int)json.readInteger();
+        else if (key == "y")
+            layer.y = (int)json.readInteger();
+        else if (key == "opacity")
+            layer.opacity = (int)json.readNumber();
+        else if (key == "visible")
+            layer.visible = json.readBool();
+        else if (key == "encoding")
+            json.readString(encoding);
+        else if (key == "compression")
+            json.readString(compression);
+        else if (key == "data")
+        {
+            if (json.peek('"'))
+            {
+                json.readString(payload);
+            }
+            else if (json.expect('['))
+            {
+                layer.data.reserve((size_t)map.width * map.height);
+                while (json.nextItem())
+                {
+                    layer.data.push_back((int)((unsigned int)json.readInteger() & GID_MASK));
+                }
+            }
+        }
+        else if (key == "objects" && json.expect('['))
+        {
+            while (json.nextItem())
+            {
+                TiledObject object;
+                ReadJsonObject(json, object);
+                objects.objects.push_back(object);
+            }
+        }
+        else if (key == "layers" && json.expect('['))
+        {
+            while (json.nextItem())
+            {
+                ReadJsonLayer(json, map);
+            }
+        }
+        else
+            json.skipValue();
+    }
+
+    if (type == "tilelayer")
+    {
+        layer.type = type;
+        if (!payload.empty() && encoding == "base64")
+            DecodeTiledLayer(payload.data(), payload.size(), compression, layer.data, (size_t)layer.width * layer.height);
+        map.layers.push_back(layer);
+    }
+    else if (type == "objectgroup")
+    {
+        objects.name = layer.name;
+        objects.visible = layer.visible;
+        map.objectLayers.push_back(objects);
+    }
+}
+
+//*********************************************************************************************************************
+//**                         XML                                                                                     **
+//*********************************************************************************************************************
+
+struct XmlReader
+{
+    const char *p;
+    const char *end;
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    bool closing; // </name>
+    bool empty;   // <name/>
+    const char *text; // text before the tag
+    size_t textSize;
+
+    XmlReader(const char *source, size_t size) : p(source), end(source + size), closing(false), empty(false), text(source), textSize(0) {}
+
+    static void unescape(std::string &value)
+    {
+        if (value.find('&') == std::string::npos)
+            return;
+        static const char *entities[][2] = {{"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}, {"&amp;", "&"}};
+        for (auto &entity : entities)
+        {
+            size_t pos = 0;
+            while ((pos = value.find(entity[0], pos)) != std::string::npos)
+            {
+                value.replace(pos, strlen(entity[0]), entity[1]);
+                pos++;
+            }
+        }
+    }
+
+    bool skipTo(const char *marker)
+    {
+        size_t size = strlen(marker);
+        while (p + size <= end)
+        {
+            if (strncmp(p, marker, size) == 0)
+            {
+                p += size;
+                return true;
+            }
+            p++;
+        }
+        p = end;
+        return false;
+    }
+
+    // next element tag, comments and declarations are skipped
+    bool next()
+    {
+        text = p;
+        while (true)
+        {
+            while (p < end && *p != '<')
+                p++;
+            if (p >= end)
+                return false;
+            textSize = (size_t)(p - text);
+            if (end - p >= 4 && strncmp(p, "<!--", 4) == 0)
+            {
+                skipTo("-->");
+                continue;
+            }
+            if (end - p >= 2 && (p[1] == '?' || p[1] == '!'))
+            {
+                skipTo(">");
+                continue;
+            }
+            break;
+        }
+
+        p++;
+        closing = *p == '/';
+        if (closing)
+            p++;
+        const char *start = p;
+        while (p < end && !IsSpace(*p) && *p != '>' && *p != '/')
+            p++;
+        name.assign(start, p);
+
+        attributes.clear();
+        empty = false;
+        while (p < end)
+        {
+            while (p < end && IsSpace(*p))
+                p++;
+            if (p >= end)
+                return false;
+            if (*p == '>')
+            {
+                p++;
+                break;
+            }
+            if (*p == '/')
+            {
+                empty = true;
+                p++;
+                continue;
+            }
+            start = p;
+            while (p < end && *p != '=' && !IsSpace(*p) && *p != '>')
+                p++;
+            std::string key(start, p);
+            while (p < end && *p != '"' && *p != '\'')
+                p++;
+            if (p >= end)
+                return false;
+            char quote = *p++;
+            start = p;
+            while (p < end && *p != quote)
+                p++;
+            std::string value(start, p);
+            p++;
+            unescape(value);
+            attributes.push_back(std::make_pair(key, value));
+        }
+        return true;
+    }
+
+    const std::string *get(const char *key) const
+    {
+        for (const auto &attribute : attributes)
+        {
+            if (attribute.first == key)
+                return &attribute.second;
+        }
+        return nullptr;
+    }
+
+    std::string getString(const char *key) const
+    {
+        const std::string *value = get(key);
+        return value ? *value : std::string();
+    }
+
+    int getInt(const char *key, int value = 0) const
+    {
+        const std::string *s = get(key);
+        return s ? (int)strtoll(s->c_str(), nullptr, 10) : value;
+    }
+
+    float getFloat(const char *key, float value = 0) const
+    {
+        const std::string *s = get(key);
+        return s ? (float)strtod(s->c_str(), nullptr) : value;
+    }
+};
+
+//*********************************************************************************************************************
+//**                         TiledMap                                                                                **
+//*********************************************************************************************************************
+
+TiledMap::TiledMap() : width(0), height(0), tileWidth(0), tileHeight(0)
+{
+}
+
+void TiledMap::clear()
+{
+    width = height = tileWidth = tileHeight = 0;
+    tilesets.clear();
+    layers.clear();
+    objectLayers.clear();
+}
+
+bool TiledMap::load(const std::string &fileName)
+{
+    clear();
+
+    FileBuffer file;
+    if (!FileSystem::Instance().load(fileName, file))
+    {
+        Log(LOG_ERROR, "Tiled: reading %s", fileName.c_str());
+        return false;
+    }
+
+    size_t slash = fileName.find_last_of("/\\");
+    folder = slash == std::string::npos ? "" : fileName.substr(0, slash + 1);
+
+    bool xml = EndsWith(fileName, ".tmx") || EndsWith(fileName, ".tsx");
+    bool ok = xml ? loadXml(file.text(), file.size) : loadJson(file.text(), file.size);
+    if (!ok)
+    {
+        Log(LOG_ERROR, "Tiled: parsing %s", fileName.c_str());
+        return false;
+    }
+
+    std::sort(tilesets.begin(), tilesets.end(), [](const TiledTileset &a, const TiledTileset &b)
+              { return a.firstgid < b.firstgid; });
+    Log(LOG_INFO, "Tiled: %s %dx%d %d layers %d object layers", fileName.c_str(), width, height, (int)layers.size(), (int)objectLayers.size());
+    return true;
+}
+
+std::string TiledMap::getImagePath(const std::string &image) const
+{
+    std::string path = NormalizePath(folder + image);
+    if (FileSystem::Instance().exists(path))
+        return path;
+    return image;
+}
+
+void TiledMap::addTileset(const TiledTileset &tileset)
+{
+    tilesets.push_back(tileset);
+}
+
+static bool CommitTileset(TilesetBuilder &builder, const std::string &folder, TiledTileset &out)
+{
+    if (builder.tileset.name.empty())
+        builder.tileset.name = builder.tileset.imageSource;
+    if (!builder.tileset.imageSource.empty())
+    {
+        std::string path = NormalizePath(folder + builder.tileset.imageSource);
+        if (FileSystem::Instance().exists(path))
+            builder.tileset.imageSource = path;
+    }
+    builder.tileset.firstgid = builder.firstgid;
+
+    Tileset *tileset = Assets::Instance().addTileset(builder.tileset.name);
+    *tileset = builder.tileset;
+    for (const auto &animation : builder.animations)
+    {
+        tileset->addAnimation(animation.first, animation.second);
+    }
+
+    out.firstgid = builder.firstgid;
+    out.tileset = tileset;
+    out.columns = builder.columns;
+    out.tileCount = builder.tileCount;
+    return true;
+}
+
+bool TiledMap::loadTileset(const std::string &fileName, TiledTileset &out)
+{
+    int firstgid = out.firstgid;
+    std::string path = NormalizePath(folder + fileName);
+
+    if (EndsWith(fileName, ".tsx"))
+    {
+        TiledMap tsx;
+        if (!tsx.load(path) || tsx.tilesets.empty())
+            return false;
+        out = tsx.tilesets[0];
+    }
+    else
+    {
+        FileBuffer file;
+        if (!FileSystem::Instance().load(path, file))
+        {
+            Log(LOG_ERROR, "Tiled: reading tileset %s", path.c_str());
+            return false;
+        }
+        size_t slash = path.find_last_of('/');
+        std::string tsjFolder = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        JsonReader json(file.text(), file.size);
+        TilesetBuilder builder;
+        ReadJsonTileset(json, builder);
+        CommitTileset(builder, tsjFolder, out);
+    }
+    out.firstgid = firstgid;
+    out.tileset->firstgid = firstgid;
+    return true;
+}
+
+bool TiledMap::loadJson(const char *text, size_t size)
+{
+    JsonReader json(text, size);
+    std::string key;
+    if (!json.expect('{'))
+        return false;
+    while (json.nextKey(key))
+    {
+        if (key == "width")
+            width = (int)json.readInteger();
+        else if (key == "height")
+            height = (int)json.readInteger();
+        else if (key == "tilewidth")
+            tileWidth = (int)json.readInteger();
+        else if (key == "tileheight")
+            tileHeight = (int)json.readInteger();
+        else if (key == "layers" && json.expect('['))
+        {
+            while (json.nextItem())
+            {
+                ReadJsonLayer(json, *this);
+            }
+        }
+        else if (key == "tilesets" && json.expect('['))
+        {
+            while (json.nextItem())
+            {
+                TilesetBuilder builder;
+                ReadJsonTileset(json, builder);
+                TiledTileset tileset;
+                tileset.firstgid = builder.firstgid;
+                if (!builder.source.empty())
+                {
+                    if (loadTileset(builder.source, tileset))
+                        addTileset(tileset);
+                }
+                else if (CommitTileset(builder, folder, tileset))
+                {
+                    addTileset(tileset);
+                }
+            }
+        }
+        else
+            json.skipValue();
+    }
+
+    // layers written before "width"/"height" got 0
+    for (TileLayer &layer : layers)
+    {
+        if (layer.width == 0 && layer.height == 0)
+        {
+            layer.width = width;
+            layer.height = height;
+        }
+    }
+    return !json.failed;
+}
+
+bool TiledMap::loadXml(const char *text, size_t size)
+{
+    XmlReader xml(text, size);
+    TilesetBuilder builder;
+    bool inTileset = false;
+    bool inLayer = false;
+    TileLayer layer;
+    std::string encoding;
+    std::string compression;
+
+    while (xml.next())
+    {
+        const std::string &name = xml.name;
+        if (xml.closing)
+        {
+            if (name == "data" && inLayer)
+            {
+                if (encoding == "csv")
+                    ParseCSV(xml.text, xml.text + xml.textSize, layer.data);
+                else if (encoding == "base64")
+                    DecodeTiledLayer(xml.text, xml.textSize, compression, layer.data, (size_t)layer.width * layer.height);
+            }
+            else if (name == "layer" && inLayer)
+            {
+                layers.push_back(layer);
+                inLayer = false;
+            }
+            else if (name == "animation" && inTileset)
+            {
+                if (builder.animationTile >= 0 && !builder.frames.empty())
+                    builder.animations.push_back(std::make_pair(builder.animationTile, builder.frames));
+                builder.frames.clear();
+            }
+            else if (name == "tileset" && inTileset)
+            {
+                TiledTileset tileset;
+                if (CommitTileset(builder, folder, tileset))
+                    addTileset(tileset);
+                inTileset = false;
+            }
+            continue;
+        }
+
+        if (name == "map")
+        {
+            width = xml.getInt("width");
+            height = xml.getInt("height");
+            tileWidth = xml.getInt("tilewidth");
+            tileHeight = xml.getInt("tileheight");
+        }
+        else if (name == "tileset")
+        {
+            builder = TilesetBuilder();
+            builder.firstgid = xml.getInt("firstgid", 1);
+            builder.source = xml.getString("source");
+            builder.tileset.name = xml.getString("name");
+            builder.tileset.tileWidth = xml.getInt("tilewidth");
+            builder.tileset.tileHeight = xml.getInt("tileheight");
+            builder.tileset.spacing = xml.getInt("spacing");
+            builder.tileset.margin = xml.getInt("margin");
+            builder.columns = xml.getInt("columns");
+            builder.tileCount = xml.getInt("tilecount");
+
+            TiledTileset tileset;
+            tileset.firstgid = builder.firstgid;
+            if (!builder.source.empty())
+            {
+                if (loadTileset(builder.source, tileset))
+                    addTileset(tileset);
+            }
+            else if (xml.empty)
+            {
+                if (CommitTileset(builder, folder, tileset))
+                    addTileset(tileset);
+            }
+            else
+            {
+                inTileset = true;
+            }
+        }
+        else if (name == "image" && inTileset)
+        {
+            builder.tileset.imageSource = xml.getString("source");
+        }
+        else if (name == "tile" && inTileset)
+        {
+            builder.animationTile = xml.getInt("id", -1);
+        }
+        else if (name == "frame" && inTileset)
+        {
+            TileFrame frame;
+            frame.tile = xml.getInt("tileid");
+            frame.duration = xml.getFloat("duration") / 1000.0f;
+            builder.frames.push_back(frame);
+        }
+        else if (name == "layer")
+        {
+            layer = TileLayer();
+            layer.name = xml.getString("name");
+            layer.type = "tilelayer";
+            layer.width = xml.getInt("width", width);
+            layer.height = xml.getInt("height", height);
+            layer.x = xml.getInt("offsetx");
+            layer.y = xml.getInt("offsety");
+            layer.opacity = (int)xml.getFloat("opacity", 1);
+            layer.visible = xml.getInt("visible", 1) != 0;
+            layer.data.reserve((size_t)layer.width * layer.height);
+            inLayer = !xml.empty;
+        }
+        else if (name == "data" && inLayer)
+        {
+            encoding = xml.getString("encoding");
+            compression = xml.getString("compression");
+        }
+        else if (name == "tile" && inLayer)
+        {
+            // <data> without encoding, one element per cell
+            layer.data.push_back((int)((unsigned int)strtoul(xml.getString("gid").c_str(), nullptr, 10) & GID_MASK));
+        }
+        else if (name == "objectgroup" && !inTileset)
+        {
+            TiledObjectLayer objects;
+            objects.name = xml.getString("name");
+            objects.visible = xml.getInt("visible", 1) != 0;
+            objectLayers.push_back(objects);
+        }
+        else if (name == "object" && !inTileset && !objectLayers.empty())
+        {
+            TiledObject object;
+            object.id = xml.getInt("id");
+            object.gid = (int)((unsigned int)strtoul(xml.getString("gid").c_str(), nullptr, 10) & GID_MASK);
+            object.name = xml.getString("name");
+            object.type = xml.get("type") ? xml.getString("type") : xml.getString("class");
+            object.x = xml.getFloat("x");
+            object.y = xml.getFloat("y");
+            object.width = xml.getFloat("width");
+            object.height = xml.getFloat("height");
+            object.rotation = xml.getFloat("rotation");
+            object.visible = xml.getInt("visible", 1) != 0;
+            objectLayers.back().objects.push_back(object);
+        }
+    }
+    return width > 0 || !tilesets.empty();
+}
+
+int TiledMap::getLayerIndex(const std::string &name) const
+{
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].name == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+const TiledObjectLayer *TiledMap::getObjectLayer(const std::string &name) const
+{
+    for (const TiledObjectLayer &layer : objectLayers)
+    {
+        if (layer.name == name)
+            return &layer;
+    }
+    return nullptr;
+}
+
+const TiledTileset *TiledMap::getTileset(int gid) const
+{
+    const TiledTileset *result = nullptr;
+    for (const TiledTileset &tileset : tilesets)
+    {
+        if (tileset.firstgid > gid)
+            break;
+        result = &tileset;
+    }
+    return result;
+}
+
+TileLayerComponent *TiledMap::createLayer(GameObject *object, int index)
+{
+    if (index < 0 || index >= (int)layers.size() || tilesets.empty())
+    {
+        Log(LOG_ERROR, "Tiled: invalid layer %d", index);
+        return nullptr;
+    }
+    const TileLayer &layer = layers[index];
+
+    // one texture per layer, the tileset of the first tile used
+    const TiledTileset *tiled = &tilesets[0];
+    for (int gid : layer.data)
+    {
+        if (gid != 0)
+        {
+            tiled = getTileset(gid);
+            break;
+        }
+    }
+    Tileset *tileset = tiled->tileset;
+
+    Assets &assets = Assets::Instance();
+    if (!assets.hasGraph(tileset->name))
+        assets.loadGraph(tileset->name, tileset->imageSource);
+
+    TileLayerComponent *component = object->AddComponent<TileLayerComponent>(
+        layer.width, layer.height,
+        tileset->tileWidth ? tileset->tileWidth : tileWidth,
+        tileset->tileHeight ? tileset->tileHeight : tileHeight,
+        tileset->spacing, tileset->margin,
+        assets.getGraphID(tileset->name));
+    component->setTileset(tileset);
+    component->loadFromLayer(layer, tiled->firstgid);
+    return component;
+}
+
+TileMapComponent *TiledMap::createMap(GameObject *object)
+{
+    if (layers.empty() || tilesets.empty())
+    {
+        Log(LOG_ERROR, "Tiled: no layers to create a map");
+        return nullptr;
+    }
+
+    const TiledTileset *tiled = &tilesets[0];
+    Tileset *tileset = tiled->tileset;
+    Assets &assets = Assets::Instance();
+    if (!assets.hasGraph(tileset->name))
+        assets.loadGraph(tileset->name, tileset->imageSource);
+
+    TileMapComponent *component = object->AddComponent<TileMapComponent>(
+        width, height,
+        tileset->tileWidth ? tileset->tileWidth : tileWidth,
+        tileset->tileHeight ? tileset->tileHeight : tileHeight,
+        tileset->spacing, tileset->margin,
+        assets.getGraphID(tileset->name));
+    component->setTileset(tileset);
+
+    for (const TileLayer &layer : layers)
+    {
+        bool other = false;
+        for (int gid : layer.data)
+        {
+            if (gid != 0)
+            {
+                other = getTileset(gid) != tiled;
+                if (other)
+                    break;
+            }
+        }
+        if (other)
+        {
+            Log(LOG_WARNING, "Tiled: layer %s uses another tileset, skipped", layer.name.c_str());
+            continue;
+        }
+        int index = component->addLayer(layer.name);
+        component->getLayer(index)->visible = layer.visible;
+        component->loadFromLayer(index, layer, tiled->firstgid);
+    }
+    return component;
+}
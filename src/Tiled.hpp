@@ -0,0 +1,77 @@
+#pragma once
+#include "Engine.hpp"
+
+//*********************************************************************************************************************
+//**                         Tiled                                                                                   **
+//*********************************************************************************************************************
+
+// Loader for Tiled maps (.tmj json and .tmx xml), parsed in place from the FileBuffer:
+// csv/array, base64, base64+zlib and base64+gzip layers, tilesets (inline or .tsx/.tsj) and object layers.
+// Tile layers keep the gids (0 = empty, flip bits removed), createLayer converts them to tileset ids.
+
+struct TiledTileset
+{
+    int firstgid;
+    Tileset *tileset; // owned by Assets
+    int columns;
+    int tileCount;
+};
+
+struct TiledObject
+{
+    int id;
+    int gid;
+    std::string name;
+    std::string type;
+    float x;
+    float y;
+    float width;
+    float height;
+    float rotation;
+    bool visible;
+};
+
+struct TiledObjectLayer
+{
+    std::string name;
+    bool visible;
+    std::vector<TiledObject> objects;
+};
+
+class TiledMap
+{
+public:
+    TiledMap();
+
+    bool load(const std::string &fileName);
+    void clear();
+
+    int width;
+    int height;
+    int tileWidth;
+    int tileHeight;
+    std::vector<TiledTileset> tilesets; // sorted by firstgid
+    std::vector<TileLayer> layers;
+    std::vector<TiledObjectLayer> objectLayers;
+
+    int getLayerIndex(const std::string &name) const;
+    const TiledObjectLayer *getObjectLayer(const std::string &name) const;
+    const TiledTileset *getTileset(int gid) const;
+
+    // add a TileLayerComponent with the layer tiles, the tileset image is loaded if needed
+    TileLayerComponent *createLayer(GameObject *object, int index);
+    // one TileMapComponent with every tile layer of the first tileset (layers of other tilesets are skipped)
+    TileMapComponent *createMap(GameObject *object);
+
+private:
+    std::string folder;
+
+    bool loadJson(const char *text, size_t size);
+    bool loadXml(const char *text, size_t size);
+    bool loadTileset(const std::string &fileName, TiledTileset &out);
+    void addTileset(const TiledTileset &tileset);
+    std::string getImagePath(const std::string &image) const;
+};
+
+// base64 layer payload -> gids, compression is "", "zlib" or "gzip"
+bool DecodeTiledLayer(const char *text, size_t size, const std::string &compression, std::vector<int> &out, size_t count);
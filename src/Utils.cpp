@@ -11,6 +11,8 @@
 /* ************************************************************************** */
 
 #include "Utils.hpp"
+#include <cfloat>
+#include "FileSystem.hpp"
 #include <raylib.h>
 
 void Log(int severity, const char *fmt, ...)
@@ -1136,8 +1138,8 @@ bool getTransparentPixel(Color *pixels,int width,int height, int x , int y)
 {
     if (x < 0  ) return false;
     if (y < 0 ) return false;
-    if (x > width ) return false;
-    if (y > height ) return false;
+    if (x >= width ) return false;
+    if (y >= height ) return false;
 
 
     Color r = pixels[y*width + x];
@@ -1190,142 +1192,468 @@ int CollidePixel(Color* as , Image a, int ax , int ay ,    Color* bs ,Image b, i
 }
 
 
-float memoryInMB(size_t bytes)
+//**************************************************************************************************
+//  OrientedBox
+//**************************************************************************************************
+
+static Vector2 UnitNormal(Vector2 edge)
 {
-    return static_cast<float>(bytes) / (1024.0f * 1024.0f);
+    float length = sqrtf(edge.x * edge.x + edge.y * edge.y);
+    if (length == 0)
+        return {0, 0};
+    return {-edge.y / length, edge.x / length};
 }
-float memoryInKB(size_t bytes)
+
+void OrientedBox::set(const Matrix2D &m, const Rectangle &local)
 {
-    return static_cast<float>(bytes) / 1024.0f;
+    float cx = local.x + local.width * 0.5f;
+    float cy = local.y + local.height * 0.5f;
+    center = {m.a * cx + m.c * cy + m.tx, m.b * cx + m.d * cy + m.ty};
+    u = {m.a * local.width * 0.5f, m.b * local.width * 0.5f};
+    v = {m.c * local.height * 0.5f, m.d * local.height * 0.5f};
+    normal[0] = UnitNormal(v);
+    normal[1] = UnitNormal(u);
+    float ex = fabsf(u.x) + fabsf(v.x);
+    float ey = fabsf(u.y) + fabsf(v.y);
+    bound = {center.x - ex, center.y - ey, ex * 2, ey * 2};
 }
 
-float memoryIn(size_t bytes)
+void OrientedBox::set(const Rectangle &rect)
 {
+    center = {rect.x + rect.width * 0.5f, rect.y + rect.height * 0.5f};
+    u = {rect.width * 0.5f, 0};
+    v = {0, rect.height * 0.5f};
+    normal[0] = {1, 0};
+    normal[1] = {0, 1};
+    bound = rect;
+}
 
-    if (bytes >= 1.0e6)
+static inline float ProjectedRadius(const OrientedBox &box, Vector2 axis)
+{
+    return fabsf(axis.x * box.u.x + axis.y * box.u.y) + fabsf(axis.x * box.v.x + axis.y * box.v.y);
+}
+
+bool OverlapOrientedBoxes(const OrientedBox &a, const OrientedBox &b, Vector2 *normal, float *depth)
+{
+    if (!CheckCollisionRecs(a.bound, b.bound))
+        return false;
+
+    Vector2 d = {b.center.x - a.center.x, b.center.y - a.center.y};
+    const Vector2 axes[4] = {a.normal[0], a.normal[1], b.normal[0], b.normal[1]};
+    float best = FLT_MAX;
+    Vector2 bestAxis = {1, 0};
+    for (int i = 0; i < 4; i++)
     {
-        return memoryInMB(bytes);
+        Vector2 n = axes[i];
+        if (n.x == 0 && n.y == 0)
+            continue;
+        float distance = n.x * d.x + n.y * d.y;
+        float overlap = ProjectedRadius(a, n) + ProjectedRadius(b, n) - fabsf(distance);
+        if (overlap < 0)
+            return false;
+        if (overlap < best)
+        {
+            best = overlap;
+            bestAxis = distance < 0 ? Vector2{-n.x, -n.y} : n;
+        }
     }
-    else if (bytes >= 1.0e3)
+    if (normal)
+        *normal = bestAxis;
+    if (depth)
+        *depth = best;
+    return true;
+}
+
+bool OverlapOrientedBoxCircle(const OrientedBox &a, Vector2 center, float radius, Vector2 *normal, float *depth)
+{
+    if (!CheckCollisionCircleRec(center, radius, a.bound))
+        return false;
+
+    // circle center in box coords (s, t in -1..1 inside)
+    float det = a.u.x * a.v.y - a.v.x * a.u.y;
+    if (det == 0)
+        return false;
+    float dx = center.x - a.center.x;
+    float dy = center.y - a.center.y;
+    float s = (dx * a.v.y - dy * a.v.x) / det;
+    float t = (a.u.x * dy - a.u.y * dx) / det;
+
+    if (fabsf(s) <= 1 && fabsf(t) <= 1)
     {
-        return memoryInKB(bytes);
+        // inside, out along the nearest side
+        float best = FLT_MAX;
+        Vector2 bestAxis = {1, 0};
+        for (int i = 0; i < 2; i++)
+        {
+            Vector2 n = a.normal[i];
+            float distance = n.x * dx + n.y * dy;
+            float overlap = ProjectedRadius(a, n) - fabsf(distance) + radius;
+            if (overlap < best)
+            {
+                best = overlap;
+                bestAxis = distance < 0 ? Vector2{-n.x, -n.y} : n;
+            }
+        }
+        if (normal)
+            *normal = bestAxis;
+        if (depth)
+            *depth = best;
+        return true;
     }
-    else
+
+    s = Clamp(s, -1, 1);
+    t = Clamp(t, -1, 1);
+    float px = a.center.x + a.u.x * s + a.v.x * t;
+    float py = a.center.y + a.u.y * s + a.v.y * t;
+    float ox = center.x - px;
+    float oy = center.y - py;
+    float distance2 = ox * ox + oy * oy;
+    if (distance2 > radius * radius)
+        return false;
+    float distance = sqrtf(distance2);
+    if (normal)
+        *normal = distance > 0 ? Vector2{ox / distance, oy / distance} : Vector2{1, 0};
+    if (depth)
+        *depth = radius - distance;
+    return true;
+}
+
+//**************************************************************************************************
+//  BitMask
+//**************************************************************************************************
+
+void BitMask::create(const Image &image, unsigned char threshold)
+{
+    width = image.width;
+    height = image.height;
+    stride = (width + 63) / 64 + 1;
+    bits.assign((size_t)stride * height, 0);
+    rowMin.assign(height, width);
+    rowMax.assign(height, -1);
+
+    Color *pixels = LoadImageColors(image);
+    if (!pixels)
+        return;
+    for (int y = 0; y < height; y++)
     {
-        return static_cast<float>(bytes);
+        uint64_t *row = bits.data() + (size_t)y * stride;
+        const Color *line = pixels + (size_t)y * width;
+        for (int x = 0; x < width; x++)
+        {
+            if (line[x].a <= threshold)
+                continue;
+            row[x >> 6] |= (uint64_t)1 << (x & 63);
+            if (rowMin[y] == width)
+                rowMin[y] = x;
+            rowMax[y] = x;
+        }
     }
+    UnloadImageColors(pixels);
 }
 
-std::string base64_decode(const std::string &base64_string) 
+bool BitMask::get(int x, int y) const
 {
-    const std::string base64_chars =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/";
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return false;
+    return (bits[(size_t)y * stride + (x >> 6)] >> (x & 63)) & 1;
+}
 
-    int i = 0;
-    int j = 0;
-    int in_len = base64_string.size();
-    unsigned char char_array_4[4], char_array_3[3];
-    std::string ret;
+static Rectangle MaskClip(const BitMask &mask, Rectangle clip)
+{
+    if (clip.width <= 0 || clip.height <= 0)
+        return {0, 0, (float)mask.width, (float)mask.height};
+    // inside the mask
+    float x = Clamp(floorf(clip.x), 0, (float)mask.width);
+    float y = Clamp(floorf(clip.y), 0, (float)mask.height);
+    return {x, y, Clamp(floorf(clip.width), 0, mask.width - x), Clamp(floorf(clip.height), 0, mask.height - y)};
+}
 
-    while (in_len-- && (base64_string[i] != '=') && (isalnum(base64_string[i]) || (base64_string[i] == '+') || (base64_string[i] == '/'))) {
-        char_array_4[j++] = base64_chars.find(base64_string[i++]);
-        if (j == 4) {
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+bool MaskCollide(const BitMask &a, Rectangle clipA, int ax, int ay, const BitMask &b, Rectangle clipB, int bx, int by)
+{
+    if (a.empty() || b.empty())
+        return false;
+    clipA = MaskClip(a, clipA);
+    clipB = MaskClip(b, clipB);
+    int cax = (int)clipA.x, cay = (int)clipA.y;
+    int cbx = (int)clipB.x, cby = (int)clipB.y;
+
+    // overlap in world, end exclusive
+    int x0 = std::max(ax, bx);
+    int y0 = std::max(ay, by);
+    int x1 = std::min(ax + (int)clipA.width, bx + (int)clipB.width);
+    int y1 = std::min(ay + (int)clipA.height, by + (int)clipB.height);
+    if (x0 >= x1 || y0 >= y1)
+        return false;
 
-            for (j = 0; j < 3; j++) {
-                ret += char_array_3[j];
-            }
-            j = 0;
+    // frame inside the mask, world -> mask column = x + da
+    int da = cax - ax;
+    int db = cbx - bx;
+    for (int y = y0; y < y1; y++)
+    {
+        int ra = y - ay + cay;
+        int rb = y - by + cby;
+
+        // solid spans of both rows, skips the row when they miss
+        int lo = std::max(x0, std::max(a.rowMin[ra] - da, b.rowMin[rb] - db));
+        int hi = std::min(x1 - 1, std::min(a.rowMax[ra] - da, b.rowMax[rb] - db));
+        for (int x = lo; x <= hi; x += 64)
+        {
+            int n = hi - x + 1;
+            uint64_t keep = n >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+            if (a.fetch(x + da, ra) & b.fetch(x + db, rb) & keep)
+                return true;
         }
     }
+    return false;
+}
 
-    if (j) {
-        for (int i = j; i < 4; i++) {
-            char_array_4[i] = 0;
-        }
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int LowestBit(uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+static Rectangle MaskBounds(const Matrix2D &m, const Rectangle &clip)
+{
+    float xs[4] = {0, clip.width, clip.width, 0};
+    float ys[4] = {0, 0, clip.height, clip.height};
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int i = 0; i < 4; i++)
+    {
+        float x = m.a * xs[i] + m.c * ys[i] + m.tx;
+        float y = m.b * xs[i] + m.d * ys[i] + m.ty;
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+    }
+    return {minX, minY, maxX - minX, maxY - minY};
+}
 
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+bool MaskCollide(const BitMask &a, Rectangle clipA, const Matrix2D &ta, const BitMask &b, Rectangle clipB, const Matrix2D &tb)
+{
+    if (a.empty() || b.empty())
+        return false;
+    clipA = MaskClip(a, clipA);
+    clipB = MaskClip(b, clipB);
+    if (!CheckCollisionRecs(MaskBounds(ta, clipA), MaskBounds(tb, clipB)))
+        return false;
 
-        for (int i = 0; i < j - 1; i++) {
-            ret += char_array_3[i];
+    // walk the solid pixels of the finer one (smaller pixels in world) and look them up in the other
+    float detA = fabsf(ta.a * ta.d - ta.b * ta.c);
+    float detB = fabsf(tb.a * tb.d - tb.b * tb.c);
+    bool swap = detB < detA;
+    const BitMask &src = swap ? b : a;
+    const BitMask &dst = swap ? a : b;
+    const Rectangle &clipSrc = swap ? clipB : clipA;
+    const Rectangle &clipDst = swap ? clipA : clipB;
+    const Matrix2D &ts = swap ? tb : ta;
+    const Matrix2D &td = swap ? ta : tb;
+
+    float det = td.a * td.d - td.b * td.c;
+    if (det == 0 || (ts.a * ts.d - ts.b * ts.c) == 0)
+        return false;
+    float inv = 1.0f / det;
+
+    // src pixel (u, v) -> dst pixel = origin + u * du + v * dv
+    float ox = ts.tx - td.tx;
+    float oy = ts.ty - td.ty;
+    Vector2 origin = {(td.d * ox - td.c * oy) * inv, (-td.b * ox + td.a * oy) * inv};
+    Vector2 du = {(td.d * ts.a - td.c * ts.b) * inv, (-td.b * ts.a + td.a * ts.b) * inv};
+    Vector2 dv = {(td.d * ts.c - td.c * ts.d) * inv, (-td.b * ts.c + td.a * ts.d) * inv};
+
+    int sx = (int)clipSrc.x, sy = (int)clipSrc.y;
+    int sw = (int)clipSrc.width, sh = (int)clipSrc.height;
+    int dx = (int)clipDst.x, dy = (int)clipDst.y;
+    int dw = (int)clipDst.width, dh = (int)clipDst.height;
+    for (int v = 0; v < sh; v++)
+    {
+        int row = sy + v;
+        int lo = std::max(src.rowMin[row], sx);
+        int hi = std::min(src.rowMax[row], sx + sw - 1);
+        float cv = v + 0.5f;
+        float rowX = origin.x + dv.x * cv;
+        float rowY = origin.y + dv.y * cv;
+        for (int x = lo; x <= hi; x += 64)
+        {
+            int n = hi - x + 1;
+            uint64_t word = src.fetch(x, row);
+            if (n < 64)
+                word &= ((uint64_t)1 << n) - 1;
+            while (word)
+            {
+                int bit = LowestBit(word);
+                word &= word - 1;
+                float cu = (x + bit - sx) + 0.5f;
+                int px = (int)floorf(rowX + du.x * cu);
+                int py = (int)floorf(rowY + du.y * cu);
+                if (px >= 0 && py >= 0 && px < dw && py < dh && dst.get(dx + px, dy + py))
+                    return true;
+            }
         }
     }
+    return false;
+}
 
-    return ret;
+//**************************************************************************************************
+//  WorkerPool
+//**************************************************************************************************
+
+WorkerPool::WorkerPool() : job(nullptr), busy(0), generation(0), running(true)
+{
 }
 
-std::string GetPath(const std::string &path)
+WorkerPool::~WorkerPool()
+{
+    setThreads(1);
+}
+
+void WorkerPool::setThreads(int count)
 {
-    if (FileExists(TextFormat("assets/%s", path.c_str())))
-    {
-        return TextFormat("assets/%s", path.c_str());
-    }else if (FileExists(TextFormat("../assets/%s", path.c_str())))
-    {
-        return TextFormat("../assets/%s", path.c_str());
-    } else if (FileExists(TextFormat("assets/images/%s", path.c_str())))
-    {
-        return TextFormat("assets/images/%s", path.c_str());
-    } else if (FileExists(TextFormat("../assets/images/%s", path.c_str())))
-    {
-        return TextFormat("../assets/images/%s", path.c_str());
-    } else if (FileExists(TextFormat("assets/textures/%s", path.c_str())))
     {
-        return TextFormat("assets/textures/%s", path.c_str());
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
     }
-    else if (FileExists(TextFormat("../assets/textures/%s", path.c_str())))
+    wake.notify_all();
+    for (auto &thread : threads)
     {
-        return TextFormat("../assets/textures/%s", path.c_str());
+        thread.join();
     }
-    else if (FileExists(TextFormat("assets/sounds/%s", path.c_str())))
-    {
-        return TextFormat("assets/sounds/%s", path.c_str());
-    }else if (FileExists(TextFormat("../assets/sounds/%s", path.c_str())))
+    threads.clear();
+
+    // a thread that starts late still takes the first dispatch
+    running = true;
+    for (int i = 1; i < count; i++)
     {
-        return TextFormat("../assets/sounds/%s", path.c_str());
+        threads.push_back(std::thread(&WorkerPool::worker, this, i, generation));
     }
-    return path;
 }
-bool FileInPath(const std::string &path)
+
+void WorkerPool::worker(int index, unsigned long seen)
 {
-    
-    if (FileExists(path.c_str()))
+    for (;;)
     {
-        return true;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]
+                      { return !running || generation != seen; });
+            if (!running)
+                return;
+            seen = generation;
+        }
+        (*job)(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        finished.notify_one();
     }
-    else if (FileExists(TextFormat("assets/%s", path.c_str())))
-    {
-        return true;
-    }else if (FileExists(TextFormat("../assets/%s", path.c_str())))
+}
+
+void WorkerPool::run(const std::function<void(int)> &job)
+{
+    if (threads.empty())
     {
-        return true;
-    } else if (FileExists(TextFormat("assets/images/%s", path.c_str())))
+        job(0);
+        return;
+    }
     {
-        return true;
-    } else if (FileExists(TextFormat("../assets/images/%s", path.c_str())))
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        busy = (int)threads.size();
+        generation++;
+    }
+    wake.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]
+                  { return busy == 0; });
+}
+
+float memoryInMB(size_t bytes)
+{
+    return static_cast<float>(bytes) / (1024.0f * 1024.0f);
+}
+float memoryInKB(size_t bytes)
+{
+    return static_cast<float>(bytes) / 1024.0f;
+}
+
+float memoryIn(size_t bytes)
+{
+
+    if (bytes >= 1.0e6)
     {
-        return true;
-    } else if (FileExists(TextFormat("assets/textures/%s", path.c_str())))
+        return memoryInMB(bytes);
+    }
+    else if (bytes >= 1.0e3)
     {
-        return true;
+        return memoryInKB(bytes);
     }
-    else if (FileExists(TextFormat("../assets/textures/%s", path.c_str())))
+    else
     {
-        return true;
+        return static_cast<float>(bytes);
     }
-    else if (FileExists(TextFormat("assets/sounds/%s", path.c_str())))
+}
+
+std::string base64_decode(const std::string &base64_string) 
+{
+    // 255 = not a base64 char (padding, white space...)
+    static unsigned char table[256];
+    static bool init = false;
+    if (!init)
     {
-        return true;
-    }else if (FileExists(TextFormat("../assets/sounds/%s", path.c_str())))
+        const char *base64_chars =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz"
+            "0123456789+/";
+        memset(table, 255, sizeof(table));
+        for (int i = 0; i < 64; i++)
+        {
+            table[(unsigned char)base64_chars[i]] = (unsigned char)i;
+        }
+        init = true;
+    }
+
+    std::string ret;
+    ret.reserve(base64_string.size() / 4 * 3);
+
+    unsigned int buffer = 0;
+    int bits = 0;
+    for (size_t i = 0; i < base64_string.size(); i++)
     {
-        return true;
+        char c = base64_string[i];
+        if (c == '=')
+            break;
+        unsigned char value = table[(unsigned char)c];
+        if (value == 255)
+            continue;
+        buffer = (buffer << 6) | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            ret += (char)((buffer >> bits) & 0xFF);
+        }
     }
-    
-    
-    return false;
-}
\ No newline at end of file
+
+    return ret;
+}
+
+std::string GetPath(const std::string &path)
+{
+    return FileSystem::Instance().getPath(path);
+}
+bool FileInPath(const std::string &path)
+{
+    return FileSystem::Instance().exists(path);
+}
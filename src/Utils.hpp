@@ -20,6 +20,7 @@
 #include <memory>
 
 #include <vector>
+#include <list>
 #include <map>
 #include <algorithm>
 #include <unordered_map>
@@ -27,8 +28,13 @@
 #include <memory>
 
 #include <bitset>
+#include <condition_variable>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #define CONSOLE_COLOR_RESET "\033[0m"
 #define CONSOLE_COLOR_GREEN "\033[1;32m"
@@ -77,6 +83,12 @@ typedef struct rQuad
 
 void Log(int severity, const char *fmt, ...);
 
+// FNV-1a, usable at compile time for literal keys
+constexpr uint32_t HashFNV(const char *str, uint32_t hash = 2166136261u)
+{
+    return *str ? HashFNV(str + 1, (hash ^ (uint32_t)(unsigned char)*str) * 16777619u) : hash;
+}
+
 //*********************************************************************************************************************
 //**                         Vec2                                                                              **
 //*********************************************************************************************************************
@@ -301,6 +313,83 @@ private:
 };
 
 
+// box under a Matrix2D (rotation, scale, skew): center plus the two half edges
+struct OrientedBox
+{
+    Vector2 center;
+    Vector2 u;         // half width edge
+    Vector2 v;         // half height edge
+    Vector2 normal[2]; // unit, perpendicular to v and u (the separating axes)
+    Rectangle bound;   // world AABB
+
+    void set(const Matrix2D &m, const Rectangle &local);
+    void set(const Rectangle &rect);
+};
+
+// separating axis test, normal goes from a to b
+bool OverlapOrientedBoxes(const OrientedBox &a, const OrientedBox &b, Vector2 *normal, float *depth);
+bool OverlapOrientedBoxCircle(const OrientedBox &a, Vector2 center, float radius, Vector2 *normal, float *depth);
+
+// one bit per pixel (alpha > threshold), each row ends with a spare zero word
+class BitMask
+{
+public:
+    BitMask() : width(0), height(0), stride(0) {}
+
+    void create(const Image &image, unsigned char threshold);
+    bool get(int x, int y) const;
+    // 64 pixels of row y from column x, column x in bit 0
+    uint64_t fetch(int x, int y) const
+    {
+        const uint64_t *row = bits.data() + (size_t)y * stride;
+        int word = x >> 6;
+        int shift = x & 63;
+        if (shift == 0)
+            return row[word];
+        return (row[word] >> shift) | (row[word + 1] << (64 - shift));
+    }
+    bool empty() const { return bits.empty(); }
+    size_t memory() const { return bits.size() * 8 + rowMin.size() * 8; }
+
+    int width;
+    int height;
+    int stride; // words per row
+    std::vector<uint64_t> bits;
+    std::vector<int> rowMin; // first solid column, width when the row is empty
+    std::vector<int> rowMax; // last solid column, -1 when the row is empty
+};
+
+// clip = frame inside the mask (width 0 = whole mask), ax/ay = world position of the clip top left
+bool MaskCollide(const BitMask &a, Rectangle clipA, int ax, int ay, const BitMask &b, Rectangle clipB, int bx, int by);
+// rotated/scaled, the matrices map clip pixels to world
+bool MaskCollide(const BitMask &a, Rectangle clipA, const Matrix2D &ta, const BitMask &b, Rectangle clipB, const Matrix2D &tb);
+
+// threads parked between jobs, the caller works as thread 0 and waits for the others
+class WorkerPool
+{
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    // counts the caller, 1 = no workers
+    void setThreads(int count);
+    int getThreads() const { return (int)threads.size() + 1; }
+    // job(index) on every thread, returns when all of them are done
+    void run(const std::function<void(int)> &job);
+
+private:
+    void worker(int index, unsigned long seen);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(int)> *job;
+    int busy;
+    unsigned long generation;
+    bool running;
+};
+
 void RenderTransform(Texture2D texture, const Matrix2D *matrix, int blend);
 void RenderTransformFlip(Texture2D texture, Rectangle clip, bool flipX, bool flipY, Color color, const Matrix2D *matrix, int blend);
 void RenderTransformFlipClip(Texture2D texture, int width, int height, Rectangle clip, bool flipX, bool flipY, Color color, const Matrix2D *matrix, int blend);
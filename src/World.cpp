@@ -0,0 +1,566 @@
+#include "World.hpp"
+#include "Scene.hpp"
+#include "TileMapFile.hpp"
+#include <cstdio>
+#include <cstring>
+
+//*********************************************************************************************************************
+//**                         WorldStreamer                                                                           **
+//*********************************************************************************************************************
+
+static std::string RegionPath(const std::string &folder, int x, int y)
+{
+    return folder + "/region_" + std::to_string(x) + "_" + std::to_string(y) + ".urtm";
+}
+
+static size_t RegionMemory(const WorldRegion &region)
+{
+    size_t bytes = 0;
+    for (auto tiles : region.tiles)
+    {
+        bytes += tiles->tileMap.memory();
+    }
+    for (auto &hidden : region.hidden)
+    {
+        bytes += hidden.cells.size() * hidden.cells.getCellSize();
+    }
+    return bytes;
+}
+
+WorldStreamer::WorldStreamer()
+{
+    prefetch = 1;
+    maxMemory = 64 * 1024 * 1024;
+    regionSize = 0;
+    tileWidth = 0;
+    tileHeight = 0;
+    columns = 0;
+    rows = 0;
+    memory = 0;
+    overCap = false;
+    running = false;
+}
+
+WorldStreamer::~WorldStreamer()
+{
+    stop();
+    for (auto load : done)
+    {
+        delete load;
+    }
+}
+
+bool WorldStreamer::open(const std::string &folder)
+{
+    close();
+
+    std::string fileName = folder + "/world.txt";
+    char *text = LoadFileText(fileName.c_str());
+    if (text == nullptr)
+    {
+        Log(LOG_ERROR, "WorldStreamer: reading %s", fileName.c_str());
+        return false;
+    }
+    int values[5] = {0, 0, 0, 0, 0};
+    int count = sscanf(text, "%d %d %d %d %d", &values[0], &values[1], &values[2], &values[3], &values[4]);
+    UnloadFileText(text);
+    if (count != 5 || values[0] <= 0 || values[1] <= 0 || values[2] <= 0 || values[3] <= 0 || values[4] <= 0)
+    {
+        Log(LOG_ERROR, "WorldStreamer: %s is not a valid world", fileName.c_str());
+        return false;
+    }
+
+    this->folder = folder;
+    regionSize = values[0];
+    tileWidth = values[1];
+    tileHeight = values[2];
+    columns = values[3];
+    rows = values[4];
+    placements.assign((size_t)columns * rows, std::vector<WorldPlacement>());
+    start();
+
+    Log(LOG_INFO, "WorldStreamer: %s %dx%d regions of %d tiles", folder.c_str(), columns, rows, regionSize);
+    return true;
+}
+
+void WorldStreamer::close(bool removeObjects)
+{
+    if (!isOpen())
+        return;
+
+    stop();
+    for (auto load : done)
+    {
+        delete load;
+    }
+    done.clear();
+    queue.clear();
+    requested.clear();
+
+    for (auto &it : regions)
+    {
+        unload(it.second, removeObjects);
+    }
+    regions.clear();
+    placements.clear();
+    memory = 0;
+    columns = 0;
+    rows = 0;
+}
+
+void WorldStreamer::addLayer(const std::string &name, int graphID, int layer, int spacing, int margin, Tileset *tileset)
+{
+    WorldLayer info;
+    info.name = name;
+    info.graphID = graphID;
+    info.layer = layer;
+    info.spacing = spacing;
+    info.margin = margin;
+    info.tileset = tileset;
+    layers.push_back(info);
+}
+
+void WorldStreamer::addObjects(const TiledObjectLayer &layer)
+{
+    if (!isOpen())
+    {
+        Log(LOG_ERROR, "WorldStreamer: addObjects before open");
+        return;
+    }
+    float regionWidth = (float)(regionSize * tileWidth);
+    float regionHeight = (float)(regionSize * tileHeight);
+    for (auto &object : layer.objects)
+    {
+        int x = Clamp((int)floorf(object.x / regionWidth), 0, columns - 1);
+        int y = Clamp((int)floorf(object.y / regionHeight), 0, rows - 1);
+        WorldPlacement placement;
+        placement.object = object;
+        placement.consumed = false;
+        placements[y * columns + x].push_back(placement);
+    }
+}
+
+std::string WorldStreamer::regionPath(int x, int y) const
+{
+    return RegionPath(folder, x, y);
+}
+
+//*********************************************************************************************************************
+//**                         Loader thread                                                                           **
+//*********************************************************************************************************************
+
+void WorldStreamer::start()
+{
+    running = true;
+    thread = std::thread(&WorldStreamer::worker, this);
+}
+
+void WorldStreamer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+void WorldStreamer::worker()
+{
+    for (;;)
+    {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return !running || !queue.empty(); });
+            if (!running)
+                return;
+            index = queue.front();
+            queue.pop_front();
+        }
+
+        // files are mapped, only compressed layers cost a decode here
+        WorldLoad *load = new WorldLoad();
+        load->index = index;
+        TileMapFile file;
+        if (file.openFile(regionPath(index % columns, index / columns)))
+        {
+            int count = file.count();
+            load->cells.resize(count);
+            for (int i = 0; i < count; i++)
+            {
+                const TileMapLayer *info = file.getLayer(i);
+                load->names.push_back(std::string(info->name, strnlen(info->name, sizeof(info->name))));
+                load->widths.push_back((int)info->width);
+                load->heights.push_back((int)info->height);
+                file.read(i, load->cells[i]);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done.push_back(load);
+    }
+}
+
+void WorldStreamer::request(int index)
+{
+    if (regions.find(index) != regions.end() || !requested.insert(index).second)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(index);
+    }
+    wake.notify_one();
+}
+
+//*********************************************************************************************************************
+//**                         Regions                                                                                 **
+//*********************************************************************************************************************
+
+void WorldStreamer::update(const Rectangle &view)
+{
+    if (!isOpen())
+        return;
+
+    float regionWidth = (float)(regionSize * tileWidth);
+    float regionHeight = (float)(regionSize * tileHeight);
+    int x0 = (int)floorf(view.x / regionWidth);
+    int y0 = (int)floorf(view.y / regionHeight);
+    int x1 = (int)floorf((view.x + view.width) / regionWidth);
+    int y1 = (int)floorf((view.y + view.height) / regionHeight);
+
+    // regions away from the view (0 = visible)
+    auto distance = [&](int index)
+    {
+        int x = index % columns;
+        int y = index / columns;
+        int dx = x < x0 ? x0 - x : (x > x1 ? x - x1 : 0);
+        int dy = y < y0 ? y0 - y : (y > y1 ? y - y1 : 0);
+        return std::max(dx, dy);
+    };
+    int keep = prefetch + 1;
+
+    std::vector<WorldLoad *> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(done);
+
+        // queued loads that went out of range
+        for (auto it = queue.begin(); it != queue.end();)
+        {
+            if (distance(*it) > keep)
+            {
+                requested.erase(*it);
+                it = queue.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    for (auto load : ready)
+    {
+        requested.erase(load->index);
+        if (distance(load->index) <= keep && regions.find(load->index) == regions.end())
+            integrate(load);
+        delete load;
+    }
+
+    // nearest first
+    for (int d = 0; d <= prefetch; d++)
+    {
+        for (int y = std::max(y0 - d, 0); y <= std::min(y1 + d, rows - 1); y++)
+        {
+            for (int x = std::max(x0 - d, 0); x <= std::min(x1 + d, columns - 1); x++)
+            {
+                int index = y * columns + x;
+                if (distance(index) == d)
+                    request(index);
+            }
+        }
+    }
+
+    memory = 0;
+    for (auto it = regions.begin(); it != regions.end();)
+    {
+        if (distance(it->first) > keep)
+        {
+            unload(it->second, true);
+            it = regions.erase(it);
+        }
+        else
+        {
+            memory += RegionMemory(it->second);
+            ++it;
+        }
+    }
+
+    // over the cap: farthest regions out of the prefetch ring go first (the ring is requested again every frame)
+    while (memory > maxMemory)
+    {
+        auto farthest = regions.end();
+        int best = prefetch;
+        for (auto it = regions.begin(); it != regions.end(); ++it)
+        {
+            int d = distance(it->first);
+            if (d > best)
+            {
+                best = d;
+                farthest = it;
+            }
+        }
+        if (farthest == regions.end())
+            break;
+        memory -= RegionMemory(farthest->second);
+        unload(farthest->second, true);
+        regions.erase(farthest);
+    }
+    if (memory > maxMemory && !overCap)
+        Log(LOG_WARNING, "World: %d KB needed around the view, memory cap is %d KB (smaller than the prefetch ring)", (int)(memory / 1024), (int)(maxMemory / 1024));
+    overCap = memory > maxMemory;
+}
+
+void WorldStreamer::integrate(WorldLoad *load)
+{
+    Scene *scene = Scene::Instance();
+    WorldRegion &region = regions[load->index];
+    region.x = load->index % columns;
+    region.y = load->index / columns;
+
+    for (size_t i = 0; i < load->cells.size(); i++)
+    {
+        const WorldLayer *info = nullptr;
+        for (auto &layer : layers)
+        {
+            if (layer.name == load->names[i])
+            {
+                info = &layer;
+                break;
+            }
+        }
+        if (!info)
+        {
+            // kept to be written back with the region
+            region.hidden.push_back(WorldCells());
+            WorldCells &hidden = region.hidden.back();
+            hidden.name = load->names[i];
+            hidden.width = load->widths[i];
+            hidden.height = load->heights[i];
+            hidden.cells.swap(load->cells[i]);
+            continue;
+        }
+
+        GameObject *object = new GameObject(info->name, info->layer);
+        TileLayerComponent *tiles = object->AddComponentManualInit<TileLayerComponent>(load->widths[i], load->heights[i], tileWidth, tileHeight, info->spacing, info->margin, info->graphID);
+        tiles->offset.x = (float)(region.x * regionSize * tileWidth);
+        tiles->offset.y = (float)(region.y * regionSize * tileHeight);
+        tiles->tileMap.assign(load->cells[i], load->widths[i], load->heights[i]);
+        tiles->setTileset(info->tileset);
+        tiles->OnInit();
+        scene->AddQueueObject(object);
+        region.tiles.push_back(tiles);
+        region.objects[object->id] = -1;
+    }
+
+    if (!spawner)
+        return;
+    std::vector<WorldPlacement> &list = placements[load->index];
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        if (list[i].consumed)
+            continue;
+        GameObject *object = spawner(list[i].object);
+        if (!object)
+            continue;
+        scene->AddQueueObject(object);
+        region.objects[object->id] = (int)i;
+    }
+}
+
+void WorldStreamer::unload(WorldRegion &region, bool removeObjects)
+{
+    bool changed = false;
+    for (auto tiles : region.tiles)
+    {
+        if (tiles->tileMap.isModified())
+            changed = true;
+    }
+    if (changed)
+    {
+        std::vector<TileMapEntry> entries;
+        std::vector<TileCells> cells(region.tiles.size());
+        for (size_t i = 0; i < region.tiles.size(); i++)
+        {
+            TileLayerComponent *tiles = region.tiles[i];
+            tiles->tileMap.toCells(cells[i]);
+            TileMapEntry entry = {tiles->object->name, tiles->width, tiles->height, &cells[i]};
+            entries.push_back(entry);
+        }
+        for (auto &hidden : region.hidden)
+        {
+            TileMapEntry entry = {hidden.name, hidden.width, hidden.height, &hidden.cells};
+            entries.push_back(entry);
+        }
+        TileMapFile::save(regionPath(region.x, region.y), entries, tileWidth, tileHeight, true);
+    }
+
+    if (!removeObjects)
+        return;
+
+    Scene *scene = Scene::Instance();
+    std::vector<WorldPlacement> &list = placements[region.y * columns + region.x];
+    std::unordered_set<unsigned long> found;
+    for (auto object : scene->gameObjects)
+    {
+        auto it = region.objects.find(object->id);
+        if (it == region.objects.end())
+            continue;
+        found.insert(object->id);
+        if (it->second >= 0 && (object->persistent || !object->alive))
+            list[it->second].consumed = true;
+        if (!object->persistent)
+            scene->RemoveGameObject(object);
+    }
+
+    // still queued, never reached the scene
+    std::vector<GameObject *> &queued = scene->gameObjectsToAdd;
+    for (auto it = queued.begin(); it != queued.end();)
+    {
+        GameObject *object = *it;
+        auto entry = region.objects.find(object->id);
+        if (entry == region.objects.end() || object->persistent)
+        {
+            if (entry != region.objects.end())
+            {
+                found.insert(object->id);
+                if (entry->second >= 0)
+                    list[entry->second].consumed = true;
+            }
+            ++it;
+            continue;
+        }
+        found.insert(object->id);
+        object->OnRemove();
+        delete object;
+        it = queued.erase(it);
+    }
+
+    // destroyed while the region was loaded
+    for (auto &it : region.objects)
+    {
+        if (it.second >= 0 && found.find(it.first) == found.end())
+            list[it.second].consumed = true;
+    }
+}
+
+TileLayerComponent *WorldStreamer::findTiles(const std::string &layer, int x, int y)
+{
+    if (!isOpen() || x < 0 || y < 0)
+        return nullptr;
+    int regionX = x / regionSize;
+    int regionY = y / regionSize;
+    if (regionX >= columns || regionY >= rows)
+        return nullptr;
+    auto it = regions.find(regionY * columns + regionX);
+    if (it == regions.end())
+        return nullptr;
+    for (auto tiles : it->second.tiles)
+    {
+        if (tiles->object->name == layer)
+            return tiles;
+    }
+    return nullptr;
+}
+
+int WorldStreamer::getTile(const std::string &layer, int x, int y)
+{
+    TileLayerComponent *tiles = findTiles(layer, x, y);
+    if (!tiles)
+        return -1;
+    return tiles->getTile(x % regionSize, y % regionSize);
+}
+
+void WorldStreamer::setTile(const std::string &layer, int x, int y, int tile)
+{
+    TileLayerComponent *tiles = findTiles(layer, x, y);
+    if (tiles)
+        tiles->setTile(x % regionSize, y % regionSize, tile);
+}
+
+bool WorldStreamer::bake(const std::string &folder, const std::vector<TileLayerComponent *> &layers, int regionSize, bool compress)
+{
+    if (layers.empty() || regionSize <= 0 || !DirectoryExists(folder.c_str()))
+    {
+        Log(LOG_ERROR, "WorldStreamer: bake %s", folder.c_str());
+        return false;
+    }
+    int width = layers[0]->width;
+    int height = layers[0]->height;
+    for (auto layer : layers)
+    {
+        if (layer->width != width || layer->height != height || layer->tileMap.getWidth() != width || layer->tileMap.getHeight() != height)
+        {
+            Log(LOG_ERROR, "WorldStreamer: bake layers must be %dx%d", width, height);
+            return false;
+        }
+    }
+
+    int columns = (width + regionSize - 1) / regionSize;
+    int rows = (height + regionSize - 1) / regionSize;
+    int saved = 0;
+    std::vector<int> tiles;
+    std::vector<TileCells> cells(layers.size());
+    for (int regionY = 0; regionY < rows; regionY++)
+    {
+        for (int regionX = 0; regionX < columns; regionX++)
+        {
+            int x0 = regionX * regionSize;
+            int y0 = regionY * regionSize;
+            int w = std::min(regionSize, width - x0);
+            int h = std::min(regionSize, height - y0);
+            tiles.resize((size_t)w * h);
+
+            std::vector<TileMapEntry> entries;
+            for (size_t i = 0; i < layers.size(); i++)
+            {
+                const TileChunks &source = layers[i]->tileMap;
+                bool empty = true;
+                for (int y = 0; y < h; y++)
+                {
+                    for (int x = 0; x < w; x++)
+                    {
+                        int tile = source.get(x0 + x, y0 + y);
+                        tiles[(size_t)y * w + x] = tile;
+                        empty = empty && tile == -1;
+                    }
+                }
+                if (empty)
+                    continue;
+                cells[i].assign(tiles.data(), tiles.size());
+                TileMapEntry entry = {layers[i]->object ? layers[i]->object->name : "", w, h, &cells[i]};
+                entries.push_back(entry);
+            }
+
+            std::string path = RegionPath(folder, regionX, regionY);
+            if (entries.empty())
+            {
+                std::remove(path.c_str());
+                continue;
+            }
+            if (!TileMapFile::save(path, entries, layers[0]->tileWidth, layers[0]->tileHeight, compress))
+                return false;
+            saved++;
+        }
+    }
+
+    std::string fileName = folder + "/world.txt";
+    const char *text = TextFormat("%d %d %d %d %d\n", regionSize, layers[0]->tileWidth, layers[0]->tileHeight, columns, rows);
+    if (!SaveFileText(fileName.c_str(), const_cast<char *>(text)))
+    {
+        Log(LOG_ERROR, "WorldStreamer: saving %s", fileName.c_str());
+        return false;
+    }
+    Log(LOG_INFO, "WorldStreamer: baked %s %d of %d regions", folder.c_str(), saved, columns * rows);
+    return true;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include "Engine.hpp"
+#include "Tiled.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+//*********************************************************************************************************************
+//**                         WorldStreamer                                                                           **
+//*********************************************************************************************************************
+
+// Open worlds split in regions of regionSize x regionSize tiles:
+//   folder/world.txt              regionSize tileWidth tileHeight columns rows
+//   folder/region_<x>_<y>.urtm    one TileMapFile per region, no file = empty region
+// Regions around the camera view are read by a loader thread (prefetch regions ahead), the far ones are
+// unloaded and written back when a tile changed. Object placements are spawned with their region;
+// persistent objects stay in the scene, destroyed and persistent ones are not spawned again.
+
+struct WorldLayer
+{
+    std::string name; // layer name in the region files
+    int graphID;
+    int layer; // scene layer
+    int spacing;
+    int margin;
+    Tileset *tileset;
+};
+
+struct WorldPlacement
+{
+    TiledObject object;
+    bool consumed;
+};
+
+// region layer without a WorldLayer, kept to be written back
+struct WorldCells
+{
+    std::string name;
+    int width;
+    int height;
+    TileCells cells;
+};
+
+struct WorldRegion
+{
+    int x;
+    int y;
+    std::vector<TileLayerComponent *> tiles;
+    std::vector<WorldCells> hidden;
+    std::unordered_map<unsigned long, int> objects; // GameObject id -> placement (-1 = tile layer)
+};
+
+// loader thread -> main thread
+struct WorldLoad
+{
+    int index;
+    std::vector<std::string> names;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<TileCells> cells;
+};
+
+class WorldStreamer
+{
+public:
+    static WorldStreamer &Instance()
+    {
+        static WorldStreamer instance;
+        return instance;
+    }
+    ~WorldStreamer();
+
+    bool open(const std::string &folder);
+    // writes back the changed regions, removeObjects = false when the scene frees them itself
+    void close(bool removeObjects = true);
+    bool isOpen() const { return columns > 0; }
+
+    void addLayer(const std::string &name, int graphID, int layer, int spacing = 0, int margin = 0, Tileset *tileset = nullptr);
+    // placements by position, spawner creates the GameObject (not added to the scene)
+    void addObjects(const TiledObjectLayer &layer);
+    std::function<GameObject *(const TiledObject &)> spawner;
+
+    // called by the Scene each frame
+    void update(const Rectangle &view);
+
+    // world tile coords, -1 when the region is not loaded
+    int getTile(const std::string &layer, int x, int y);
+    void setTile(const std::string &layer, int x, int y, int tile);
+
+    int getLoaded() const { return (int)regions.size(); }
+    size_t getMemory() const { return memory; }
+
+    // full size layers (same size) -> region files + world.txt, layers are named after their GameObject
+    static bool bake(const std::string &folder, const std::vector<TileLayerComponent *> &layers, int regionSize, bool compress);
+
+    int prefetch;     // regions loaded around the view
+    size_t maxMemory; // regions past the prefetch ring are unloaded first when over
+    int regionSize;
+    int tileWidth;
+    int tileHeight;
+    int columns;
+    int rows;
+
+private:
+    WorldStreamer();
+
+    void worker();
+    void start();
+    void stop();
+    void request(int index);
+    void integrate(WorldLoad *load);
+    void unload(WorldRegion &region, bool removeObjects);
+    TileLayerComponent *findTiles(const std::string &layer, int x, int y);
+    std::string regionPath(int x, int y) const;
+
+    std::string folder;
+    std::vector<WorldLayer> layers;
+    std::vector<std::vector<WorldPlacement>> placements; // per region
+    std::unordered_map<int, WorldRegion> regions;
+    std::unordered_set<int> requested;
+    size_t memory;
+    bool overCap;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> queue;
+    std::vector<WorldLoad *> done;
+    bool running;
+};
@@ -1,5 +1,11 @@
 #include "Engine.hpp"
 #include "Scene.hpp"
+#include "Pack.hpp"
+#include "Collision.hpp"
+#include "Steering.hpp"
+#include "Physics.hpp"
+#include <chrono>
+#include <sstream>
 
 
 
@@ -125,9 +131,211 @@ void testeMovements()
   scene.AddGameObject(wabbit);
 }
 
-int main()
+// ./game --bench-csv [width] [height]
+// old istringstream/ostringstream path against ParseTileCSV/WriteTileCSV, in MB/s
+int testeCSV(int argc, char **argv)
+{
+  int width = argc > 2 ? atoi(argv[2]) : 1000;
+  int height = argc > 3 ? atoi(argv[3]) : 1000;
+  std::vector<int> tiles((size_t)width * height);
+  for (size_t i = 0; i < tiles.size(); i++)
+    tiles[i] = (int)((i * 2654435761u) % 300) - 1;
+
+  auto now = []()
+  { return std::chrono::high_resolution_clock::now(); };
+  auto seconds = [](std::chrono::high_resolution_clock::time_point a, std::chrono::high_resolution_clock::time_point b)
+  { return std::chrono::duration<double>(b - a).count(); };
+
+  auto t0 = now();
+  std::ostringstream stream;
+  for (int y = 0; y < height; ++y)
+  {
+    for (int x = 0; x < width; ++x)
+    {
+      stream << tiles[y * width + x];
+      if (x < width - 1)
+        stream << ",";
+    }
+    stream << "\n";
+  }
+  std::string oldText = stream.str();
+  auto t1 = now();
+  std::string newText;
+  WriteTileCSV(tiles.data(), tiles.size(), width, newText);
+  auto t2 = now();
+
+  std::vector<int> oldTiles;
+  std::istringstream file(newText);
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::istringstream lineStream(line);
+    std::string cell;
+    while (std::getline(lineStream, cell, ','))
+      oldTiles.push_back(std::stoi(cell));
+  }
+  auto t3 = now();
+  std::vector<int> newTiles;
+  ParseTileCSV(newText.data(), newText.size(), 0, newTiles);
+  auto t4 = now();
+
+  double mb = newText.size() / (1024.0 * 1024.0);
+  Log(LOG_INFO, "CSV %dx%d %.2f MB same=%d", width, height, mb, (int)(oldText == newText && oldTiles == newTiles && newTiles == tiles));
+  Log(LOG_INFO, "write  stream %8.1f MB/s   WriteTileCSV %8.1f MB/s", mb / seconds(t0, t1), mb / seconds(t1, t2));
+  Log(LOG_INFO, "parse  stream %8.1f MB/s   ParseTileCSV %8.1f MB/s", mb / seconds(t2, t3), mb / seconds(t3, t4));
+  return 0;
+}
+
+// ./game --bench-collision [objects]
+// narrowphase over every pair of random boxes and circles, in ns per pair (-DCOLLISION_NO_SIMD for the scalar path)
+int testeCollision(int argc, char **argv)
+{
+  int total = argc > 2 ? atoi(argv[2]) : 3000;
+  srand(3);
+  std::vector<GameObject *> objects;
+  for (int i = 0; i < total; i++)
+  {
+    GameObject *object = new GameObject("shape");
+    object->transform->position.x = (float)(rand() % 2000);
+    object->transform->position.y = (float)(rand() % 2000);
+    if (i % 2)
+      object->AddComponent<BoxColiderComponent>(0, 0, (float)(5 + rand() % 40), (float)(5 + rand() % 40));
+    else
+      object->AddComponent<CircleColiderComponent>(0, 0, (float)(3 + rand() % 20));
+    objects.push_back(object);
+  }
+
+  CollisionSystem &collision = CollisionSystem::Instance();
+  collision.gather(objects);
+  std::vector<CollisionPair> pairs;
+  for (int a = 0; a < collision.getCount(); a++)
+    for (int b = a + 1; b < collision.getCount(); b++)
+      pairs.push_back({a, b});
+
+  std::vector<Contact> contacts;
+  collision.test(pairs, contacts); // warm up
+  contacts.clear();
+  auto t0 = std::chrono::high_resolution_clock::now();
+  collision.test(pairs, contacts);
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / pairs.size();
+  Log(LOG_INFO, "collision %d objects %d pairs %d contacts %.2f ns/pair", total, (int)pairs.size(), (int)contacts.size(), ns);
+  for (auto object : objects)
+    delete object;
+  return 0;
+}
+
+// ./game --bench-steering [agents]
+// flocking agents with wander, in ms per SteeringSystem update (-DSTEERING_NO_SIMD for the scalar path)
+int testeSteering(int argc, char **argv)
+{
+  int total = argc > 2 ? atoi(argv[2]) : 10000;
+  srand(1);
+  std::vector<GameObject *> agents;
+  for (int i = 0; i < total; i++)
+  {
+    GameObject *agent = new GameObject("boid");
+    agent->transform->position.x = (float)(rand() % 3000);
+    agent->transform->position.y = (float)(rand() % 3000);
+    SteeringComponent *steering = agent->AddComponent<SteeringComponent>(120.0f, 300.0f);
+    steering->setFlock(1.5f, 1.0f, 1.0f);
+    steering->wanderWeight = 0.3f;
+    steering->face = true;
+    steering->velocity = {(float)(rand() % 100 - 50), (float)(rand() % 100 - 50)};
+    agents.push_back(agent);
+  }
+
+  SteeringSystem &flock = SteeringSystem::Instance();
+  flock.update(1 / 60.0f); // warm up
+  const int frames = 60;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < frames; i++)
+    flock.update(1 / 60.0f);
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() / frames;
+  Log(LOG_INFO, "steering %d agents %.2f ms/update", flock.getCount(), ms);
+  for (auto agent : agents)
+    delete agent;
+  return 0;
+}
+
+// ./game --bench-physics [bodies]
+// boxes and circles dropped into a walled floor, in ms per PhysicsSystem update over 5 seconds
+int testePhysics(int argc, char **argv)
+{
+  int total = argc > 2 ? atoi(argv[2]) : 1500;
+  srand(3);
+  const Rectangle walls[3] = {{0, 700, 2000, 40}, {-40, -400, 40, 1140}, {2000, -400, 40, 1140}};
+  for (const Rectangle &wall : walls)
+  {
+    GameObject *object = new GameObject("wall");
+    object->transform->position.x = wall.x;
+    object->transform->position.y = wall.y;
+    object->AddComponent<BoxColiderComponent>(0, 0, wall.width, wall.height);
+    scene.gameObjects.push_back(object);
+  }
+  for (int i = 0; i < total; i++)
+  {
+    GameObject *object = new GameObject("body");
+    object->transform->position.x = (float)(20 + rand() % 1960);
+    object->transform->position.y = (float)(-300 + rand() % 800);
+    float size = (float)(8 + rand() % 10);
+    if (i % 2)
+      object->AddComponent<CircleColiderComponent>(0, 0, size);
+    else
+      object->AddComponent<BoxColiderComponent>(0, 0, size, size);
+    object->AddComponent<RigidBodyComponent>();
+    scene.gameObjects.push_back(object);
+  }
+
+  PhysicsSystem &physics = PhysicsSystem::Instance();
+  const int frames = 300;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < frames; i++)
+    physics.update(1 / 60.0f);
+  auto t1 = std::chrono::high_resolution_clock::now();
+
+  double ms = std::chrono::duration<double, std::milli>(t1 - t0).count() / frames;
+  Log(LOG_INFO, "physics %d bodies %.2f ms/update, %d awake %d contacts", physics.getCount(), ms, physics.getAwake(), physics.getContacts());
+  scene.ClearAndFree();
+  return 0;
+}
+
+// ./game --pack [folder] [file.pak] [--lz4]
+int buildPack(int argc, char **argv)
+{
+  PackWriter writer;
+  std::vector<std::string> args;
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--lz4") == 0)
+      writer.compress = true;
+    else
+      args.push_back(argv[i]);
+  }
+  std::string folder = args.size() > 0 ? args[0] : "assets";
+  std::string fileName = args.size() > 1 ? args[1] : "assets.pak";
+
+  if (writer.addDirectory(folder) == 0)
+    return 1;
+  return writer.save(fileName) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
 {
 
+  if (argc > 1 && strcmp(argv[1], "--pack") == 0)
+    return buildPack(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--bench-csv") == 0)
+    return testeCSV(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--bench-collision") == 0)
+    return testeCollision(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--bench-steering") == 0)
+    return testeSteering(argc, argv);
+  if (argc > 1 && strcmp(argv[1], "--bench-physics") == 0)
+    return testePhysics(argc, argv);
 
 
   InitWindow(screenWidth, screenHeight, "2D Engine");